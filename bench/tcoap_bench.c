@@ -0,0 +1,511 @@
+/**
+ * tcoap_bench.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: end-to-end load generator. It runs a stand-in CoAP server on the
+ *       loopback and drives several clients (one thread and one Linux port
+ *       per client) through 'tcoap_send_coap_request'. Throughput and
+ *       latency percentiles are printed as JSON, so results of the hot path
+ *       can be compared with a baseline.
+ *
+ *       Build it together with the library and the Linux port, e.g.:
+ *
+ *       cc -O2 -DTCOAP_MAX_PDU_SIZE=1024 -I. -Iport/linux -o tcoap-bench \
+ *          bench/tcoap_bench.c tcoap*.c port/linux/tcoap_port_*.c -lpthread
+ *
+ *       Usage: tcoap-bench [-t udp|tcp] [-m con|non] [-c clients]
+ *                          [-n requests] [-p payload] [-o options]
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "tcoap_port_linux.h"
+
+
+#define BENCH_MAX_OPTIONS               32
+#define BENCH_SERVER_BUF_LEN            (TCOAP_MAX_PDU_SIZE + 16)
+
+
+typedef struct bench_config {
+
+    uint16_t transport;
+    uint8_t type;
+    uint32_t clients;
+    uint32_t requests;        /* per client */
+    uint32_t payload_len;
+    uint32_t options;
+
+} bench_config;
+
+
+typedef struct bench_client {
+
+    const bench_config * cfg;
+    const char * service;
+
+    tcoap_linux_port port;
+
+    tcoap_option_data opts[BENCH_MAX_OPTIONS];
+    uint8_t opt_values[BENCH_MAX_OPTIONS][8];
+    uint8_t * payload;
+
+    uint32_t * latency_ns;    /* latencies of successful exchanges */
+    uint32_t done;
+    uint32_t errors;
+
+} bench_client;
+
+
+static int server_sock;
+static volatile bool server_stop;
+
+
+static uint64_t now_ns(void);
+static int cmp_latency(const void * a, const void * b);
+
+static uint32_t build_response(const uint8_t * req, const uint32_t len, uint8_t * resp, const bool tcp);
+static void * udp_server(void * arg);
+static void * tcp_server(void * arg);
+static void * tcp_connection(void * arg);
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
+static void * client_thread(void * arg);
+
+static void usage(const char * name);
+
+
+
+int main(int argc, char ** argv)
+{
+    bench_config cfg = { TCOAP_UDP, TCOAP_MESSAGE_CON, 4, 10000, 0, 0 };
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+    char service[16];
+    pthread_t server;
+    pthread_t * threads;
+    bench_client * clients;
+    uint32_t * latencies;
+    uint64_t total, errors, started;
+    double seconds;
+    int opt;
+    uint32_t i;
+
+    while ((opt = getopt(argc, argv, "t:m:c:n:p:o:h")) != -1) {
+        switch (opt) {
+            case 't':
+                cfg.transport = strcmp(optarg, "tcp") == 0 ? TCOAP_TCP : TCOAP_UDP;
+                break;
+
+            case 'm':
+                cfg.type = strcmp(optarg, "non") == 0 ? TCOAP_MESSAGE_NON : TCOAP_MESSAGE_CON;
+                break;
+
+            case 'c':
+                cfg.clients = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'n':
+                cfg.requests = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                cfg.payload_len = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'o':
+                cfg.options = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!cfg.clients || !cfg.requests || cfg.options > BENCH_MAX_OPTIONS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* stand-in server on the loopback */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_len = sizeof(addr);
+
+    server_sock = socket(AF_INET, cfg.transport == TCOAP_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+
+    if (server_sock < 0 || bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+            || getsockname(server_sock, (struct sockaddr *)&addr, &addr_len) != 0
+            || (cfg.transport == TCOAP_TCP && listen(server_sock, (int)cfg.clients) != 0)) {
+        perror("server");
+        return 1;
+    }
+
+    snprintf(service, sizeof(service), "%u", ntohs(addr.sin_port));
+    pthread_create(&server, NULL, cfg.transport == TCOAP_TCP ? tcp_server : udp_server, NULL);
+
+    /* clients */
+    threads = calloc(cfg.clients, sizeof(pthread_t));
+    clients = calloc(cfg.clients, sizeof(bench_client));
+    latencies = malloc((size_t)cfg.clients * cfg.requests * sizeof(uint32_t));
+
+    if (threads == NULL || clients == NULL || latencies == NULL) {
+        perror("alloc");
+        return 1;
+    }
+
+    started = now_ns();
+
+    for (i = 0; i < cfg.clients; ++i) {
+        clients[i].cfg = &cfg;
+        clients[i].service = service;
+        clients[i].latency_ns = latencies + (size_t)i * cfg.requests;
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+
+    total = 0;
+    errors = 0;
+
+    for (i = 0; i < cfg.clients; ++i) {
+        pthread_join(threads[i], NULL);
+
+        /* pack latencies of all clients together */
+        memmove(latencies + total, clients[i].latency_ns, clients[i].done * sizeof(uint32_t));
+        total += clients[i].done;
+        errors += clients[i].errors;
+    }
+
+    seconds = (double)(now_ns() - started) / 1e9;
+
+    server_stop = true;
+    shutdown(server_sock, SHUT_RDWR);
+    close(server_sock);
+
+    qsort(latencies, total, sizeof(uint32_t), cmp_latency);
+
+    printf("{\"transport\":\"%s\",\"type\":\"%s\",\"clients\":%u,\"requests\":%u,"
+           "\"payload\":%u,\"options\":%u,\"pdu\":%u,\"completed\":%llu,\"errors\":%llu,"
+           "\"seconds\":%.3f,\"throughput\":%.0f,",
+           cfg.transport == TCOAP_TCP ? "tcp" : "udp",
+           cfg.type == TCOAP_MESSAGE_NON ? "non" : "con",
+           cfg.clients, cfg.requests, cfg.payload_len, cfg.options, TCOAP_MAX_PDU_SIZE,
+           (unsigned long long)total, (unsigned long long)errors,
+           seconds, (double)total / seconds);
+
+    if (total) {
+        printf("\"latency_us\":{\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               latencies[total * 50 / 100] / 1e3,
+               latencies[total * 99 / 100] / 1e3,
+               latencies[total * 999 / 1000] / 1e3,
+               latencies[total - 1] / 1e3);
+    } else {
+        printf("\"latency_us\":null}\n");
+    }
+
+    free(latencies);
+    free(clients);
+    free(threads);
+
+    return errors ? 2 : 0;
+}
+
+
+
+static void * client_thread(void * arg)
+{
+    bench_client * const client = (bench_client *)arg;
+    const bench_config * const cfg = client->cfg;
+    tcoap_request_descriptor reqd;
+    uint64_t started;
+    uint32_t i;
+
+    client->port.handle.name = "bench";
+
+    if (tcoap_linux_port_open(&client->port, "127.0.0.1", client->service, cfg->transport) != TCOAP_OK) {
+        client->errors = cfg->requests;
+        return NULL;
+    }
+
+    if (cfg->transport == TCOAP_TCP && tcoap_start_connection(&client->port.handle) != TCOAP_OK) {
+        client->errors = cfg->requests;
+        tcoap_linux_port_close(&client->port);
+        return NULL;
+    }
+
+    /* request: Uri-Path segments and the payload of given length */
+    memset(&reqd, 0, sizeof(reqd));
+    reqd.type = cfg->type;
+    reqd.code = cfg->payload_len ? TCOAP_REQ_POST : TCOAP_REQ_GET;
+    reqd.tkl = 4;
+    reqd.response_callback = response_callback;
+
+    for (i = 0; i < cfg->options; ++i) {
+        client->opts[i].num = TCOAP_URI_PATH_OPT;
+        client->opts[i].len = (uint16_t)snprintf((char *)client->opt_values[i], sizeof(client->opt_values[i]), "seg%u", i);
+        client->opts[i].value = client->opt_values[i];
+        client->opts[i].next = i + 1 < cfg->options ? &client->opts[i + 1] : NULL;
+    }
+
+    reqd.options = cfg->options ? client->opts : NULL;
+
+    if (cfg->payload_len) {
+        client->payload = malloc(cfg->payload_len);
+        memset(client->payload, 'x', cfg->payload_len);
+    }
+
+    reqd.payload.buf = client->payload;
+    reqd.payload.len = cfg->payload_len;
+
+    for (i = 0; i < cfg->requests; ++i) {
+        started = now_ns();
+
+        if (tcoap_send_coap_request(&client->port.handle, &reqd) == TCOAP_OK) {
+            client->latency_ns[client->done++] = (uint32_t)(now_ns() - started);
+        } else {
+            client->errors++;
+        }
+    }
+
+    tcoap_linux_port_close(&client->port);
+    free(client->payload);
+
+    return NULL;
+}
+
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    (void)reqd;
+    (void)result;
+}
+
+
+
+/**
+ * @brief Build the response 2.05 to the request: ACK with the same message id
+ *        for CON, NON with another one for NON (UDP), the same token.
+ *
+ * @param req - pointer on the request (UDP datagram or TCP frame)
+ * @param len - length of request
+ * @param resp - buffer for the response
+ * @param tcp - the request is a TCP frame
+ *
+ * @return length of response, 0 if the request is invalid
+ */
+static uint32_t build_response(const uint8_t * req, const uint32_t len, uint8_t * resp, const bool tcp)
+{
+    static const uint8_t extra[4] = { 0, 1, 2, 4 };
+    uint32_t tkl;
+    uint32_t hl;
+
+    tkl = req[0] & 0x0F;
+
+    if (tcp) {
+        hl = 1 + extra[(req[0] >> 4) < 13 ? 0 : (req[0] >> 4) - 12] + 1;
+
+        if (len < hl + tkl) {
+            return 0;
+        }
+
+        resp[0] = (uint8_t)((3 << 4) | tkl);
+        resp[1] = TCOAP_RESP_SUCCESS_CONTENT_205;
+        memcpy(resp + 2, req + hl, tkl);
+        resp[2 + tkl] = 0xFF;
+        resp[3 + tkl] = 'o';
+        resp[4 + tkl] = 'k';
+
+        return 5 + tkl;
+    }
+
+    if (len < 4 + tkl) {
+        return 0;
+    }
+
+    if (((req[0] >> 4) & 0x03) == TCOAP_MESSAGE_NON) {
+        resp[0] = (uint8_t)(0x40 | (TCOAP_MESSAGE_NON << 4) | tkl);
+        resp[2] = (uint8_t)~req[2];
+    } else {
+        resp[0] = (uint8_t)(0x40 | (TCOAP_MESSAGE_ACK << 4) | tkl);
+        resp[2] = req[2];
+    }
+
+    resp[1] = TCOAP_RESP_SUCCESS_CONTENT_205;
+    resp[3] = req[3];
+    memcpy(resp + 4, req + 4, tkl);
+    resp[4 + tkl] = 0xFF;
+    resp[5 + tkl] = 'o';
+    resp[6 + tkl] = 'k';
+
+    return 7 + tkl;
+}
+
+
+static void * udp_server(void * arg)
+{
+    uint8_t req[BENCH_SERVER_BUF_LEN];
+    uint8_t resp[32];
+    struct sockaddr_in peer;
+    socklen_t peer_len;
+    ssize_t len;
+    uint32_t resp_len;
+
+    (void)arg;
+
+    while (!server_stop) {
+        peer_len = sizeof(peer);
+        len = recvfrom(server_sock, req, sizeof(req), 0, (struct sockaddr *)&peer, &peer_len);
+
+        if (len <= 0) {
+            break;
+        }
+
+        resp_len = build_response(req, (uint32_t)len, resp, false);
+
+        if (resp_len) {
+            sendto(server_sock, resp, resp_len, 0, (struct sockaddr *)&peer, peer_len);
+        }
+    }
+
+    return NULL;
+}
+
+
+static void * tcp_server(void * arg)
+{
+    pthread_t thread;
+    intptr_t sock;
+
+    (void)arg;
+
+    while (!server_stop) {
+        sock = accept(server_sock, NULL, NULL);
+
+        if (sock < 0) {
+            break;
+        }
+
+        pthread_create(&thread, NULL, tcp_connection, (void *)sock);
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+
+static void * tcp_connection(void * arg)
+{
+    static const uint8_t csm[] = { 0x30, 0xE1, 0x22, (uint8_t)(TCOAP_MAX_PDU_SIZE >> 8), (uint8_t)TCOAP_MAX_PDU_SIZE };
+    static const uint8_t extra[4] = { 0, 1, 2, 4 };
+    const int sock = (int)(intptr_t)arg;
+    uint8_t stream[BENCH_SERVER_BUF_LEN * 2];
+    uint8_t resp[32];
+    uint32_t have = 0;
+    uint32_t frame_len;
+    uint32_t hl;
+    uint32_t body;
+    ssize_t len;
+    uint32_t k;
+
+    if (send(sock, csm, sizeof(csm), MSG_NOSIGNAL) != (ssize_t)sizeof(csm)) {
+        close(sock);
+        return NULL;
+    }
+
+    for (;;) {
+        len = recv(sock, stream + have, sizeof(stream) - have, 0);
+
+        if (len <= 0) {
+            break;
+        }
+
+        have += (uint32_t)len;
+
+        /* answer every complete frame, signals of client (CSM) are skipped */
+        for (;;) {
+            if (!have) {
+                break;
+            }
+
+            hl = 1 + extra[(stream[0] >> 4) < 13 ? 0 : (stream[0] >> 4) - 12];
+
+            if (have < hl + 1) {
+                break;
+            }
+
+            body = stream[0] >> 4;
+
+            if (body >= 13) {
+                uint32_t ext = 0;
+
+                for (k = 1; k < hl; ++k) {
+                    ext = (ext << 8) | stream[k];
+                }
+
+                body = ext + (body == 13 ? 13 : body == 14 ? 269 : 65805);
+            }
+
+            frame_len = hl + 1 + (stream[0] & 0x0F) + body;
+
+            if (frame_len > sizeof(stream)) {
+                close(sock);
+                return NULL;
+            }
+
+            if (have < frame_len) {
+                break;
+            }
+
+            if (stream[hl] < TCOAP_TCP_SIGNAL_700) {
+                k = build_response(stream, frame_len, resp, true);
+                send(sock, resp, k, MSG_NOSIGNAL);
+            }
+
+            memmove(stream, stream + frame_len, have - frame_len);
+            have -= frame_len;
+        }
+    }
+
+    close(sock);
+    return NULL;
+}
+
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static int cmp_latency(const void * a, const void * b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-t udp|tcp] [-m con|non] [-c clients] [-n requests] [-p payload] [-o options(<=%u)]\n",
+            name, BENCH_MAX_OPTIONS);
+}
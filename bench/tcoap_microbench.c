@@ -0,0 +1,522 @@
+/**
+ * tcoap_microbench.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: microbenchmarks of the codec hot paths: 'encoding_options',
+ *       'decoding_options', 'tcoap_fill_block2_opt' and the whole exchange
+ *       over UDP and TCP (assembling of request and parsing of response).
+ *       The extern hooks are implemented here by a null transport: the
+ *       request is dropped, the prepared response is delivered immediately,
+ *       so only the work of library is measured. Results are ns/op and
+ *       bytes/op (encoded bytes for the codec, request + response for the
+ *       exchange).
+ *
+ *       Build it with the library only (not with a port), the TCP length
+ *       boundaries up to 65805 need the large PDU:
+ *
+ *       cc -O2 -DTCOAP_MAX_PDU_SIZE=66000 -I. -o tcoap-microbench \
+ *          bench/tcoap_microbench.c tcoap*.c
+ *
+ *       Usage: tcoap-microbench [-j] [-n iterations], '-j' prints JSON lines
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tcoap.h"
+#include "tcoap_utils.h"
+#include "tcoap_helpers.h"
+
+
+#define BENCH_MAX_OPTIONS               32
+#define BENCH_BUF_LEN                   2048
+#define BENCH_TOKEN                     0x5A
+
+
+typedef struct bench_option_set {
+
+    const char * name;
+    uint32_t count;
+    tcoap_option_data opts[BENCH_MAX_OPTIONS];
+
+} bench_option_set;
+
+
+static uint32_t iterations = 1000000;
+static bool json;
+
+static uint8_t value_buf[4096];      /* values of options */
+static uint32_t value_used;
+
+static uint8_t encoded[BENCH_BUF_LEN];
+static tcoap_option_data decoded[BENCH_MAX_OPTIONS + 1];
+
+static uint8_t response[64];         /* prepared response of null transport */
+static uint32_t response_len;
+static uint32_t tx_bytes;
+
+static volatile uint32_t sink;
+
+
+static uint64_t now_ns(void);
+static void report(const char * group, const char * name, const uint64_t ns, const uint32_t iters, const uint32_t bytes);
+
+static void add_option(bench_option_set * const set, const uint16_t num, const uint32_t len);
+static void build_sets(bench_option_set * const sets, uint32_t * const count);
+
+static void bench_encoding(const bench_option_set * const set);
+static void bench_decoding(const bench_option_set * const set);
+static void bench_block2(void);
+static void bench_exchange(const char * name, const uint16_t transport, const bench_option_set * const set, const uint32_t payload_len);
+static void bench_tcp_boundaries(void);
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
+
+
+
+int main(int argc, char ** argv)
+{
+    bench_option_set sets[8];
+    uint32_t count;
+    uint32_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "jn:")) != -1) {
+        switch (opt) {
+            case 'j':
+                json = true;
+                break;
+
+            case 'n':
+                iterations = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            default:
+                fprintf(stderr, "usage: %s [-j] [-n iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (!iterations) {
+        return 1;
+    }
+
+    build_sets(sets, &count);
+
+    if (!json) {
+        printf("%-10s %-28s %12s %10s\n", "group", "case", "ns/op", "bytes/op");
+    }
+
+    for (i = 0; i < count; ++i) {
+        bench_encoding(&sets[i]);
+    }
+
+    for (i = 0; i < count; ++i) {
+        bench_decoding(&sets[i]);
+    }
+
+    bench_block2();
+
+    for (i = 0; i < count; ++i) {
+        bench_exchange(sets[i].name, TCOAP_UDP, &sets[i], 0);
+        bench_exchange(sets[i].name, TCOAP_TCP, &sets[i], 0);
+    }
+
+    bench_tcp_boundaries();
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Option sets: typical requests with 0, 3, 8 and 20 options, long
+ *        Uri-Path and every class of extended delta and length.
+ *
+ */
+static void build_sets(bench_option_set * const sets, uint32_t * const count)
+{
+    bench_option_set * set;
+    uint32_t i;
+
+    memset(sets, 0, sizeof(bench_option_set) * 8);
+    set = sets;
+
+    set->name = "opts-0";
+    set++;
+
+    set->name = "opts-3";
+    add_option(set, TCOAP_URI_PATH_OPT, 7);
+    add_option(set, TCOAP_URI_PATH_OPT, 4);
+    add_option(set, TCOAP_CONTENT_FORMAT_OPT, 1);
+    set++;
+
+    set->name = "opts-8";
+    add_option(set, TCOAP_URI_HOST_OPT, 11);
+    add_option(set, TCOAP_URI_PORT_OPT, 2);
+    add_option(set, TCOAP_URI_PATH_OPT, 3);
+    add_option(set, TCOAP_URI_PATH_OPT, 6);
+    add_option(set, TCOAP_URI_PATH_OPT, 4);
+    add_option(set, TCOAP_CONTENT_FORMAT_OPT, 1);
+    add_option(set, TCOAP_URI_QUERY_OPT, 8);
+    add_option(set, TCOAP_ACCEPT_OPT, 1);
+    set++;
+
+    set->name = "opts-20";
+    for (i = 0; i < 16; ++i) {
+        add_option(set, TCOAP_URI_PATH_OPT, 4);
+    }
+    add_option(set, TCOAP_CONTENT_FORMAT_OPT, 1);
+    add_option(set, TCOAP_URI_QUERY_OPT, 6);
+    add_option(set, TCOAP_URI_QUERY_OPT, 6);
+    add_option(set, TCOAP_ACCEPT_OPT, 1);
+    set++;
+
+    set->name = "long-uri-path";
+    add_option(set, TCOAP_URI_PATH_OPT, 12);
+    add_option(set, TCOAP_URI_PATH_OPT, 40);
+    add_option(set, TCOAP_URI_PATH_OPT, 200);
+    set++;
+
+    /* delta: 4-bit, 8-bit, 16-bit; length: 4-bit, 8-bit, 16-bit */
+    set->name = "ext-delta-len";
+    add_option(set, TCOAP_IF_MATCH_OPT, 4);
+    add_option(set, TCOAP_URI_PATH_OPT, 12);
+    add_option(set, TCOAP_PROXY_URI_OPT, 300);
+    add_option(set, TCOAP_SIZE1_OPT, 2);
+    add_option(set, 2000, 20);
+    set++;
+
+    *count = (uint32_t)(set - sets);
+}
+
+
+static void add_option(bench_option_set * const set, const uint16_t num, const uint32_t len)
+{
+    tcoap_option_data * const option = &set->opts[set->count];
+    uint32_t i;
+
+    option->num = num;
+    option->len = (uint16_t)len;
+    option->value = value_buf + value_used;
+    option->next = NULL;
+
+    for (i = 0; i < len; ++i) {
+        value_buf[value_used++] = (uint8_t)('a' + i % 26);
+    }
+
+    if (set->count) {
+        set->opts[set->count - 1].next = option;
+    }
+
+    set->count++;
+}
+
+
+
+static void bench_encoding(const bench_option_set * const set)
+{
+    uint64_t started;
+    uint32_t len;
+    uint32_t i;
+
+    /* the codec is not called for requests without options */
+    if (!set->count) {
+        return;
+    }
+
+    len = 0;
+    started = now_ns();
+
+    for (i = 0; i < iterations; ++i) {
+        len = encoding_options(encoded, set->opts);
+        sink += len;
+    }
+
+    report("encode", set->name, now_ns() - started, iterations, len);
+}
+
+
+static void bench_decoding(const bench_option_set * const set)
+{
+    tcoap_data packet;
+    uint32_t payload_idx;
+    uint64_t started;
+    uint32_t i;
+
+    if (!set->count) {
+        return;
+    }
+
+    packet.buf = encoded;
+    packet.len = encoding_options(encoded, set->opts);
+
+    started = now_ns();
+
+    for (i = 0; i < iterations; ++i) {
+        decoding_options(&packet, decoded, 0, &payload_idx);
+        sink += payload_idx;
+    }
+
+    report("decode", set->name, now_ns() - started, iterations, packet.len);
+}
+
+
+static void bench_block2(void)
+{
+    static const uint32_t nums[3] = { 5, 2000, 1000000 };   /* 1, 2 and 3 bytes of value */
+    static const char * names[3] = { "block2-num-1byte", "block2-num-2byte", "block2-num-3byte" };
+    tcoap_blockwise_data bw;
+    tcoap_option_data option;
+    uint8_t value[4];
+    uint64_t started;
+    uint32_t i;
+    uint32_t k;
+
+    for (k = 0; k < 3; ++k) {
+        bw.fld.num = nums[k];
+        bw.fld.block_szx = 6;
+        bw.fld.more = 1;
+
+        started = now_ns();
+
+        for (i = 0; i < iterations; ++i) {
+            tcoap_fill_block2_opt(&option, &bw, value);
+            sink += option.len;
+        }
+
+        report("block2", names[k], now_ns() - started, iterations, option.len);
+    }
+}
+
+
+/**
+ * @brief Whole exchange over the null transport: assembling of request,
+ *        parsing of the prepared response and decoding of its options.
+ *
+ */
+static void bench_exchange(const char * name, const uint16_t transport, const bench_option_set * const set, const uint32_t payload_len)
+{
+    static uint8_t payload[70000];
+    static tcoap_handle handle;
+    tcoap_request_descriptor reqd;
+    uint32_t iters;
+    uint64_t started;
+    uint32_t i;
+
+    /* the request should fit into the PDU with the longest TCP header */
+    if ((set->count ? encoding_options_len(set->opts) : 0) + payload_len + 16 > TCOAP_MAX_PDU_SIZE) {
+        return;
+    }
+
+    memset(&handle, 0, sizeof(handle));
+    handle.name = "microbench";
+    handle.transport = transport;
+
+    memset(&reqd, 0, sizeof(reqd));
+    reqd.type = TCOAP_MESSAGE_CON;
+    reqd.code = payload_len ? TCOAP_REQ_POST : TCOAP_REQ_GET;
+    reqd.tkl = 4;
+    reqd.options = set->count ? (tcoap_option_data *)set->opts : NULL;
+    reqd.payload.buf = payload;
+    reqd.payload.len = payload_len;
+    reqd.response_callback = response_callback;
+
+    /* 2.05 "ok", the same token (see 'tcoap_fill_token'), the message id
+     * is copied from the request by 'tcoap_tx_data' */
+    memset(response, BENCH_TOKEN, sizeof(response));
+
+    if (transport == TCOAP_TCP) {
+        response[0] = (3 << 4) | 4;
+        response[1] = TCOAP_RESP_SUCCESS_CONTENT_205;
+        response_len = 6;
+    } else {
+        response[0] = 0x40 | (TCOAP_MESSAGE_ACK << 4) | 4;
+        response[1] = TCOAP_RESP_SUCCESS_CONTENT_205;
+        response_len = 8;
+    }
+
+    response[response_len++] = TCOAP_PAYLOAD_PREFIX;
+    response[response_len++] = 'o';
+    response[response_len++] = 'k';
+
+    /* large packets are slower, the time of run is kept about the same */
+    iters = payload_len > 1024 ? iterations / 100 + 1 : iterations / 4 + 1;
+
+    started = now_ns();
+
+    for (i = 0; i < iters; ++i) {
+        if (tcoap_send_coap_request(&handle, &reqd) != TCOAP_OK) {
+            fprintf(stderr, "exchange %s failed\n", name);
+            return;
+        }
+    }
+
+    report(transport == TCOAP_TCP ? "tcp" : "udp", name, now_ns() - started, iters, tx_bytes + response_len);
+}
+
+
+/**
+ * @brief TCP exchanges with the body length (options, marker, payload) at
+ *        the boundaries of Len classes: 12/13, 268/269, 65804/65805.
+ *
+ */
+static void bench_tcp_boundaries(void)
+{
+    static const uint32_t bodies[6] = { 12, 13, 268, 269, 65804, 65805 };
+    static const bench_option_set empty = { "", 0, { { 0 } } };
+    char name[32];
+    uint32_t i;
+
+    for (i = 0; i < 6; ++i) {
+        snprintf(name, sizeof(name), "body-len-%u", bodies[i]);
+        bench_exchange(name, TCOAP_TCP, &empty, bodies[i] - 1);
+    }
+}
+
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    (void)reqd;
+    sink += result->payload.len;
+}
+
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static void report(const char * group, const char * name, const uint64_t ns, const uint32_t iters, const uint32_t bytes)
+{
+    if (json) {
+        printf("{\"group\":\"%s\",\"case\":\"%s\",\"ns_per_op\":%.1f,\"bytes_per_op\":%u}\n",
+               group, name, (double)ns / iters, bytes);
+    } else {
+        printf("%-10s %-28s %12.1f %10u\n", group, name, (double)ns / iters, bytes);
+    }
+}
+
+
+
+/*
+ * Null transport: the request is dropped, the prepared response is delivered
+ * at once, so the exchange does not wait and measures the library only.
+ */
+
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    /* the ACK carries the message id of request */
+    if (handle->transport == TCOAP_UDP) {
+        response[2] = buf[2];
+        response[3] = buf[3];
+    }
+
+    tx_bytes = len;
+
+    return TCOAP_OK;
+}
+
+
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+
+    return tcoap_rx_packet(handle, response, response_len);
+}
+
+
+tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal)
+{
+    (void)handle;
+    (void)signal;
+
+    return TCOAP_OK;
+}
+
+
+uint16_t tcoap_get_message_id(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return 0x1234;
+}
+
+
+tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl)
+{
+    (void)handle;
+    memset(token, BENCH_TOKEN, tkl);
+
+    return TCOAP_OK;
+}
+
+
+uint32_t tcoap_get_time_ms(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return (uint32_t)(now_ns() / 1000000);
+}
+
+
+void tcoap_debug_print_packet(tcoap_handle * const handle, const char * msg, uint8_t * data, const uint32_t len)
+{
+    (void)handle; (void)msg; (void)data; (void)len;
+}
+
+
+void tcoap_debug_print_options(tcoap_handle * const handle, const char * msg, const tcoap_option_data * options)
+{
+    (void)handle; (void)msg; (void)options;
+}
+
+
+void tcoap_debug_print_payload(tcoap_handle * const handle, const char * msg, const tcoap_data * const payload)
+{
+    (void)handle; (void)msg; (void)payload;
+}
+
+
+tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len)
+{
+    *block = malloc(min_len);
+
+    return *block != NULL ? TCOAP_OK : TCOAP_NO_FREE_MEM_ERROR;
+}
+
+
+tcoap_error tcoap_free_mem_block(uint8_t * block, const uint32_t min_len)
+{
+    (void)min_len;
+    free(block);
+
+    return TCOAP_OK;
+}
+
+
+void mem_copy(void * dst, const void * src, uint32_t cnt)
+{
+    memcpy(dst, src, cnt);
+}
+
+
+bool mem_cmp(const void * dst, const void * src, uint32_t cnt)
+{
+    return memcmp(dst, src, cnt) == 0;
+}
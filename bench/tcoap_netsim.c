@@ -0,0 +1,1099 @@
+/**
+ * tcoap_netsim.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: deterministic simulator of a lossy network for the UDP exchanges:
+ *       retransmission of CON ('waiting_ack'), piggybacked and separate
+ *       responses and NON requests. The extern hooks are implemented here:
+ *       'tcoap_tx_data' puts the packet into the simulated network, which
+ *       loses, delays (latency +- jitter, so packets are reordered) and
+ *       duplicates it, 'tcoap_wait_event' runs the virtual time until the
+ *       next packet for the client arrives or the timeout expires, so the
+ *       timeouts of library pass without waiting. A stand-in server answers
+ *       the requests (after the processing delay), detects duplicates of
+ *       requests and retransmits its separate CON responses until they are
+ *       acknowledged. Packets which arrive out of exchange are dropped by
+ *       'tcoap_rx_packet' as on a device, late answers of the previous
+ *       exchange reach the next one.
+ *
+ *       All randomness comes from the seed, so a run is reproducible. For
+ *       each profile of network it reports the completion rate, results of
+ *       exchanges, retransmissions, goodput (payload of completed exchanges
+ *       per second of virtual time) and latency (p50/p90/p99/max).
+ *
+ *       Build it with the library only (not with a port):
+ *
+ *       cc -O2 -I. -o tcoap-netsim bench/tcoap_netsim.c tcoap*.c
+ *
+ *       Usage: tcoap-netsim [-P profile] [-n exchanges] [-s seed] [-l loss]
+ *                           [-d delay] [-J jitter] [-u dup] [-m] [-S]
+ *                           [-w ms] [-q len] [-r len] [-i ms] [-v] [-j]
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tcoap.h"
+
+
+#define NETSIM_MAX_EVENTS               1024
+#define NETSIM_MAX_PACKET               TCOAP_MAX_PDU_SIZE
+#define NETSIM_MAX_PENDING              16
+#define NETSIM_CACHE_SIZE               32
+
+/* transmission parameters of the stand-in server, rfc7252 4.8 */
+#define NETSIM_SERVER_ACK_TIMEOUT_MS    2000
+#define NETSIM_SERVER_MAX_RETRANSMIT    4
+
+#define NETSIM_TOKEN_LEN                4
+#define NETSIM_RESP_CODE                TCOAP_CODE(2, 5)
+
+
+typedef enum {
+
+    NETSIM_TO_SERVER = 0,
+    NETSIM_TO_CLIENT,
+    NETSIM_TIMER              /* the deferred answer of server should be sent */
+
+} netsim_event_kind;
+
+
+typedef struct netsim_profile {
+
+    const char * name;
+    double loss;              /* % of packets which are lost, in each direction */
+    uint32_t delay_ms;        /* one-way latency */
+    uint32_t jitter_ms;       /* latency is spread uniformly by +- jitter */
+    double dup;               /* % of packets which are duplicated */
+
+} netsim_profile;
+
+
+typedef struct netsim_event {
+
+    uint64_t at_ms;
+    uint32_t seq;             /* events of the same time are processed in order of scheduling */
+    netsim_event_kind kind;
+
+    uint32_t slot;            /* NETSIM_TIMER */
+    uint32_t generation;
+
+    uint32_t len;
+    uint8_t data[NETSIM_MAX_PACKET];
+
+} netsim_event;
+
+
+/* the answer of server which is sent after the processing delay */
+typedef struct netsim_pending {
+
+    bool active;
+    uint32_t generation;
+    uint16_t mid;             /* message ID of the answer */
+    bool confirmable;         /* separate CON, it is retransmitted until ACK */
+    bool sent;
+    uint32_t retries;
+    uint32_t timeout_ms;
+    uint32_t cache_idx;       /* entry of the request in the cache of duplicates */
+
+    uint32_t len;
+    uint8_t data[NETSIM_MAX_PACKET];
+
+} netsim_pending;
+
+
+/* the recent requests of client, rfc7252 4.5 */
+typedef struct netsim_cached {
+
+    bool valid;
+    uint16_t mid;
+    uint32_t len;             /* the answer for duplicates of CON, 0 while it is processed */
+    uint8_t data[NETSIM_MAX_PACKET];
+
+} netsim_cached;
+
+
+typedef struct netsim_result {
+
+    uint32_t exchanges;
+    uint32_t ok;
+    uint32_t timeouts;
+    uint32_t rejected;        /* an unexpected answer (e.g. late one of the previous exchange) ended the exchange */
+    uint32_t rsts;
+    uint32_t failed;
+
+    uint64_t client_tx;
+    uint64_t retransmissions;
+    uint64_t server_tx;
+    uint64_t server_retransmissions;
+    uint64_t server_dups;     /* duplicates of requests which were detected by server */
+    uint64_t lost;
+    uint64_t duplicated;
+    uint64_t late;            /* packets for the client which arrived out of exchange */
+    uint64_t wrong_packets;
+
+    uint64_t payload_bytes;
+    uint64_t duration_ms;
+
+    uint32_t * latency_ms;    /* of completed exchanges */
+
+} netsim_result;
+
+
+static const netsim_profile profiles[] = {
+    /* name          loss  delay jitter  dup */
+    { "ideal",        0.0,    10,     0, 0.0 },
+    { "lan",          0.5,     2,     1, 0.0 },
+    { "wan",          2.0,    80,    20, 0.1 },
+    { "cellular",     5.0,   150,   100, 0.5 },
+    { "lossy",       15.0,   200,   150, 1.0 },
+    { "satellite",    3.0,   600,    50, 0.0 },
+};
+
+#define NETSIM_PROFILES                 (sizeof(profiles) / sizeof(profiles[0]))
+
+
+static uint32_t exchanges = 1000;
+static uint64_t seed = 1;
+static bool non_requests;
+static bool separate;
+static uint32_t process_ms;
+static uint32_t req_len;
+static uint32_t resp_len = 32;
+static uint32_t interval_ms;
+static bool verbose;
+static bool json;
+
+static double loss_override = -1;
+static int64_t delay_override = -1;
+static int64_t jitter_override = -1;
+static double dup_override = -1;
+
+/* state of the running profile */
+static netsim_profile profile;
+static netsim_result result;
+static uint64_t rng_net;
+static uint64_t rng_ids;
+static uint64_t sim_now_ms;
+
+static netsim_event events[NETSIM_MAX_EVENTS];
+static uint32_t event_count;
+static uint32_t event_seq;
+
+static netsim_pending pending[NETSIM_MAX_PENDING];
+static uint32_t pending_generation;
+static netsim_cached cache[NETSIM_CACHE_SIZE];
+static uint32_t cache_next;
+
+static tcoap_handle handle;
+static uint16_t client_mid;
+static uint16_t server_mid;
+static bool answered;
+
+static uint8_t req_payload[NETSIM_MAX_PACKET];
+static uint8_t resp_payload[NETSIM_MAX_PACKET];
+
+
+static uint64_t now_ns(void);
+static uint32_t rnd(uint64_t * const state);
+static bool chance(uint64_t * const state, const double percent);
+
+static void run_profile(const uint32_t idx);
+static bool run_until(const uint64_t deadline_ms);
+static void net_send(const netsim_event_kind kind, const uint8_t * buf, const uint32_t len);
+static void push_event(const netsim_event_kind kind, const uint64_t at_ms, const uint8_t * buf, const uint32_t len, const uint32_t slot);
+static bool pop_event(const uint64_t deadline_ms, netsim_event * const ev);
+
+static void server_rx(const uint8_t * buf, const uint32_t len);
+static void server_timer(const uint32_t slot, const uint32_t generation);
+static void server_tx(const uint8_t * buf, const uint32_t len);
+static uint32_t assemble_answer(uint8_t * const buf, const uint8_t type, const uint8_t code, const uint16_t mid, const uint8_t * const token, const uint32_t tkl, const uint32_t payload_len);
+static void defer_answer(const uint8_t * const buf, const uint32_t len, const uint16_t mid, const bool confirmable, const uint32_t cache_idx);
+
+static void trace_packet(const char * dir, const uint8_t * buf, const uint32_t len, const uint64_t at_ms, const char * note);
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
+static int cmp_latency(const void * a, const void * b);
+static uint32_t percentile(const uint32_t * const sorted, const uint32_t count, const uint32_t p);
+static void report(void);
+static void usage(const char * name);
+
+
+
+int main(int argc, char ** argv)
+{
+    const char * name;
+    uint64_t started_at;
+    uint64_t virtual_ms;
+    uint32_t i;
+    bool found;
+    int opt;
+
+    name = NULL;
+
+    while ((opt = getopt(argc, argv, "P:n:s:l:d:J:u:mSw:q:r:i:vjh")) != -1) {
+        switch (opt) {
+            case 'P':
+                name = optarg;
+                break;
+
+            case 'n':
+                exchanges = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case 'l':
+                loss_override = strtod(optarg, NULL);
+                break;
+
+            case 'd':
+                delay_override = strtol(optarg, NULL, 10);
+                break;
+
+            case 'J':
+                jitter_override = strtol(optarg, NULL, 10);
+                break;
+
+            case 'u':
+                dup_override = strtod(optarg, NULL);
+                break;
+
+            case 'm':
+                non_requests = true;
+                break;
+
+            case 'S':
+                separate = true;
+                break;
+
+            case 'w':
+                process_ms = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'q':
+                req_len = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'r':
+                resp_len = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'i':
+                interval_ms = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'v':
+                verbose = true;
+                break;
+
+            case 'j':
+                json = true;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    /* header, token and the payload marker should fit into a PDU */
+    if (req_len > NETSIM_MAX_PACKET - 5 - NETSIM_TOKEN_LEN || resp_len > NETSIM_MAX_PACKET - 5 - NETSIM_TOKEN_LEN) {
+        fprintf(stderr, "payload is longer than %u bytes (TCOAP_MAX_PDU_SIZE)\n", NETSIM_MAX_PACKET - 5 - NETSIM_TOKEN_LEN);
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(req_payload); ++i) {
+        req_payload[i] = (uint8_t)('a' + i % 26);
+        resp_payload[i] = (uint8_t)('A' + i % 26);
+    }
+
+    if (!json) {
+        printf("%u %s exchanges, %s responses, seed %llu\n", exchanges, non_requests ? "NON" : "CON",
+               separate ? "separate" : "piggybacked", (unsigned long long)seed);
+        printf("%-10s %5s %5s %5s %5s | %6s %6s %6s %6s %6s | %6s %6s %6s | %9s | %6s %6s %6s %6s | %8s\n",
+               "profile", "loss%", "delay", "jit", "dup%", "done%", "ok", "tmout", "rejct", "rst",
+               "retr", "sretr", "late", "goodput", "p50", "p90", "p99", "max", "virt s");
+    }
+
+    started_at = now_ns();
+    virtual_ms = 0;
+    found = false;
+
+    for (i = 0; i < NETSIM_PROFILES; ++i) {
+        if (name != NULL && strcmp(name, profiles[i].name) != 0) {
+            continue;
+        }
+
+        found = true;
+
+        run_profile(i);
+        report();
+
+        virtual_ms += result.duration_ms;
+        free(result.latency_ms);
+    }
+
+    if (!found) {
+        fprintf(stderr, "unknown profile '%s'\n", name);
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!json) {
+        printf("%.1f s of virtual time in %.3f s\n", virtual_ms / 1000.0, (now_ns() - started_at) / 1e9);
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Run all exchanges of the profile (the profile is overridden by options)
+ *
+ * @param idx - index of profile in 'profiles', it seeds the network
+ */
+static void run_profile(const uint32_t idx)
+{
+    tcoap_request_descriptor reqd;
+    tcoap_error err;
+    uint64_t started_ms;
+    uint32_t i;
+
+    profile = profiles[idx];
+
+    if (loss_override >= 0) {
+        profile.loss = loss_override;
+    }
+
+    if (delay_override >= 0) {
+        profile.delay_ms = (uint32_t)delay_override;
+    }
+
+    if (jitter_override >= 0) {
+        profile.jitter_ms = (uint32_t)jitter_override;
+    }
+
+    if (dup_override >= 0) {
+        profile.dup = dup_override;
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.latency_ms = calloc(exchanges ? exchanges : 1, sizeof(uint32_t));
+
+    memset(pending, 0, sizeof(pending));
+    memset(cache, 0, sizeof(cache));
+    cache_next = 0;
+    event_count = 0;
+    event_seq = 0;
+    sim_now_ms = 0;
+
+    /* streams of the network and of identifiers are independent, so changing of
+     * the payload does not change the losses
+     */
+    rng_net = (seed + 1) * 0x9E3779B97F4A7C15ull ^ ((uint64_t)(idx + 1) << 32);
+    rng_ids = rng_net ^ 0xD1B54A32D192ED03ull;
+    rnd(&rng_net);
+    rnd(&rng_ids);
+
+    client_mid = (uint16_t)rnd(&rng_ids);
+    server_mid = (uint16_t)rnd(&rng_ids);
+
+    memset(&handle, 0, sizeof(handle));
+    handle.name = "netsim";
+    handle.transport = TCOAP_UDP;
+
+    memset(&reqd, 0, sizeof(reqd));
+    reqd.type = non_requests ? TCOAP_MESSAGE_NON : TCOAP_MESSAGE_CON;
+    reqd.code = req_len ? TCOAP_REQ_POST : TCOAP_REQ_GET;
+    reqd.tkl = NETSIM_TOKEN_LEN;
+    reqd.payload.buf = req_payload;
+    reqd.payload.len = req_len;
+    reqd.response_callback = response_callback;
+
+    for (i = 0; i < exchanges; ++i) {
+
+        started_ms = sim_now_ms;
+        answered = false;
+
+        err = tcoap_send_coap_request(&handle, &reqd);
+
+        result.exchanges++;
+
+        if (err == TCOAP_OK && answered) {
+            result.latency_ms[result.ok++] = (uint32_t)(sim_now_ms - started_ms);
+            result.payload_bytes += req_len + resp_len;
+        } else if (err == TCOAP_TIMEOUT_ERROR) {
+            result.timeouts++;
+        } else if (err == TCOAP_NO_ACK_ERROR || err == TCOAP_NO_RESP_ERROR) {
+            result.rejected++;
+        } else if (err == TCOAP_NRST_ANSWER) {
+            result.rsts++;
+        } else {
+            result.failed++;
+        }
+
+        result.duration_ms = sim_now_ms;
+
+        /* packets which arrive between exchanges are dropped by the library */
+        run_until(sim_now_ms + interval_ms);
+    }
+}
+
+
+/**
+ * @brief Run the virtual time: deliver packets to the server and to the
+ *        client, fire timers of server
+ *
+ * @param deadline_ms - the virtual time to stop at
+ *
+ * @return true if a packet was accepted by the client (the virtual time is
+ *         the time of its arrival), false if the deadline is reached
+ */
+static bool run_until(const uint64_t deadline_ms)
+{
+    static netsim_event ev;
+
+    while (pop_event(deadline_ms, &ev)) {
+
+        sim_now_ms = ev.at_ms;
+
+        switch (ev.kind) {
+            case NETSIM_TO_SERVER:
+                server_rx(ev.data, ev.len);
+                break;
+
+            case NETSIM_TIMER:
+                server_timer(ev.slot, ev.generation);
+                break;
+
+            case NETSIM_TO_CLIENT:
+                if (tcoap_rx_packet(&handle, ev.data, ev.len) == TCOAP_OK) {
+                    return true;
+                }
+
+                result.late++;
+
+                if (verbose) {
+                    trace_packet("s>c", ev.data, ev.len, sim_now_ms, "late");
+                }
+                break;
+        }
+    }
+
+    sim_now_ms = deadline_ms;
+
+    return false;
+}
+
+
+/**
+ * @brief Put the packet into the network: it may be lost or duplicated, each
+ *        copy gets its own latency
+ *
+ */
+static void net_send(const netsim_event_kind kind, const uint8_t * buf, const uint32_t len)
+{
+    const char * dir;
+    uint64_t at_ms;
+    uint32_t copies;
+    uint32_t spread;
+    int64_t latency;
+
+    dir = kind == NETSIM_TO_SERVER ? "c>s" : "s>c";
+    copies = 1;
+
+    if (chance(&rng_net, profile.dup)) {
+        copies++;
+        result.duplicated++;
+    }
+
+    while (copies--) {
+
+        if (chance(&rng_net, profile.loss)) {
+            result.lost++;
+
+            if (verbose) {
+                trace_packet(dir, buf, len, sim_now_ms, "lost");
+            }
+            continue;
+        }
+
+        latency = profile.delay_ms;
+
+        if (profile.jitter_ms) {
+            spread = rnd(&rng_net) % (2 * profile.jitter_ms + 1);
+            latency += (int64_t)spread - profile.jitter_ms;
+        }
+
+        at_ms = sim_now_ms + (latency > 0 ? (uint64_t)latency : 0);
+
+        if (verbose) {
+            trace_packet(dir, buf, len, at_ms, NULL);
+        }
+
+        push_event(kind, at_ms, buf, len, 0);
+    }
+}
+
+
+static void push_event(const netsim_event_kind kind, const uint64_t at_ms, const uint8_t * buf, const uint32_t len, const uint32_t slot)
+{
+    netsim_event * ev;
+
+    if (event_count == NETSIM_MAX_EVENTS) {
+        result.lost++;
+        return;
+    }
+
+    ev = &events[event_count++];
+
+    ev->at_ms = at_ms;
+    ev->seq = event_seq++;
+    ev->kind = kind;
+    ev->slot = slot;
+    ev->generation = kind == NETSIM_TIMER ? pending[slot].generation : 0;
+    ev->len = len;
+
+    if (len) {
+        mem_copy(ev->data, buf, len);
+    }
+}
+
+
+/**
+ * @brief Take the earliest event which is not later than the deadline
+ *
+ */
+static bool pop_event(const uint64_t deadline_ms, netsim_event * const ev)
+{
+    uint32_t best;
+    uint32_t i;
+
+    best = event_count;
+
+    for (i = 0; i < event_count; ++i) {
+        if (events[i].at_ms > deadline_ms) {
+            continue;
+        }
+
+        if (best == event_count || events[i].at_ms < events[best].at_ms
+                || (events[i].at_ms == events[best].at_ms && events[i].seq < events[best].seq)) {
+            best = i;
+        }
+    }
+
+    if (best == event_count) {
+        return false;
+    }
+
+    *ev = events[best];
+    events[best] = events[--event_count];
+
+    return true;
+}
+
+
+
+/**
+ * @brief The stand-in server: a piggybacked response (or an Empty ACK and the
+ *        separate CON response with '-S') for CON, NON response for NON
+ *
+ */
+static void server_rx(const uint8_t * buf, const uint32_t len)
+{
+    uint8_t answer[NETSIM_MAX_PACKET];
+    const uint8_t * token;
+    netsim_cached * entry;
+    uint32_t answer_len;
+    uint32_t cache_idx;
+    uint16_t mid;
+    uint8_t type;
+    uint8_t tkl;
+    uint32_t i;
+
+    if (len < 4 || (buf[0] >> 6) != 1) {
+        return;
+    }
+
+    type = (buf[0] >> 4) & 0x03;
+    tkl = buf[0] & 0x0F;
+    token = buf + 4;
+    mem_copy(&mid, buf + 2, sizeof(mid));
+
+    if (tkl > TCOAP_MAX_TOKEN_LEN || len < 4u + tkl) {
+        return;
+    }
+
+    /* ACK or RST of the separate response stops its retransmission */
+    if (type == TCOAP_MESSAGE_ACK || type == TCOAP_MESSAGE_RST) {
+        for (i = 0; i < NETSIM_MAX_PENDING; ++i) {
+            if (pending[i].active && pending[i].confirmable && pending[i].sent && pending[i].mid == mid) {
+                pending[i].active = false;
+            }
+        }
+        return;
+    }
+
+    /* duplicate of request */
+    for (i = 0; i < NETSIM_CACHE_SIZE; ++i) {
+        if (cache[i].valid && cache[i].mid == mid) {
+            result.server_dups++;
+
+            /* NON is processed once, CON is answered again when the answer is ready */
+            if (type == TCOAP_MESSAGE_CON && cache[i].len) {
+                server_tx(cache[i].data, cache[i].len);
+            }
+            return;
+        }
+    }
+
+    cache_idx = cache_next;
+    cache_next = (cache_next + 1) % NETSIM_CACHE_SIZE;
+
+    entry = &cache[cache_idx];
+    entry->valid = true;
+    entry->mid = mid;
+    entry->len = 0;
+
+    /* "CoAP ping" */
+    if (buf[1] == TCOAP_CODE_EMPTY_MSG) {
+        if (type == TCOAP_MESSAGE_CON) {
+            entry->len = assemble_answer(entry->data, TCOAP_MESSAGE_RST, TCOAP_CODE_EMPTY_MSG, mid, NULL, 0, 0);
+            server_tx(entry->data, entry->len);
+        }
+        return;
+    }
+
+    if (type == TCOAP_MESSAGE_NON) {
+        answer_len = assemble_answer(answer, TCOAP_MESSAGE_NON, NETSIM_RESP_CODE, server_mid++, token, tkl, resp_len);
+        defer_answer(answer, answer_len, 0, false, NETSIM_CACHE_SIZE);
+        return;
+    }
+
+    if (separate) {
+        /* the request is acknowledged at once, the response is sent later */
+        entry->len = assemble_answer(entry->data, TCOAP_MESSAGE_ACK, TCOAP_CODE_EMPTY_MSG, mid, NULL, 0, 0);
+        server_tx(entry->data, entry->len);
+
+        answer_len = assemble_answer(answer, TCOAP_MESSAGE_CON, NETSIM_RESP_CODE, server_mid, token, tkl, resp_len);
+        defer_answer(answer, answer_len, server_mid++, true, NETSIM_CACHE_SIZE);
+        return;
+    }
+
+    answer_len = assemble_answer(answer, TCOAP_MESSAGE_ACK, NETSIM_RESP_CODE, mid, token, tkl, resp_len);
+    defer_answer(answer, answer_len, mid, false, cache_idx);
+}
+
+
+/**
+ * @brief Timer of the deferred answer: the first transmission, then
+ *        retransmissions of the separate CON with the doubled timeout
+ *
+ */
+static void server_timer(const uint32_t slot, const uint32_t generation)
+{
+    netsim_pending * p;
+
+    p = &pending[slot];
+
+    /* the answer was acknowledged, or the slot was reused */
+    if (!p->active || p->generation != generation) {
+        return;
+    }
+
+    if (!p->confirmable) {
+        server_tx(p->data, p->len);
+
+        /* duplicates of the CON are answered by the piggybacked response from now */
+        if (p->cache_idx < NETSIM_CACHE_SIZE && cache[p->cache_idx].valid) {
+            mem_copy(cache[p->cache_idx].data, p->data, p->len);
+            cache[p->cache_idx].len = p->len;
+        }
+
+        p->active = false;
+        return;
+    }
+
+    if (!p->sent) {
+        p->sent = true;
+        p->timeout_ms = NETSIM_SERVER_ACK_TIMEOUT_MS + rnd(&rng_net) % (NETSIM_SERVER_ACK_TIMEOUT_MS / 2 + 1);
+    } else if (p->retries == NETSIM_SERVER_MAX_RETRANSMIT) {
+        p->active = false;
+        return;
+    } else {
+        p->retries++;
+        p->timeout_ms *= 2;
+        result.server_retransmissions++;
+    }
+
+    server_tx(p->data, p->len);
+    push_event(NETSIM_TIMER, sim_now_ms + p->timeout_ms, NULL, 0, slot);
+}
+
+
+static void server_tx(const uint8_t * buf, const uint32_t len)
+{
+    result.server_tx++;
+    net_send(NETSIM_TO_CLIENT, buf, len);
+}
+
+
+static uint32_t assemble_answer(uint8_t * const buf, const uint8_t type, const uint8_t code, const uint16_t mid, const uint8_t * const token, const uint32_t tkl, const uint32_t payload_len)
+{
+    uint32_t len;
+
+    buf[0] = (uint8_t)(0x40 | (type << 4) | tkl);
+    buf[1] = code;
+    mem_copy(buf + 2, &mid, sizeof(mid));
+    len = 4;
+
+    if (tkl) {
+        mem_copy(buf + len, token, tkl);
+        len += tkl;
+    }
+
+    if (payload_len) {
+        buf[len++] = 0xFF;
+        mem_copy(buf + len, resp_payload, payload_len);
+        len += payload_len;
+    }
+
+    return len;
+}
+
+
+/**
+ * @brief Send the answer after the processing delay of server
+ *
+ */
+static void defer_answer(const uint8_t * const buf, const uint32_t len, const uint16_t mid, const bool confirmable, const uint32_t cache_idx)
+{
+    netsim_pending * p;
+    uint32_t slot;
+
+    for (slot = 0; slot < NETSIM_MAX_PENDING; ++slot) {
+        if (!pending[slot].active) {
+            break;
+        }
+    }
+
+    /* the server is overloaded, the request is dropped */
+    if (slot == NETSIM_MAX_PENDING) {
+        return;
+    }
+
+    p = &pending[slot];
+
+    p->active = true;
+    p->generation = ++pending_generation;
+    p->mid = mid;
+    p->confirmable = confirmable;
+    p->sent = false;
+    p->retries = 0;
+    p->cache_idx = cache_idx;
+    p->len = len;
+    mem_copy(p->data, buf, len);
+
+    push_event(NETSIM_TIMER, sim_now_ms + process_ms, NULL, 0, slot);
+}
+
+
+
+static void trace_packet(const char * dir, const uint8_t * buf, const uint32_t len, const uint64_t at_ms, const char * note)
+{
+    static const char * const types[] = { "CON", "NON", "ACK", "RST" };
+    uint16_t mid;
+
+    mid = 0;
+
+    if (len >= 4) {
+        mem_copy(&mid, buf + 2, sizeof(mid));
+    }
+
+    fprintf(stderr, "%10llu ms %s %s %u.%02u mid %04x len %u ", (unsigned long long)sim_now_ms, dir,
+            len >= 1 ? types[(buf[0] >> 4) & 0x03] : "???", len >= 2 ? buf[1] >> 5 : 0, len >= 2 ? buf[1] & 0x1F : 0,
+            mid, len);
+
+    if (note != NULL) {
+        fprintf(stderr, "%s\n", note);
+    } else {
+        fprintf(stderr, "-> %llu ms\n", (unsigned long long)at_ms);
+    }
+}
+
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    (void)reqd;
+
+    answered = result->resp_code == NETSIM_RESP_CODE && result->payload.len == resp_len;
+}
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+/**
+ * @brief xorshift64* generator
+ *
+ */
+static uint32_t rnd(uint64_t * const state)
+{
+    uint64_t x;
+
+    x = *state ? *state : 0x2545F4914F6CDD1Dull;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return (uint32_t)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+
+static bool chance(uint64_t * const state, const double percent)
+{
+    if (percent <= 0) {
+        return false;
+    }
+
+    return rnd(state) < percent / 100.0 * 4294967296.0;
+}
+
+
+static int cmp_latency(const void * a, const void * b)
+{
+    uint32_t x;
+    uint32_t y;
+
+    x = *(const uint32_t *)a;
+    y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static uint32_t percentile(const uint32_t * const sorted, const uint32_t count, const uint32_t p)
+{
+    if (!count) {
+        return 0;
+    }
+
+    return sorted[((uint64_t)(count - 1) * p + 50) / 100];
+}
+
+
+static void report(void)
+{
+    double done;
+    double goodput;
+
+    qsort(result.latency_ms, result.ok, sizeof(uint32_t), cmp_latency);
+
+    done = result.exchanges ? 100.0 * result.ok / result.exchanges : 0.0;
+    goodput = result.duration_ms ? result.payload_bytes * 1000.0 / result.duration_ms : 0.0;
+
+    if (json) {
+        printf("{\"profile\":\"%s\",\"loss\":%.2f,\"delay_ms\":%u,\"jitter_ms\":%u,\"dup\":%.2f,"
+               "\"type\":\"%s\",\"separate\":%s,\"seed\":%llu,"
+               "\"exchanges\":%u,\"ok\":%u,\"completion\":%.2f,\"timeouts\":%u,\"rejected\":%u,\"rst\":%u,\"failed\":%u,"
+               "\"client_tx\":%llu,\"retransmissions\":%llu,\"server_tx\":%llu,\"server_retransmissions\":%llu,"
+               "\"server_dups\":%llu,\"lost\":%llu,\"duplicated\":%llu,\"late\":%llu,\"wrong_packets\":%llu,"
+               "\"goodput_bps\":%.1f,\"p50_ms\":%u,\"p90_ms\":%u,\"p99_ms\":%u,\"max_ms\":%u,\"virtual_ms\":%llu}\n",
+               profile.name, profile.loss, profile.delay_ms, profile.jitter_ms, profile.dup,
+               non_requests ? "NON" : "CON", separate ? "true" : "false", (unsigned long long)seed,
+               result.exchanges, result.ok, done, result.timeouts, result.rejected, result.rsts, result.failed,
+               (unsigned long long)result.client_tx, (unsigned long long)result.retransmissions,
+               (unsigned long long)result.server_tx, (unsigned long long)result.server_retransmissions,
+               (unsigned long long)result.server_dups, (unsigned long long)result.lost,
+               (unsigned long long)result.duplicated, (unsigned long long)result.late,
+               (unsigned long long)result.wrong_packets, goodput,
+               percentile(result.latency_ms, result.ok, 50), percentile(result.latency_ms, result.ok, 90),
+               percentile(result.latency_ms, result.ok, 99), result.ok ? result.latency_ms[result.ok - 1] : 0,
+               (unsigned long long)result.duration_ms);
+        return;
+    }
+
+    printf("%-10s %5.1f %5u %5u %5.1f | %6.2f %6u %6u %6u %6u | %6llu %6llu %6llu | %7.0f/s | %6u %6u %6u %6u | %8.1f\n",
+           profile.name, profile.loss, profile.delay_ms, profile.jitter_ms, profile.dup,
+           done, result.ok, result.timeouts, result.rejected, result.rsts,
+           (unsigned long long)result.retransmissions, (unsigned long long)result.server_retransmissions,
+           (unsigned long long)result.late, goodput,
+           percentile(result.latency_ms, result.ok, 50), percentile(result.latency_ms, result.ok, 90),
+           percentile(result.latency_ms, result.ok, 99), result.ok ? result.latency_ms[result.ok - 1] : 0,
+           result.duration_ms / 1000.0);
+}
+
+
+static void usage(const char * name)
+{
+    uint32_t i;
+
+    fprintf(stderr, "usage: %s [-P profile] [-n exchanges] [-s seed] [-l loss] [-d delay] [-J jitter] [-u dup]\n"
+                    "       [-m] [-S] [-w ms] [-q len] [-r len] [-i ms] [-v] [-j]\n"
+                    "  -P  run only this profile (all by default):", name);
+
+    for (i = 0; i < NETSIM_PROFILES; ++i) {
+        fprintf(stderr, " %s", profiles[i].name);
+    }
+
+    fprintf(stderr, "\n"
+                    "  -n  exchanges per profile (1000)\n"
+                    "  -s  seed of the network and identifiers (1)\n"
+                    "  -l  override the loss, %% of packets in each direction\n"
+                    "  -d  override the one-way latency, ms\n"
+                    "  -J  override the jitter (latency +- jitter), ms\n"
+                    "  -u  override the duplication, %% of packets\n"
+                    "  -m  send NON requests (CON by default)\n"
+                    "  -S  the server answers CON by an Empty ACK and the separate response\n"
+                    "  -w  processing delay of server, ms (0)\n"
+                    "  -q  payload of request, bytes (0, GET; POST otherwise)\n"
+                    "  -r  payload of response, bytes (32)\n"
+                    "  -i  interval between exchanges, ms (0)\n"
+                    "  -v  trace packets to stderr\n"
+                    "  -j  print results as JSON lines\n");
+}
+
+
+
+/*
+ * Simulated transport: packets of client go into the network, waiting runs
+ * the virtual time.
+ */
+
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    (void)handle;
+
+    result.client_tx++;
+    net_send(NETSIM_TO_SERVER, buf, len);
+
+    return TCOAP_OK;
+}
+
+
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    (void)handle;
+
+    return run_until(sim_now_ms + timeout_ms) ? TCOAP_OK : TCOAP_TIMEOUT_ERROR;
+}
+
+
+tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal)
+{
+    (void)handle;
+
+    if (signal == TCOAP_TX_RETR_PACKET) {
+        result.retransmissions++;
+    } else if (signal == TCOAP_WRONG_PACKET_DID_RECEIVE) {
+        result.wrong_packets++;
+    }
+
+    return TCOAP_OK;
+}
+
+
+uint16_t tcoap_get_message_id(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return client_mid++;
+}
+
+
+tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl)
+{
+    uint32_t value;
+    uint32_t i;
+
+    (void)handle;
+
+    value = 0;
+
+    for (i = 0; i < tkl; ++i) {
+        if (!(i & 3)) {
+            value = rnd(&rng_ids);
+        }
+
+        token[i] = (uint8_t)(value >> ((i & 3) * 8));
+    }
+
+    return TCOAP_OK;
+}
+
+
+#if defined(TCOAP_LIVENESS_ENABLED) || defined(TCOAP_STATS_ENABLED) || defined(TCOAP_CAPTURE_ENABLED)
+uint32_t tcoap_get_time_ms(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return (uint32_t)sim_now_ms;
+}
+#endif /* TCOAP_LIVENESS_ENABLED || TCOAP_STATS_ENABLED || TCOAP_CAPTURE_ENABLED */
+
+
+void tcoap_debug_print_packet(tcoap_handle * const handle, const char * msg, uint8_t * data, const uint32_t len)
+{
+    (void)handle; (void)msg; (void)data; (void)len;
+}
+
+
+void tcoap_debug_print_options(tcoap_handle * const handle, const char * msg, const tcoap_option_data * options)
+{
+    (void)handle; (void)msg; (void)options;
+}
+
+
+void tcoap_debug_print_payload(tcoap_handle * const handle, const char * msg, const tcoap_data * const payload)
+{
+    (void)handle; (void)msg; (void)payload;
+}
+
+
+tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len)
+{
+    *block = malloc(min_len);
+
+    return *block != NULL ? TCOAP_OK : TCOAP_NO_FREE_MEM_ERROR;
+}
+
+
+tcoap_error tcoap_free_mem_block(uint8_t * block, const uint32_t min_len)
+{
+    (void)min_len;
+    free(block);
+
+    return TCOAP_OK;
+}
+
+
+void mem_copy(void * dst, const void * src, uint32_t cnt)
+{
+    memmove(dst, src, cnt);
+}
+
+
+bool mem_cmp(const void * dst, const void * src, uint32_t cnt)
+{
+    return memcmp(dst, src, cnt) == 0;
+}
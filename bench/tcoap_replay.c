@@ -0,0 +1,1629 @@
+/**
+ * tcoap_replay.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: replay of captured traffic through the receiving path of library.
+ *       Answers of server (UDP datagrams and frames of TCP streams from the
+ *       port 5683) are read from pcap or pcapng files and delivered to
+ *       exchanges of 'tcoap_send_coap_request' by 'tcoap_rx_packet' (or by
+ *       'tcoap_rx_byte' with '-b', streams go through the TCP framer), so
+ *       they pass the same parsing as on a device. The message ID and token
+ *       of each request are taken from the last recorded request of the same
+ *       flow (or from the answer itself if there is none or with '-d'), so
+ *       late and foreign answers are rejected as they would be.
+ *
+ *       It reports the parse throughput (time spent inside the library),
+ *       results of exchanges and the distribution of rejects by reason
+ *       ('tcoap_reject_reason'). The timing of capture is preserved with
+ *       '-t', otherwise packets are replayed at full speed.
+ *
+ *       Build it with the library only, the statistics are needed:
+ *
+ *       cc -O2 -DTCOAP_STATS_ENABLED -I. -o tcoap-replay \
+ *          bench/tcoap_replay.c tcoap*.c
+ *
+ *       Usage: tcoap-replay [-p port] [-b] [-c chunk] [-t] [-d] [-j] file...
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "tcoap.h"
+#include "tcoap_tcp.h"
+
+
+#ifndef TCOAP_STATS_ENABLED
+#error "the replay reads reasons of rejects from statistics, define TCOAP_STATS_ENABLED"
+#endif
+
+
+#define REPLAY_HASH_SIZE                4096
+#define REPLAY_MAX_FRAME_LEN            (16u << 20)    /* longer TCP frames are taken as a broken stream */
+#define REPLAY_MAX_SNAPLEN              (256u << 10)
+
+#define REPLAY_PROTO_TCP                6
+#define REPLAY_PROTO_UDP                17
+
+#define REPLAY_TCP_FIN                  0x01
+#define REPLAY_TCP_SYN                  0x02
+#define REPLAY_TCP_RST                  0x04
+
+#define REPLAY_TO_SERVER                0
+#define REPLAY_TO_CLIENT                1
+
+
+typedef struct replay_buf {
+
+    uint8_t * data;
+    uint32_t len;
+    uint32_t size;
+
+} replay_buf;
+
+
+typedef struct replay_identity {
+
+    bool valid;
+    uint16_t mid;
+    uint8_t tkl;
+    uint8_t token[TCOAP_MAX_TOKEN_LEN];
+
+} replay_identity;
+
+
+typedef struct replay_flow {
+
+    struct replay_flow * next;
+    uint32_t bucket;
+
+    uint8_t proto;
+    uint16_t client_port;
+    uint8_t client[16];            /* IPv4 addresses are mapped into IPv6 */
+    uint8_t server[16];
+
+    replay_identity request;       /* the last recorded request of client */
+
+    replay_buf rx;                 /* UDP: datagrams of server with 32-bit length before each one, TCP: stream of server */
+    replay_buf tx;                 /* TCP: the incomplete frame of client */
+
+    uint32_t next_seq[2];          /* TCP by direction */
+    bool seq_known[2];
+    bool broken[2];                /* a segment was lost, the stream cannot be framed anymore */
+
+} replay_flow;
+
+
+typedef struct replay_packet {
+
+    uint64_t ts_ns;
+    uint32_t linktype;
+    const uint8_t * data;
+    uint32_t len;
+
+} replay_packet;
+
+
+typedef struct replay_reader {
+
+    FILE * file;
+    bool ng;                       /* pcapng */
+    bool swapped;                  /* byte order of file differs from the host one */
+
+    uint32_t linktype;             /* pcap */
+    uint64_t ts_unit_ns;           /* pcap: 1000 for microseconds, 1 for nanoseconds */
+
+    uint32_t if_count;             /* pcapng: interfaces of the current section */
+    uint32_t if_linktype[16];
+    uint64_t if_tsresol[16];       /* units per second */
+
+    uint8_t * buf;
+    uint32_t size;
+
+} replay_reader;
+
+
+typedef struct replay_counters {
+
+    uint64_t packets;
+    uint64_t skipped;              /* not IP, fragments, other ports, unknown link types */
+    uint64_t messages;             /* answers of server which were fed to the library */
+    uint64_t bytes;
+
+    uint64_t exchanges;
+    uint64_t ok;
+    uint64_t rsts;
+    uint64_t rejected;
+    uint64_t option_errors;
+    uint64_t unanswered;           /* the library awaited one more answer, but there was none */
+    uint64_t failed;
+
+    uint64_t tcp_gaps;
+    uint64_t truncated;            /* incomplete frames at the end of streams */
+
+    uint64_t parse_ns;
+
+} replay_counters;
+
+
+static const char * const reject_names[TCOAP_REJECT_REASONS] = {
+    "short", "version", "type", "empty", "mid", "tkl", "token", "code", "options"
+};
+
+static uint16_t server_port = 5683;
+static bool byte_mode;
+static uint32_t chunk_len;
+static bool timing;
+static bool derive;
+static bool json;
+
+static replay_flow * flows[REPLAY_HASH_SIZE];
+static replay_counters counters;
+
+static tcoap_handle udp_handle;
+static tcoap_handle tcp_handle;
+static tcoap_tcp_framer framer;
+static uint8_t framer_buf[TCOAP_MAX_PDU_SIZE];
+
+/* state of the running exchange, it is used by hooks */
+static replay_flow * current;
+static uint32_t feed_idx;          /* offset of the next answer in 'rx' of the current flow */
+static bool delivered;
+static replay_identity identity;
+
+static uint64_t first_ts_ns;
+static uint64_t started_ns;
+static bool started;
+
+
+static uint64_t now_ns(void);
+
+static bool open_reader(replay_reader * const reader, const char * const path);
+static bool read_packet(replay_reader * const reader, replay_packet * const pkt);
+static bool read_block(replay_reader * const reader, replay_packet * const pkt, bool * const got);
+static bool reserve(replay_reader * const reader, const uint32_t len);
+static uint16_t rd16(const replay_reader * const reader, const uint8_t * const buf);
+static uint32_t rd32(const replay_reader * const reader, const uint8_t * const buf);
+
+static void process_packet(const replay_packet * const pkt);
+static void process_udp(replay_flow * const flow, const uint32_t dir, const uint8_t * data, const uint32_t len);
+static void process_tcp(replay_flow * const flow, const uint32_t dir, const uint8_t * const tcp, const uint8_t * data, uint32_t len);
+
+static replay_flow * find_flow(const uint8_t proto, const uint8_t * const client, const uint16_t client_port, const uint8_t * const server, const bool create);
+static void close_flow(replay_flow * const flow);
+static void flush_flows(void);
+
+static bool next_message(const replay_flow * const flow, const uint32_t idx, const uint8_t ** msg, uint32_t * const len, uint32_t * const next);
+static bool awaits_more(const replay_flow * const flow, const uint8_t * const msg, const uint32_t len);
+static void run_ready(replay_flow * const flow, const bool flush);
+static void run_exchange(replay_flow * const flow, const uint8_t * const msg, const uint32_t len);
+static bool deliver(tcoap_handle * const handle, const uint8_t * msg, const uint32_t len);
+static void record_request(replay_flow * const flow, const uint8_t * const msg, const uint32_t len);
+static uint64_t frame_length(const uint8_t * const buf, const uint32_t len, uint32_t * const code_idx);
+
+static void buf_append(replay_buf * const buf, const uint8_t * data, const uint32_t len);
+static void buf_consume(replay_buf * const buf, const uint32_t len);
+static void buf_free(replay_buf * const buf);
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
+static void report(void);
+static void usage(const char * name);
+
+
+
+int main(int argc, char ** argv)
+{
+    replay_reader reader;
+    replay_packet pkt;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "p:bc:tdjh")) != -1) {
+        switch (opt) {
+            case 'p':
+                server_port = (uint16_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 'b':
+                byte_mode = true;
+                break;
+
+            case 'c':
+                chunk_len = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+
+            case 't':
+                timing = true;
+                break;
+
+            case 'd':
+                derive = true;
+                break;
+
+            case 'j':
+                json = true;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    udp_handle.name = "replay-udp";
+    udp_handle.transport = TCOAP_UDP;
+
+    tcp_handle.name = "replay-tcp";
+    tcp_handle.transport = TCOAP_TCP;
+
+    tcoap_tcp_framer_init(&framer, &tcp_handle, framer_buf, sizeof(framer_buf));
+
+    for (i = optind; i < argc; ++i) {
+
+        if (!open_reader(&reader, argv[i])) {
+            fprintf(stderr, "%s: not a pcap or pcapng file\n", argv[i]);
+            return 1;
+        }
+
+        while (read_packet(&reader, &pkt)) {
+            process_packet(&pkt);
+        }
+
+        /* flows do not continue in the next file */
+        flush_flows();
+
+        fclose(reader.file);
+        free(reader.buf);
+    }
+
+    report();
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Decode link, IP and transport layers and pass the payload to its flow
+ *
+ */
+static void process_packet(const replay_packet * const pkt)
+{
+    static const uint8_t v4_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+    const uint8_t * p;
+    const uint8_t * l4;
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint32_t len;
+    uint32_t ethertype;
+    uint32_t hl;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t proto;
+    uint32_t dir;
+    bool create;
+    replay_flow * flow;
+    uint64_t elapsed;
+    struct timespec ts;
+
+    counters.packets++;
+
+    if (timing) {
+        if (!started) {
+            first_ts_ns = pkt->ts_ns;
+            started_ns = now_ns();
+            started = true;
+        }
+
+        elapsed = pkt->ts_ns > first_ts_ns ? pkt->ts_ns - first_ts_ns : 0;
+
+        while (now_ns() - started_ns < elapsed) {
+            ts.tv_sec = 0;
+            ts.tv_nsec = 1000000;
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    p = pkt->data;
+    len = pkt->len;
+    ethertype = 0;
+
+    /* link layer */
+    switch (pkt->linktype) {
+        case 0:      /* NULL, the family is in the host order of capturing machine */
+        case 108:    /* LOOP */
+            if (len < 4) {
+                goto skip_label;
+            }
+
+            ethertype = (p[0] == 2 || p[3] == 2) ? 0x0800 : 0x86dd;
+            p += 4;
+            len -= 4;
+            break;
+
+        case 1:      /* Ethernet */
+            if (len < 14) {
+                goto skip_label;
+            }
+
+            ethertype = (p[12] << 8) | p[13];
+            p += 14;
+            len -= 14;
+
+            while ((ethertype == 0x8100 || ethertype == 0x88a8) && len >= 4) {
+                ethertype = (p[2] << 8) | p[3];
+                p += 4;
+                len -= 4;
+            }
+            break;
+
+        case 113:    /* Linux cooked */
+            if (len < 16) {
+                goto skip_label;
+            }
+
+            ethertype = (p[14] << 8) | p[15];
+            p += 16;
+            len -= 16;
+            break;
+
+        case 276:    /* Linux cooked v2 */
+            if (len < 20) {
+                goto skip_label;
+            }
+
+            ethertype = (p[0] << 8) | p[1];
+            p += 20;
+            len -= 20;
+            break;
+
+        case 12:
+        case 14:
+        case 101:    /* raw IP */
+        case 228:    /* IPv4 */
+        case 229:    /* IPv6 */
+            if (!len) {
+                goto skip_label;
+            }
+
+            ethertype = (p[0] >> 4) == 4 ? 0x0800 : 0x86dd;
+            break;
+
+        default:
+            goto skip_label;
+    }
+
+    /* IP */
+    if (ethertype == 0x0800) {
+        if (len < 20 || (p[0] >> 4) != 4) {
+            goto skip_label;
+        }
+
+        hl = (p[0] & 0x0f) * 4;
+
+        /* fragments are not reassembled */
+        if ((((p[6] << 8) | p[7]) & 0x3fff) || hl < 20) {
+            goto skip_label;
+        }
+
+        /* the padding of link layer is cut by the total length */
+        if (((uint32_t)(p[2] << 8) | p[3]) < len) {
+            len = (p[2] << 8) | p[3];
+        }
+
+        if (len < hl) {
+            goto skip_label;
+        }
+
+        proto = p[9];
+
+        mem_copy(src, v4_mapped, 12);
+        mem_copy(src + 12, p + 12, 4);
+        mem_copy(dst, v4_mapped, 12);
+        mem_copy(dst + 12, p + 16, 4);
+
+    } else if (ethertype == 0x86dd) {
+        if (len < 40 || (p[0] >> 4) != 6) {
+            goto skip_label;
+        }
+
+        if (40 + (uint32_t)((p[4] << 8) | p[5]) < len) {
+            len = 40 + ((p[4] << 8) | p[5]);
+        }
+
+        proto = p[6];
+        hl = 40;
+
+        mem_copy(src, p + 8, 16);
+        mem_copy(dst, p + 24, 16);
+
+        /* extension headers: hop-by-hop, routing, destination options */
+        while ((proto == 0 || proto == 43 || proto == 60) && len >= hl + 8) {
+            proto = p[hl];
+            hl += (p[hl + 1] + 1) * 8;
+        }
+
+        if (len < hl) {
+            goto skip_label;
+        }
+
+    } else {
+        goto skip_label;
+    }
+
+    l4 = p + hl;
+    len -= hl;
+
+    if (proto == REPLAY_PROTO_UDP) {
+        if (len < 8) {
+            goto skip_label;
+        }
+
+        if (((uint32_t)(l4[4] << 8) | l4[5]) < len) {
+            len = (l4[4] << 8) | l4[5];
+        }
+
+        if (len < 8) {
+            goto skip_label;
+        }
+
+        hl = 8;
+    } else if (proto == REPLAY_PROTO_TCP) {
+        if (len < 20 || len < (uint32_t)(l4[12] >> 4) * 4) {
+            goto skip_label;
+        }
+
+        hl = (l4[12] >> 4) * 4;
+    } else {
+        goto skip_label;
+    }
+
+    sport = (l4[0] << 8) | l4[1];
+    dport = (l4[2] << 8) | l4[3];
+
+    /* segments without data (e.g. the last ACK) do not open flows of TCP */
+    create = proto == REPLAY_PROTO_UDP || len > hl || (l4[13] & REPLAY_TCP_SYN);
+
+    if (sport == server_port) {
+        dir = REPLAY_TO_CLIENT;
+        flow = find_flow(proto, dst, dport, src, create);
+    } else if (dport == server_port) {
+        dir = REPLAY_TO_SERVER;
+        flow = find_flow(proto, src, sport, dst, create);
+    } else {
+        goto skip_label;
+    }
+
+    if (flow == NULL) {
+        return;
+    }
+
+    if (proto == REPLAY_PROTO_UDP) {
+        process_udp(flow, dir, l4 + hl, len - hl);
+    } else {
+        process_tcp(flow, dir, l4, l4 + hl, len - hl);
+    }
+
+    return;
+
+/***********/
+skip_label:
+/***********/
+
+    counters.skipped++;
+}
+
+
+/**
+ * @brief Datagrams of client set the identity of request, datagrams of server
+ *        are queued and replayed as soon as the exchange may be completed
+ *
+ */
+static void process_udp(replay_flow * const flow, const uint32_t dir, const uint8_t * data, const uint32_t len)
+{
+    if (dir == REPLAY_TO_SERVER) {
+        record_request(flow, data, len);
+        return;
+    }
+
+    buf_append(&flow->rx, (const uint8_t *)&len, sizeof(len));
+    buf_append(&flow->rx, data, len);
+
+    run_ready(flow, false);
+}
+
+
+/**
+ * @brief Segments are put in order by sequence numbers, the stream of client
+ *        sets the identity of request, the stream of server is replayed
+ *
+ */
+static void process_tcp(replay_flow * const flow, const uint32_t dir, const uint8_t * const tcp, const uint8_t * data, uint32_t len)
+{
+    const uint8_t * msg;
+    uint32_t seq;
+    uint32_t off;
+    uint32_t code_idx;
+    uint64_t frame_len;
+    uint8_t flags;
+
+    seq = ((uint32_t)tcp[4] << 24) | ((uint32_t)tcp[5] << 16) | ((uint32_t)tcp[6] << 8) | tcp[7];
+    flags = tcp[13];
+
+    if (flags & REPLAY_TCP_SYN) {
+        /* a new connection on the same ports */
+        if (dir == REPLAY_TO_SERVER && (flow->seq_known[REPLAY_TO_SERVER] || flow->rx.len)) {
+            run_ready(flow, true);
+
+            buf_free(&flow->rx);
+            buf_free(&flow->tx);
+            flow->seq_known[REPLAY_TO_CLIENT] = false;
+            flow->request.valid = false;
+        }
+
+        flow->next_seq[dir] = seq + 1;
+        flow->seq_known[dir] = true;
+        flow->broken[dir] = false;
+        seq++;
+    }
+
+    if (len && !flow->broken[dir]) {
+
+        /* the capture may start in the middle of stream */
+        if (!flow->seq_known[dir]) {
+            flow->next_seq[dir] = seq;
+            flow->seq_known[dir] = true;
+        }
+
+        if ((int32_t)(seq - flow->next_seq[dir]) < 0) {
+            /* retransmission, only the new part is taken */
+            off = flow->next_seq[dir] - seq;
+
+            if (off >= len) {
+                len = 0;
+            } else {
+                data += off;
+                len -= off;
+            }
+        } else if (seq != flow->next_seq[dir]) {
+            counters.tcp_gaps++;
+            flow->broken[dir] = true;
+            len = 0;
+        }
+
+        if (len) {
+            flow->next_seq[dir] += len;
+            buf_append(dir == REPLAY_TO_SERVER ? &flow->tx : &flow->rx, data, len);
+        }
+    }
+
+    if (dir == REPLAY_TO_SERVER) {
+        /* only the identity of the last request is needed */
+        for (;;) {
+            frame_len = frame_length(flow->tx.data, flow->tx.len, &code_idx);
+
+            if (frame_len > REPLAY_MAX_FRAME_LEN) {
+                flow->broken[dir] = true;
+                buf_free(&flow->tx);
+                break;
+            }
+
+            if (!frame_len || frame_len > flow->tx.len) {
+                break;
+            }
+
+            msg = flow->tx.data;
+
+            if (TCOAP_EXTRACT_CLASS(msg[code_idx]) == TCOAP_REQUEST_CLASS && msg[code_idx] != TCOAP_CODE_EMPTY_MSG
+                    && (msg[0] & 0x0f) <= TCOAP_MAX_TOKEN_LEN && code_idx + 1 + (msg[0] & 0x0f) <= frame_len) {
+                flow->request.valid = true;
+                flow->request.tkl = msg[0] & 0x0f;
+                mem_copy(flow->request.token, msg + code_idx + 1, flow->request.tkl);
+            }
+
+            buf_consume(&flow->tx, (uint32_t)frame_len);
+        }
+    } else {
+        if (frame_length(flow->rx.data, flow->rx.len, &code_idx) > REPLAY_MAX_FRAME_LEN) {
+            flow->broken[dir] = true;
+            counters.truncated++;
+            buf_free(&flow->rx);
+        }
+
+        run_ready(flow, false);
+    }
+
+    if (flags & (REPLAY_TCP_FIN | REPLAY_TCP_RST)) {
+        close_flow(flow);
+    }
+}
+
+
+/**
+ * @brief Set the identity of request by a request of client (UDP)
+ *
+ */
+static void record_request(replay_flow * const flow, const uint8_t * const msg, const uint32_t len)
+{
+    uint8_t tkl;
+
+    if (len < 4 || (msg[0] >> 6) != TCOAP_DEFAULT_VERSION
+            || TCOAP_EXTRACT_CLASS(msg[1]) != TCOAP_REQUEST_CLASS || msg[1] == TCOAP_CODE_EMPTY_MSG) {
+        return;
+    }
+
+    tkl = msg[0] & 0x0f;
+
+    if (tkl > TCOAP_MAX_TOKEN_LEN || len < 4u + tkl) {
+        return;
+    }
+
+    flow->request.valid = true;
+    /* the message ID is taken as 'tcoap_get_message_id' gives it to the header */
+    mem_copy(&flow->request.mid, msg + 2, sizeof(flow->request.mid));
+    flow->request.tkl = tkl;
+    mem_copy(flow->request.token, msg + 4, tkl);
+}
+
+
+/**
+ * @brief Run exchanges for the queued answers of server. An Empty ACK (UDP)
+ *        and a Ping (TCP) are followed by one more answer which is awaited
+ *        by the library in the same exchange, so they wait for it.
+ *
+ * @param flow - the flow
+ * @param flush - run exchanges for all queued answers (the end of flow)
+ */
+static void run_ready(replay_flow * const flow, const bool flush)
+{
+    const uint8_t * msg;
+    const uint8_t * second;
+    uint32_t len;
+    uint32_t second_len;
+    uint32_t next;
+
+    while (next_message(flow, 0, &msg, &len, &next)) {
+
+        if (!flush && awaits_more(flow, msg, len) && !next_message(flow, next, &second, &second_len, &next)) {
+            break;
+        }
+
+        run_exchange(flow, msg, len);
+    }
+
+    if (flush && flow->rx.len) {
+        counters.truncated++;
+        buf_free(&flow->rx);
+    }
+
+    /* flows of UDP live long, their buffers do not */
+    if (!flow->rx.len) {
+        buf_free(&flow->rx);
+    }
+}
+
+
+/**
+ * @brief Run one exchange which is answered by the first queued message
+ *        (and by the next ones if the library awaits them)
+ *
+ */
+static void run_exchange(replay_flow * const flow, const uint8_t * const msg, const uint32_t len)
+{
+    tcoap_request_descriptor reqd;
+    tcoap_handle * handle;
+    tcoap_error err;
+    const uint8_t * src;
+    uint32_t src_len;
+    uint32_t next;
+    uint32_t code_idx;
+    uint64_t started_at;
+    uint8_t type;
+
+    memset(&reqd, 0, sizeof(reqd));
+    reqd.code = TCOAP_REQ_GET;
+    reqd.response_callback = response_callback;
+
+    /* the token of request is carried by the answer after an Empty ACK or Ping */
+    if (!awaits_more(flow, msg, len) || !next_message(flow, 0, &src, &src_len, &next)
+            || !next_message(flow, next, &src, &src_len, &next)) {
+        src = msg;
+        src_len = len;
+    }
+
+    if (flow->proto == REPLAY_PROTO_UDP) {
+        handle = &udp_handle;
+
+        type = len >= 4 ? (msg[0] >> 4) & 0x03 : TCOAP_MESSAGE_NON;
+
+        /* an ACK or RST answers the CON, a separate response answers any request */
+        reqd.type = (type == TCOAP_MESSAGE_ACK || type == TCOAP_MESSAGE_RST) ? TCOAP_MESSAGE_CON : TCOAP_MESSAGE_NON;
+
+        if (flow->request.valid && !derive) {
+            identity = flow->request;
+        } else {
+            identity.mid = 0;
+            identity.tkl = src_len >= 4 ? src[0] & 0x0f : 0;
+
+            if (len >= 4) {
+                mem_copy(&identity.mid, msg + 2, sizeof(identity.mid));
+            }
+
+            if (reqd.type == TCOAP_MESSAGE_NON) {
+                identity.mid++;
+            }
+
+            if (identity.tkl > TCOAP_MAX_TOKEN_LEN) {
+                identity.tkl = TCOAP_MAX_TOKEN_LEN;
+            }
+
+            memset(identity.token, 0, sizeof(identity.token));
+
+            if (src_len >= 4u + identity.tkl) {
+                mem_copy(identity.token, src + 4, identity.tkl);
+            }
+        }
+    } else {
+        handle = &tcp_handle;
+
+        reqd.type = TCOAP_MESSAGE_NON;
+
+        /* the CSM and Pong complete the exchange of the same signal */
+        frame_length(msg, len, &code_idx);
+
+        if (msg[code_idx] == TCOAP_TCP_SIGNAL_CSM_701) {
+            reqd.code = TCOAP_TCP_SIGNAL_CSM_701;
+        } else if (msg[code_idx] == TCOAP_TCP_SIGNAL_PONG_703) {
+            reqd.code = TCOAP_TCP_SIGNAL_PING_702;
+        }
+
+        if (flow->request.valid && !derive) {
+            identity = flow->request;
+        } else {
+            frame_length(src, src_len, &code_idx);
+            identity.tkl = src[0] & 0x0f;
+
+            if (identity.tkl > TCOAP_MAX_TOKEN_LEN) {
+                identity.tkl = TCOAP_MAX_TOKEN_LEN;
+            }
+
+            memset(identity.token, 0, sizeof(identity.token));
+
+            if (code_idx + 1 + identity.tkl <= src_len) {
+                mem_copy(identity.token, src + code_idx + 1, identity.tkl);
+            }
+        }
+    }
+
+    reqd.tkl = identity.tkl;
+
+    current = flow;
+    feed_idx = 0;
+
+    started_at = now_ns();
+    err = tcoap_send_coap_request(handle, &reqd);
+    counters.parse_ns += now_ns() - started_at;
+
+    current = NULL;
+
+    /* the exchange failed before waiting, the answer is dropped */
+    if (!feed_idx) {
+        next_message(flow, 0, &src, &src_len, &feed_idx);
+    }
+
+    buf_consume(&flow->rx, feed_idx);
+
+    counters.exchanges++;
+
+    switch (err) {
+        case TCOAP_OK:
+            counters.ok++;
+            break;
+
+        case TCOAP_NRST_ANSWER:
+            counters.rsts++;
+            break;
+
+        case TCOAP_NO_ACK_ERROR:
+        case TCOAP_NO_RESP_ERROR:
+            counters.rejected++;
+            break;
+
+        case TCOAP_WRONG_OPTIONS_ERROR:
+            counters.option_errors++;
+            break;
+
+        case TCOAP_TIMEOUT_ERROR:
+            counters.unanswered++;
+            break;
+
+        default:
+            counters.failed++;
+            break;
+    }
+}
+
+
+/**
+ * @brief Get the queued answer of server at the offset
+ *
+ * @param flow - the flow
+ * @param idx - offset in 'rx' of flow
+ * @param msg - in this variable will be stored pointer on the answer
+ * @param len - in this variable will be stored length of the answer
+ * @param next - in this variable will be stored offset of the next answer
+ *
+ * @return true if there is the complete answer
+ */
+static bool next_message(const replay_flow * const flow, const uint32_t idx, const uint8_t ** msg, uint32_t * const len, uint32_t * const next)
+{
+    uint64_t frame_len;
+    uint32_t code_idx;
+
+    if (idx >= flow->rx.len) {
+        return false;
+    }
+
+    if (flow->proto == REPLAY_PROTO_UDP) {
+        mem_copy(len, flow->rx.data + idx, sizeof(*len));
+
+        *msg = flow->rx.data + idx + sizeof(*len);
+        *next = idx + sizeof(*len) + *len;
+
+        return true;
+    }
+
+    frame_len = frame_length(flow->rx.data + idx, flow->rx.len - idx, &code_idx);
+
+    if (!frame_len || frame_len > flow->rx.len - idx) {
+        return false;
+    }
+
+    *msg = flow->rx.data + idx;
+    *len = (uint32_t)frame_len;
+    *next = idx + *len;
+
+    return true;
+}
+
+
+/**
+ * @brief Check that the library awaits one more answer after this one
+ *
+ */
+static bool awaits_more(const replay_flow * const flow, const uint8_t * const msg, const uint32_t len)
+{
+    uint32_t code_idx;
+
+    if (flow->proto == REPLAY_PROTO_UDP) {
+        return len == 4 && ((msg[0] >> 4) & 0x03) == TCOAP_MESSAGE_ACK && msg[1] == TCOAP_CODE_EMPTY_MSG;
+    }
+
+    frame_length(msg, len, &code_idx);
+
+    return msg[code_idx] == TCOAP_TCP_SIGNAL_PING_702;
+}
+
+
+/**
+ * @brief Full length of CoAP over TCP frame by its header
+ *
+ * @param buf - pointer on the frame
+ * @param len - length of available data
+ * @param code_idx - in this variable will be stored index of the code
+ *
+ * @return length of frame, 0 if the header is not complete
+ */
+static uint64_t frame_length(const uint8_t * const buf, const uint32_t len, uint32_t * const code_idx)
+{
+    uint64_t data_len;
+    uint8_t nibble;
+
+    *code_idx = 0;
+
+    if (!len) {
+        return 0;
+    }
+
+    nibble = buf[0] >> 4;
+    *code_idx = nibble < 13 ? 1 : (nibble == 13 ? 2 : (nibble == 14 ? 3 : 5));
+
+    if (len <= *code_idx) {
+        return 0;
+    }
+
+    switch (nibble) {
+        case 13:
+            data_len = buf[1] + 13ull;
+            break;
+
+        case 14:
+            data_len = ((buf[1] << 8) | buf[2]) + 269ull;
+            break;
+
+        case 15:
+            data_len = (((uint64_t)buf[1] << 24) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 8) | buf[4]) + 65805ull;
+            break;
+
+        default:
+            data_len = nibble;
+            break;
+    }
+
+    return *code_idx + 1 + (buf[0] & 0x0f) + data_len;
+}
+
+
+/**
+ * @brief Deliver the answer to the library like a port does
+ *
+ * @return true if the answer was delivered
+ */
+static bool deliver(tcoap_handle * const handle, const uint8_t * msg, const uint32_t len)
+{
+    tcoap_error err;
+    uint32_t idx;
+    uint32_t cnt;
+    uint32_t step;
+
+    counters.messages++;
+    counters.bytes += len;
+
+    if (handle->transport == TCOAP_UDP) {
+
+        if (!byte_mode) {
+            return tcoap_rx_packet(handle, msg, len) == TCOAP_OK;
+        }
+
+        for (idx = 0; idx < len; ++idx) {
+            if (tcoap_rx_byte(handle, msg[idx]) != TCOAP_OK) {
+                /* the port drops the rest of datagram */
+                handle->response.len = 0;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /* the whole frame at once takes the fast path of framer */
+    step = byte_mode ? 1 : (chunk_len ? chunk_len : len);
+    delivered = false;
+
+    for (idx = 0; idx < len; idx += cnt) {
+        cnt = tcoap_tcp_framer_feed_frame(&framer, msg + idx, len - idx < step ? len - idx : step, &err);
+
+        if (!cnt) {
+            break;
+        }
+    }
+
+    return delivered;
+}
+
+
+/**
+ * @brief Find the flow by the client and server
+ *
+ * @param create - create the flow if it is absent
+ *
+ * @return the flow, NULL if it is absent and is not created
+ */
+static replay_flow * find_flow(const uint8_t proto, const uint8_t * const client, const uint16_t client_port, const uint8_t * const server, const bool create)
+{
+    replay_flow * flow;
+    uint32_t hash;
+    uint32_t i;
+
+    hash = 2166136261u ^ proto;
+    hash = (hash ^ client_port) * 16777619u;
+
+    for (i = 0; i < 16; ++i) {
+        hash = (hash ^ client[i]) * 16777619u;
+        hash = (hash ^ server[i]) * 16777619u;
+    }
+
+    hash %= REPLAY_HASH_SIZE;
+
+    for (flow = flows[hash]; flow != NULL; flow = flow->next) {
+        if (flow->proto == proto && flow->client_port == client_port
+                && !memcmp(flow->client, client, 16) && !memcmp(flow->server, server, 16)) {
+            return flow;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    flow = calloc(1, sizeof(*flow));
+
+    if (flow == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    flow->bucket = hash;
+    flow->proto = proto;
+    flow->client_port = client_port;
+    mem_copy(flow->client, client, 16);
+    mem_copy(flow->server, server, 16);
+
+    flow->next = flows[hash];
+    flows[hash] = flow;
+
+    return flow;
+}
+
+
+static void close_flow(replay_flow * const flow)
+{
+    replay_flow ** link;
+
+    run_ready(flow, true);
+
+    for (link = &flows[flow->bucket]; *link != flow; link = &(*link)->next) {
+    }
+
+    *link = flow->next;
+
+    buf_free(&flow->rx);
+    buf_free(&flow->tx);
+    free(flow);
+}
+
+
+static void flush_flows(void)
+{
+    replay_flow * flow;
+    uint32_t i;
+
+    for (i = 0; i < REPLAY_HASH_SIZE; ++i) {
+        while ((flow = flows[i]) != NULL) {
+            flows[i] = flow->next;
+
+            run_ready(flow, true);
+
+            buf_free(&flow->rx);
+            buf_free(&flow->tx);
+            free(flow);
+        }
+    }
+}
+
+
+
+static bool open_reader(replay_reader * const reader, const char * const path)
+{
+    uint8_t header[24];
+    uint32_t magic;
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->file = fopen(path, "rb");
+
+    if (reader->file == NULL) {
+        return false;
+    }
+
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+        fclose(reader->file);
+        return false;
+    }
+
+    mem_copy(&magic, header, sizeof(magic));
+
+    if (magic == 0x0A0D0D0A) {
+        /* the section header block is read again as an ordinary block */
+        reader->ng = true;
+        fseek(reader->file, 0, SEEK_SET);
+        return true;
+    }
+
+    switch (magic) {
+        case 0xa1b2c3d4:
+        case 0xd4c3b2a1:
+            reader->ts_unit_ns = 1000;
+            break;
+
+        case 0xa1b23c4d:
+        case 0x4d3cb2a1:
+            reader->ts_unit_ns = 1;
+            break;
+
+        default:
+            fclose(reader->file);
+            return false;
+    }
+
+    reader->swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    reader->linktype = rd32(reader, header + 20) & 0xffff;
+
+    return true;
+}
+
+
+static bool read_packet(replay_reader * const reader, replay_packet * const pkt)
+{
+    uint8_t header[16];
+    uint32_t len;
+    bool got;
+
+    if (reader->ng) {
+        do {
+            if (!read_block(reader, pkt, &got)) {
+                return false;
+            }
+        } while (!got);
+
+        return true;
+    }
+
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+        return false;
+    }
+
+    len = rd32(reader, header + 8);
+
+    if (len > REPLAY_MAX_SNAPLEN || !reserve(reader, len) || fread(reader->buf, 1, len, reader->file) != len) {
+        return false;
+    }
+
+    pkt->ts_ns = (uint64_t)rd32(reader, header) * 1000000000ull + (uint64_t)rd32(reader, header + 4) * reader->ts_unit_ns;
+    pkt->linktype = reader->linktype;
+    pkt->data = reader->buf;
+    pkt->len = len;
+
+    return true;
+}
+
+
+/**
+ * @brief Read a block of pcapng
+ *
+ * @param got - in this variable will be stored true if the block is a packet
+ *
+ * @return false at the end of file or if the file is broken
+ */
+static bool read_block(replay_reader * const reader, replay_packet * const pkt, bool * const got)
+{
+    uint8_t header[8];
+    uint32_t type;
+    uint32_t len;
+    uint32_t magic;
+    uint32_t idx;
+    uint32_t cap;
+    uint32_t iface;
+    uint64_t ts;
+    uint64_t resol;
+    uint16_t code;
+    uint16_t opt_len;
+    uint8_t * b;
+
+    *got = false;
+
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+        return false;
+    }
+
+    mem_copy(&type, header, sizeof(type));
+
+    if (type == 0x0A0D0D0A) {
+        /* the byte order of section is given by its magic */
+        if (fread(&magic, 1, sizeof(magic), reader->file) != sizeof(magic)) {
+            return false;
+        }
+
+        reader->swapped = magic != 0x1A2B3C4D;
+        reader->if_count = 0;
+
+        len = rd32(reader, header + 4);
+
+        return len >= 12 && !fseek(reader->file, len - 12, SEEK_CUR);
+    }
+
+    type = rd32(reader, header);
+    len = rd32(reader, header + 4);
+
+    if (len < 12) {
+        return false;
+    }
+
+    /* other blocks (e.g. name resolution, statistics) are not needed */
+    if (type != 1 && type != 2 && type != 3 && type != 6) {
+        return !fseek(reader->file, len - 8, SEEK_CUR);
+    }
+
+    if (len - 8 > REPLAY_MAX_SNAPLEN + 64 || !reserve(reader, len - 8)
+            || fread(reader->buf, 1, len - 8, reader->file) != len - 8) {
+        return false;
+    }
+
+    b = reader->buf;
+    len -= 12;             /* the body without the trailing length */
+
+    switch (type) {
+        case 1:            /* interface description */
+            if (len < 8 || reader->if_count >= 16) {
+                break;
+            }
+
+            iface = reader->if_count++;
+            reader->if_linktype[iface] = rd16(reader, b);
+            reader->if_tsresol[iface] = 1000000;
+
+            for (idx = 8; idx + 4 <= len; idx += 4 + ((opt_len + 3u) & ~3u)) {
+                code = rd16(reader, b + idx);
+                opt_len = rd16(reader, b + idx + 2);
+
+                if (!code) {
+                    break;
+                }
+
+                if (code == 9 && opt_len >= 1 && idx + 4 < len) {
+                    for (resol = 1, cap = 0; cap < (b[idx + 4] & 0x7fu); ++cap) {
+                        resol *= (b[idx + 4] & 0x80) ? 2 : 10;
+                    }
+
+                    reader->if_tsresol[iface] = resol;
+                }
+            }
+            break;
+
+        case 6:            /* enhanced packet */
+        case 2:            /* packet (obsolete) */
+            if (len < 20) {
+                break;
+            }
+
+            iface = type == 6 ? rd32(reader, b) : rd16(reader, b);
+            ts = ((uint64_t)rd32(reader, b + 4) << 32) | rd32(reader, b + 8);
+            cap = rd32(reader, b + 12);
+
+            if (iface >= reader->if_count || cap > len - 20) {
+                break;
+            }
+
+            resol = reader->if_tsresol[iface];
+
+            pkt->ts_ns = (ts / resol) * 1000000000ull + (ts % resol) * 1000000000ull / resol;
+            pkt->linktype = reader->if_linktype[iface];
+            pkt->data = b + 20;
+            pkt->len = cap;
+
+            *got = true;
+            break;
+
+        case 3:            /* simple packet, without timestamp */
+            if (len < 4 || !reader->if_count) {
+                break;
+            }
+
+            cap = rd32(reader, b);
+
+            pkt->ts_ns = 0;
+            pkt->linktype = reader->if_linktype[0];
+            pkt->data = b + 4;
+            pkt->len = cap < len - 4 ? cap : len - 4;
+
+            *got = true;
+            break;
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+
+static bool reserve(replay_reader * const reader, const uint32_t len)
+{
+    uint8_t * buf;
+
+    if (len <= reader->size) {
+        return true;
+    }
+
+    buf = realloc(reader->buf, len);
+
+    if (buf == NULL) {
+        return false;
+    }
+
+    reader->buf = buf;
+    reader->size = len;
+
+    return true;
+}
+
+
+static uint16_t rd16(const replay_reader * const reader, const uint8_t * const buf)
+{
+    uint16_t value;
+
+    mem_copy(&value, buf, sizeof(value));
+
+    return reader->swapped ? (uint16_t)((value >> 8) | (value << 8)) : value;
+}
+
+
+static uint32_t rd32(const replay_reader * const reader, const uint8_t * const buf)
+{
+    uint32_t value;
+
+    mem_copy(&value, buf, sizeof(value));
+
+    return reader->swapped ? __builtin_bswap32(value) : value;
+}
+
+
+
+static void buf_append(replay_buf * const buf, const uint8_t * data, const uint32_t len)
+{
+    uint8_t * p;
+    uint32_t size;
+
+    if (buf->len + len > buf->size) {
+        size = buf->size ? buf->size : 1024;
+
+        while (size < buf->len + len) {
+            size *= 2;
+        }
+
+        p = realloc(buf->data, size);
+
+        if (p == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+
+        buf->data = p;
+        buf->size = size;
+    }
+
+    mem_copy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+
+static void buf_consume(replay_buf * const buf, const uint32_t len)
+{
+    if (len >= buf->len) {
+        buf->len = 0;
+        return;
+    }
+
+    memmove(buf->data, buf->data + len, buf->len - len);
+    buf->len -= len;
+}
+
+
+static void buf_free(replay_buf * const buf)
+{
+    free(buf->data);
+
+    buf->data = NULL;
+    buf->len = 0;
+    buf->size = 0;
+}
+
+
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    (void)reqd;
+    (void)result;
+}
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static void report(void)
+{
+    tcoap_stats udp;
+    tcoap_stats tcp;
+    double parse_s;
+    uint32_t i;
+
+    tcoap_get_stats(&udp_handle, &udp);
+    tcoap_get_stats(&tcp_handle, &tcp);
+
+    parse_s = counters.parse_ns / 1e9;
+
+    if (json) {
+        printf("{\"packets\":%llu,\"skipped\":%llu,\"messages\":%llu,\"bytes\":%llu,"
+               "\"exchanges\":%llu,\"ok\":%llu,\"rst\":%llu,\"rejected\":%llu,\"option_errors\":%llu,"
+               "\"unanswered\":%llu,\"failed\":%llu,\"parse_s\":%.6f,\"msgs_per_s\":%.0f,\"mb_per_s\":%.2f,\"rejects\":{",
+               (unsigned long long)counters.packets, (unsigned long long)counters.skipped,
+               (unsigned long long)counters.messages, (unsigned long long)counters.bytes,
+               (unsigned long long)counters.exchanges, (unsigned long long)counters.ok,
+               (unsigned long long)counters.rsts, (unsigned long long)counters.rejected,
+               (unsigned long long)counters.option_errors, (unsigned long long)counters.unanswered,
+               (unsigned long long)counters.failed, parse_s,
+               parse_s > 0 ? counters.messages / parse_s : 0.0, parse_s > 0 ? counters.bytes / parse_s / 1e6 : 0.0);
+
+        for (i = 0; i < TCOAP_REJECT_REASONS; ++i) {
+            printf("%s\"%s\":%u", i ? "," : "", reject_names[i], udp.rejects[i] + tcp.rejects[i]);
+        }
+
+        printf("},\"rx_overflows\":%u,\"tcp_gaps\":%llu,\"truncated\":%llu}\n",
+               udp.rx_overflows + tcp.rx_overflows,
+               (unsigned long long)counters.tcp_gaps, (unsigned long long)counters.truncated);
+        return;
+    }
+
+    printf("packets %llu (skipped %llu), answers %llu, bytes %llu\n",
+           (unsigned long long)counters.packets, (unsigned long long)counters.skipped,
+           (unsigned long long)counters.messages, (unsigned long long)counters.bytes);
+
+    printf("exchanges %llu: ok %llu, rst %llu, rejected %llu, option errors %llu, unanswered %llu, failed %llu\n",
+           (unsigned long long)counters.exchanges, (unsigned long long)counters.ok,
+           (unsigned long long)counters.rsts, (unsigned long long)counters.rejected,
+           (unsigned long long)counters.option_errors, (unsigned long long)counters.unanswered,
+           (unsigned long long)counters.failed);
+
+    printf("parse %.6f s, %.0f msg/s, %.2f MB/s\n", parse_s,
+           parse_s > 0 ? counters.messages / parse_s : 0.0, parse_s > 0 ? counters.bytes / parse_s / 1e6 : 0.0);
+
+    printf("rejects:");
+
+    for (i = 0; i < TCOAP_REJECT_REASONS; ++i) {
+        printf(" %s %u", reject_names[i], udp.rejects[i] + tcp.rejects[i]);
+    }
+
+    printf("\nrx overflows %u, tcp gaps %llu, truncated %llu\n", udp.rx_overflows + tcp.rx_overflows,
+           (unsigned long long)counters.tcp_gaps, (unsigned long long)counters.truncated);
+}
+
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-p port] [-b] [-c chunk] [-t] [-d] [-j] file...\n"
+                    "  -p  port of server (5683)\n"
+                    "  -b  deliver datagrams by 'tcoap_rx_byte' and streams by one byte\n"
+                    "  -c  length of chunks of TCP stream for the framer (the whole frame)\n"
+                    "  -t  preserve the timing of capture\n"
+                    "  -d  derive the message ID and token of requests from answers\n"
+                    "  -j  print the result as JSON\n", name);
+}
+
+
+
+/*
+ * Replay transport: requests are dropped, the answers are taken from the
+ * queue of the current flow.
+ */
+
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    (void)handle; (void)buf; (void)len;
+
+    return TCOAP_OK;
+}
+
+
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    const uint8_t * msg;
+    uint32_t len;
+    uint32_t next;
+
+    (void)timeout_ms;
+
+    while (current != NULL && next_message(current, feed_idx, &msg, &len, &next)) {
+        feed_idx = next;
+
+        if (deliver(handle, msg, len)) {
+            return TCOAP_OK;
+        }
+    }
+
+    return TCOAP_TIMEOUT_ERROR;
+}
+
+
+tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal)
+{
+    (void)handle;
+
+    if (signal == TCOAP_RESPONSE_DID_RECEIVE) {
+        delivered = true;
+    }
+
+    return TCOAP_OK;
+}
+
+
+uint16_t tcoap_get_message_id(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return identity.mid;
+}
+
+
+tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl)
+{
+    (void)handle;
+    mem_copy(token, identity.token, tkl);
+
+    return TCOAP_OK;
+}
+
+
+uint32_t tcoap_get_time_ms(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return (uint32_t)(now_ns() / 1000000);
+}
+
+
+void tcoap_debug_print_packet(tcoap_handle * const handle, const char * msg, uint8_t * data, const uint32_t len)
+{
+    (void)handle; (void)msg; (void)data; (void)len;
+}
+
+
+void tcoap_debug_print_options(tcoap_handle * const handle, const char * msg, const tcoap_option_data * options)
+{
+    (void)handle; (void)msg; (void)options;
+}
+
+
+void tcoap_debug_print_payload(tcoap_handle * const handle, const char * msg, const tcoap_data * const payload)
+{
+    (void)handle; (void)msg; (void)payload;
+}
+
+
+tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len)
+{
+    *block = malloc(min_len);
+
+    return *block != NULL ? TCOAP_OK : TCOAP_NO_FREE_MEM_ERROR;
+}
+
+
+tcoap_error tcoap_free_mem_block(uint8_t * block, const uint32_t min_len)
+{
+    (void)min_len;
+    free(block);
+
+    return TCOAP_OK;
+}
+
+
+void mem_copy(void * dst, const void * src, uint32_t cnt)
+{
+    memcpy(dst, src, cnt);
+}
+
+
+bool mem_cmp(const void * dst, const void * src, uint32_t cnt)
+{
+    return memcmp(dst, src, cnt) == 0;
+}
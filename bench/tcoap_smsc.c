@@ -0,0 +1,563 @@
+/**
+ * tcoap_smsc.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: in-process stand-in of SMSC for the SMS bearer ('tcoap_sms.h'). The
+ *       extern hooks are implemented here: 'tcoap_tx_data' hands the User
+ *       Data of SMS of the device to the SMSC, which reassembles concatenated
+ *       SMS and passes the request to a stand-in server. The response is
+ *       split into concatenated SMS by the SMSC and 'tcoap_wait_event'
+ *       delivers them by 'tcoap_rx_packet' in the order of scenario: out of
+ *       order, duplicated, with 16-bit references, with other elements of the
+ *       User Data Header, mixed with segments of another message or left
+ *       incomplete by the previous exchange. The waiting time is virtual, so
+ *       the long timeouts of SMS pass at once.
+ *
+ *       Each scenario reports whether the response was reassembled right
+ *       (the payload depends on the Message ID, so data of another exchange
+ *       is detected), the exit code is not zero if any scenario fails.
+ *
+ *       Build it with the library only (not with a port), the PDU should fit
+ *       a concatenated SMS:
+ *
+ *       cc -O2 -DTCOAP_SMS_ENABLED -DTCOAP_MAX_PDU_SIZE=512 -I. -o tcoap-smsc bench/tcoap_smsc.c tcoap*.c
+ *
+ *       Usage: tcoap-smsc [-v]
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tcoap.h"
+#include "tcoap_sms.h"
+
+
+#ifndef TCOAP_SMS_ENABLED
+#error "build it with -DTCOAP_SMS_ENABLED"
+#endif /* TCOAP_SMS_ENABLED */
+
+#define SMSC_RESP_LEN                   300       /* payload of response, 3 segments */
+#define SMSC_REQ_LEN                    200       /* payload of the long request, 2 segments */
+#define SMSC_TOKEN_LEN                  4
+
+#if TCOAP_MAX_PDU_SIZE < SMSC_RESP_LEN + 5 + SMSC_TOKEN_LEN
+#error "build it with -DTCOAP_MAX_PDU_SIZE=512"
+#endif
+
+#define SMSC_MAX_QUEUE                  32
+#define SMSC_MAX_STEPS                  2
+#define SMSC_RESP_CODE                  TCOAP_CODE(2, 5)
+
+#define SMSC_IEI_CONCAT_8BIT            0x00
+#define SMSC_IEI_CONCAT_16BIT           0x08
+#define SMSC_IEI_PORT_16BIT             0x05      /* application port addressing, 16-bit */
+
+
+/* one exchange of scenario */
+typedef struct smsc_step {
+
+    uint16_t ref;             /* reference number of the concatenated response */
+    const char * order;       /* delivery: '1'..'9' segment of response, 'a'..'i' segment of another message */
+    tcoap_error expected;
+
+} smsc_step;
+
+
+typedef struct smsc_scenario {
+
+    const char * name;
+    bool ref16;               /* 16-bit reference numbers (IEI 0x08) */
+    bool port_ie;             /* the port addressing element precedes the concatenation one */
+    uint32_t resp_len;
+    uint32_t req_len;
+    smsc_step steps[SMSC_MAX_STEPS];
+
+} smsc_scenario;
+
+
+typedef struct smsc_sms {
+
+    uint32_t len;
+    uint8_t data[TCOAP_SMS_USER_DATA_LEN];
+
+} smsc_sms;
+
+
+static const smsc_scenario scenarios[] = {
+    /* name           ref16  port   resp           req            steps */
+    { "single",       false, false, 32,            0,             { { 0x0011, "1",     TCOAP_OK } } },
+    { "in-order",     false, false, SMSC_RESP_LEN, 0,             { { 0x0012, "123",   TCOAP_OK } } },
+    { "out-of-order", false, false, SMSC_RESP_LEN, 0,             { { 0x0013, "312",   TCOAP_OK } } },
+    { "duplicates",   false, false, SMSC_RESP_LEN, 0,             { { 0x0014, "22113", TCOAP_OK } } },
+    { "ref16",        true,  false, SMSC_RESP_LEN, 0,             { { 0x1234, "213",   TCOAP_OK } } },
+    { "ref16-high",   true,  false, SMSC_RESP_LEN, 0,             { { 0x0142, "a123",  TCOAP_OK } } },
+    { "other-ie",     false, true,  SMSC_RESP_LEN, 0,             { { 0x0015, "312",   TCOAP_OK } } },
+    { "long-request", false, false, SMSC_RESP_LEN, SMSC_REQ_LEN,  { { 0x0016, "123",   TCOAP_OK } } },
+    { "stale-partial", false, false, SMSC_RESP_LEN, 0,            { { 0x0017, "1",     TCOAP_TIMEOUT_ERROR },
+                                                                    { 0x0017, "231",   TCOAP_OK } } },
+};
+
+#define SMSC_SCENARIOS                  (sizeof(scenarios) / sizeof(scenarios[0]))
+
+
+static bool verbose;
+
+/* state of the running exchange */
+static const smsc_scenario * scenario;
+static const smsc_step * step;
+static tcoap_handle handle;
+static uint16_t client_mid = 0x4200;
+static uint64_t sim_now_ms;
+
+static smsc_sms queue[SMSC_MAX_QUEUE];
+static uint32_t queue_len;
+static uint32_t queue_next;
+
+static uint8_t uplink[TCOAP_MAX_PDU_SIZE];   /* the request of device being reassembled */
+static uint32_t uplink_mask;
+static uint32_t uplink_len;
+
+static bool served;                          /* the response of exchange is queued */
+static bool received;                        /* the library reported the whole response */
+static bool answered;                        /* the callback got the expected payload */
+static bool request_ok;
+static uint32_t delivered;
+static uint32_t rejected;
+
+static uint8_t req_payload[SMSC_REQ_LEN];
+
+
+static void run_scenario(const smsc_scenario * const sc, bool * const passed);
+static void server_rx(const uint8_t * buf, const uint32_t len);
+static void queue_segment(const uint8_t * msg, const uint32_t len, const uint16_t ref, const uint32_t seq);
+static uint8_t payload_byte(const uint16_t mid, const uint32_t idx);
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
+static void usage(const char * name);
+
+
+
+int main(int argc, char ** argv)
+{
+    uint32_t failed;
+    uint32_t i;
+    bool passed;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vh")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    for (i = 0; i < sizeof(req_payload); ++i) {
+        req_payload[i] = (uint8_t)('a' + i % 26);
+    }
+
+    printf("%-14s %-6s %9s %8s\n", "scenario", "result", "delivered", "rejected");
+
+    failed = 0;
+
+    for (i = 0; i < SMSC_SCENARIOS; ++i) {
+        run_scenario(&scenarios[i], &passed);
+
+        printf("%-14s %-6s %9u %8u\n", scenarios[i].name, passed ? "ok" : "FAILED", delivered, rejected);
+
+        if (!passed) {
+            failed++;
+        }
+    }
+
+    printf("%u of %u scenarios failed\n", failed, (uint32_t)SMSC_SCENARIOS);
+
+    return failed ? 1 : 0;
+}
+
+
+
+/**
+ * @brief Run all exchanges of the scenario on a fresh handle
+ *
+ * @param sc - scenario
+ * @param passed - set to true if every exchange ended as expected
+ */
+static void run_scenario(const smsc_scenario * const sc, bool * const passed)
+{
+    tcoap_request_descriptor reqd;
+    tcoap_error err;
+    uint32_t i;
+
+    scenario = sc;
+    delivered = 0;
+    rejected = 0;
+    *passed = true;
+
+    memset(&handle, 0, sizeof(handle));
+    handle.name = "smsc";
+    handle.transport = TCOAP_SMS;
+
+    memset(&reqd, 0, sizeof(reqd));
+    reqd.type = TCOAP_MESSAGE_CON;
+    reqd.code = sc->req_len ? TCOAP_REQ_POST : TCOAP_REQ_GET;
+    reqd.tkl = SMSC_TOKEN_LEN;
+    reqd.payload.buf = req_payload;
+    reqd.payload.len = sc->req_len;
+    reqd.response_callback = response_callback;
+
+    for (i = 0; i < SMSC_MAX_STEPS && sc->steps[i].order != NULL; ++i) {
+
+        step = &sc->steps[i];
+        queue_len = 0;
+        queue_next = 0;
+        uplink_mask = 0;
+        served = false;
+        answered = false;
+        request_ok = false;
+
+        err = tcoap_send_coap_request(&handle, &reqd);
+
+        if (err != step->expected || (err == TCOAP_OK && (!answered || !request_ok))) {
+            *passed = false;
+        }
+
+        if (verbose) {
+            fprintf(stderr, "%s #%u: err %d (expected %d), answered %d, request %s\n", sc->name, i, err,
+                    step->expected, answered, request_ok ? "ok" : "broken");
+        }
+    }
+}
+
+
+/**
+ * @brief Stand-in server: check the request and queue the segments of its
+ *        piggybacked response in the order of the step
+ *
+ * @param buf - the request reassembled by the SMSC
+ * @param len - its length
+ */
+static void server_rx(const uint8_t * buf, const uint32_t len)
+{
+    static uint8_t resp[TCOAP_MAX_PDU_SIZE];
+    static uint8_t other[TCOAP_MAX_PDU_SIZE];
+
+    uint32_t tkl;
+    uint32_t resp_len;
+    uint32_t idx;
+    uint16_t mid;
+
+    /* retransmissions of the request are not answered again */
+    if (served || len < 4) {
+        return;
+    }
+
+    served = true;
+
+    tkl = buf[0] & 0x0F;
+    mid = (uint16_t)((buf[2] << 8) | buf[3]);
+
+    /* the request has no options, the payload follows the token */
+    if (scenario->req_len) {
+        request_ok = len == 4 + tkl + 1 + scenario->req_len && buf[4 + tkl] == 0xFF
+                && memcmp(buf + 4 + tkl + 1, req_payload, scenario->req_len) == 0;
+    } else {
+        request_ok = len == 4 + tkl;
+    }
+
+    /* piggybacked response: ACK, 2.05, the same Message ID and token */
+    resp_len = 0;
+    resp[resp_len++] = (uint8_t)(0x60 | tkl);
+    resp[resp_len++] = SMSC_RESP_CODE;
+    resp[resp_len++] = buf[2];
+    resp[resp_len++] = buf[3];
+    memcpy(resp + resp_len, buf + 4, tkl);
+    resp_len += tkl;
+    resp[resp_len++] = 0xFF;
+
+    for (idx = 0; idx < scenario->resp_len; ++idx) {
+        resp[resp_len++] = payload_byte(mid, idx);
+    }
+
+    /* another message with the same length, its reference differs in the high byte */
+    memcpy(other, resp, resp_len);
+    memset(other + resp_len - scenario->resp_len, 0xEE, scenario->resp_len);
+
+    if (resp_len <= TCOAP_SMS_USER_DATA_LEN) {
+        queue[queue_len].len = resp_len;
+        memcpy(queue[queue_len++].data, resp, resp_len);
+        return;
+    }
+
+    for (idx = 0; step->order[idx]; ++idx) {
+        if (step->order[idx] >= 'a') {
+            queue_segment(other, resp_len, step->ref ^ 0x0100, (uint32_t)(step->order[idx] - 'a') + 1);
+        } else {
+            queue_segment(resp, resp_len, step->ref, (uint32_t)(step->order[idx] - '1') + 1);
+        }
+    }
+}
+
+
+/**
+ * @brief Queue one segment of concatenated SMS
+ *
+ * @param msg - the message
+ * @param len - its length
+ * @param ref - reference number
+ * @param seq - sequence number of the segment, from 1
+ */
+static void queue_segment(const uint8_t * msg, const uint32_t len, const uint16_t ref, const uint32_t seq)
+{
+    smsc_sms * sms;
+    uint32_t udh_len;
+    uint32_t seg_len;
+    uint32_t offset;
+    uint32_t part;
+
+    udh_len = 1 + (scenario->ref16 ? 6 : 5) + (scenario->port_ie ? 6 : 0);
+    seg_len = TCOAP_SMS_USER_DATA_LEN - udh_len;
+    offset = (seq - 1) * seg_len;
+
+    if (queue_len >= SMSC_MAX_QUEUE || offset >= len) {
+        return;
+    }
+
+    sms = &queue[queue_len++];
+
+    sms->data[0] = (uint8_t)(udh_len - 1);
+    udh_len = 1;
+
+    if (scenario->port_ie) {
+        sms->data[udh_len++] = SMSC_IEI_PORT_16BIT;
+        sms->data[udh_len++] = 4;
+        sms->data[udh_len++] = 0x16;     /* destination port 5683 */
+        sms->data[udh_len++] = 0x33;
+        sms->data[udh_len++] = 0x16;     /* source port 5683 */
+        sms->data[udh_len++] = 0x33;
+    }
+
+    if (scenario->ref16) {
+        sms->data[udh_len++] = SMSC_IEI_CONCAT_16BIT;
+        sms->data[udh_len++] = 4;
+        sms->data[udh_len++] = (uint8_t)(ref >> 8);
+    } else {
+        sms->data[udh_len++] = SMSC_IEI_CONCAT_8BIT;
+        sms->data[udh_len++] = 3;
+    }
+
+    sms->data[udh_len++] = (uint8_t)ref;
+    sms->data[udh_len++] = (uint8_t)((len + seg_len - 1) / seg_len);
+    sms->data[udh_len++] = (uint8_t)seq;
+
+    part = len - offset < seg_len ? len - offset : seg_len;
+
+    memcpy(sms->data + udh_len, msg + offset, part);
+    sms->len = udh_len + part;
+}
+
+
+/**
+ * @brief Payload of response, it depends on the exchange
+ *
+ */
+static uint8_t payload_byte(const uint16_t mid, const uint32_t idx)
+{
+    return (uint8_t)(mid * 31 + idx);
+}
+
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    uint16_t mid;
+    uint32_t idx;
+
+    (void)reqd;
+
+    mid = (uint16_t)((handle.request.buf[2] << 8) | handle.request.buf[3]);
+
+    answered = result->resp_code == SMSC_RESP_CODE && result->payload.len == scenario->resp_len;
+
+    for (idx = 0; answered && idx < result->payload.len; ++idx) {
+        answered = result->payload.buf[idx] == payload_byte(mid, idx);
+    }
+}
+
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-v]\n"
+                    "  -v  trace exchanges to stderr\n", name);
+}
+
+
+
+/*
+ * SMSC: SMS of the device go to the server, waiting delivers the queued SMS
+ * of the response.
+ */
+
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    uint32_t seq;
+    uint32_t total;
+
+    (void)handle;
+
+    if (!TCOAP_SMS_HAS_UDH(buf)) {
+        server_rx(buf, len);
+        return TCOAP_OK;
+    }
+
+    /* the library sends concatenated SMS with the 8-bit reference and without other elements */
+    if (len <= TCOAP_SMS_CONCAT_UDH_LEN || buf[1] != SMSC_IEI_CONCAT_8BIT) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    total = buf[4];
+    seq = buf[5];
+
+    if (!seq || seq > total || (seq - 1) * TCOAP_SMS_SEGMENT_LEN + len - TCOAP_SMS_CONCAT_UDH_LEN > sizeof(uplink)) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    memcpy(uplink + (seq - 1) * TCOAP_SMS_SEGMENT_LEN, buf + TCOAP_SMS_CONCAT_UDH_LEN, len - TCOAP_SMS_CONCAT_UDH_LEN);
+
+    if (seq == total) {
+        uplink_len = (seq - 1) * TCOAP_SMS_SEGMENT_LEN + len - TCOAP_SMS_CONCAT_UDH_LEN;
+    }
+
+    uplink_mask |= 1u << (seq - 1);
+
+    if (uplink_mask == (1u << total) - 1) {
+        uplink_mask = 0;
+        server_rx(uplink, uplink_len);
+    }
+
+    return TCOAP_OK;
+}
+
+
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    received = false;
+
+    while (queue_next < queue_len) {
+
+        delivered++;
+
+        if (tcoap_rx_packet(handle, queue[queue_next].data, queue[queue_next].len) != TCOAP_OK) {
+            rejected++;
+        }
+
+        queue_next++;
+
+        if (received) {
+            return TCOAP_OK;
+        }
+    }
+
+    sim_now_ms += timeout_ms;
+
+    return TCOAP_TIMEOUT_ERROR;
+}
+
+
+tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal)
+{
+    (void)handle;
+
+    if (signal == TCOAP_RESPONSE_DID_RECEIVE) {
+        received = true;
+    }
+
+    return TCOAP_OK;
+}
+
+
+uint16_t tcoap_get_message_id(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return client_mid++;
+}
+
+
+tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl)
+{
+    uint32_t i;
+
+    (void)handle;
+
+    for (i = 0; i < tkl; ++i) {
+        token[i] = (uint8_t)(client_mid + i);
+    }
+
+    return TCOAP_OK;
+}
+
+
+#if defined(TCOAP_LIVENESS_ENABLED) || defined(TCOAP_STATS_ENABLED) || defined(TCOAP_CAPTURE_ENABLED)
+uint32_t tcoap_get_time_ms(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return (uint32_t)sim_now_ms;
+}
+#endif /* TCOAP_LIVENESS_ENABLED || TCOAP_STATS_ENABLED || TCOAP_CAPTURE_ENABLED */
+
+
+void tcoap_debug_print_packet(tcoap_handle * const handle, const char * msg, uint8_t * data, const uint32_t len)
+{
+    (void)handle; (void)msg; (void)data; (void)len;
+}
+
+
+void tcoap_debug_print_options(tcoap_handle * const handle, const char * msg, const tcoap_option_data * options)
+{
+    (void)handle; (void)msg; (void)options;
+}
+
+
+void tcoap_debug_print_payload(tcoap_handle * const handle, const char * msg, const tcoap_data * const payload)
+{
+    (void)handle; (void)msg; (void)payload;
+}
+
+
+tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len)
+{
+    *block = malloc(min_len);
+
+    return *block != NULL ? TCOAP_OK : TCOAP_NO_FREE_MEM_ERROR;
+}
+
+
+tcoap_error tcoap_free_mem_block(uint8_t * block, const uint32_t min_len)
+{
+    (void)min_len;
+    free(block);
+
+    return TCOAP_OK;
+}
+
+
+void mem_copy(void * dst, const void * src, uint32_t cnt)
+{
+    memmove(dst, src, cnt);
+}
+
+
+bool mem_cmp(const void * dst, const void * src, uint32_t cnt)
+{
+    return memcmp(dst, src, cnt) == 0;
+}
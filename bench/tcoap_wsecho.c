@@ -0,0 +1,668 @@
+/**
+ * tcoap_wsecho.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: in-process stand-in of WebSocket echo server for CoAP over WebSockets
+ *       ('tcoap_ws.h'). The extern hooks are implemented here: 'tcoap_tx_data'
+ *       puts the stream of client to the server, which checks every frame of
+ *       client (FIN, no RSV bits, known opcode, masked with a new key) and
+ *       answers the request by the 2.05 response with the same token and
+ *       payload. 'tcoap_wait_event' feeds the frames of server to the
+ *       'tcoap_ws_receiver' by chunks of the given length in the order of
+ *       scenario: masked or not, fragmented, with Ping between fragments, with
+ *       a text message before and a Close after the response, with the 16-bit
+ *       extended length. The Pong and Close of client should echo the data of
+ *       server.
+ *
+ *       Each scenario reports whether the echo was received and the control
+ *       frames were answered right, the exit code is not zero if any fails.
+ *
+ *       Build it with the library only (not with a port), the PDU should fit
+ *       the payload with the 16-bit length:
+ *
+ *       cc -O2 -DTCOAP_MAX_PDU_SIZE=512 -I. -o tcoap-wsecho bench/tcoap_wsecho.c tcoap*.c
+ *
+ *       Usage: tcoap-wsecho [-v]
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tcoap.h"
+#include "tcoap_ws.h"
+
+
+#define WSECHO_LONG_LEN                 300       /* payload with the 16-bit extended length */
+#define WSECHO_TOKEN_LEN                4
+
+#if TCOAP_MAX_PDU_SIZE < WSECHO_LONG_LEN + 3 + WSECHO_TOKEN_LEN
+#error "build it with -DTCOAP_MAX_PDU_SIZE=512"
+#endif
+
+#define WSECHO_MAX_STREAM               4096
+#define WSECHO_RESP_CODE                TCOAP_CODE(2, 5)
+#define WSECHO_CLOSE_STATUS             1000      /* normal closure, rfc6455 7.4.1 */
+
+#define WSECHO_FIN_BIT                  0x80
+#define WSECHO_RSV_BITS                 0x70
+#define WSECHO_MASK_BIT                 0x80
+
+
+typedef struct wsecho_scenario {
+
+    const char * name;
+    uint32_t payload_len;     /* payload of request, it is echoed */
+    uint32_t fragments;       /* the response is split into this number of frames */
+    bool masked;              /* the server masks its frames (it should not, the client accepts them) */
+    bool ping;                /* a Ping follows the first fragment */
+    bool text;                /* a text message precedes the response, it is dropped */
+    bool close;               /* a Close follows the response */
+    uint32_t chunk;           /* the stream of server is fed by chunks of this length */
+
+} wsecho_scenario;
+
+
+/* a frame of client */
+typedef struct wsecho_frame {
+
+    uint8_t opcode;
+    uint32_t len;
+    uint8_t mask[TCOAP_WS_MASK_LEN];
+    const uint8_t * data;     /* unmasked in the stream */
+
+} wsecho_frame;
+
+
+typedef struct wsecho_result {
+
+    uint32_t frames;          /* frames of client */
+    uint32_t bad_frames;      /* not final, with RSV bits, not masked or with an unknown opcode */
+    uint32_t reused_masks;    /* the masking key of the previous frame was repeated */
+    uint32_t pongs;           /* Pongs which echo the Ping */
+    uint32_t closes;          /* Closes which echo the status code */
+    uint32_t close_signals;
+    bool answered;            /* the callback got the echo */
+
+} wsecho_result;
+
+
+static const wsecho_scenario scenarios[] = {
+    /* name              payload          frag  masked ping   text   close  chunk */
+    { "single",          16,              1,    false, false, false, false, 64 },
+    { "bytewise",        16,              1,    false, false, false, false, 1 },
+    { "masked",          16,              1,    true,  false, false, false, 5 },
+    { "empty",           0,               1,    false, false, false, false, 64 },
+    { "fragmented",      40,              4,    false, false, false, false, 7 },
+    { "ping-inside",     40,              3,    false, true,  false, false, 3 },
+    { "masked-ping",     40,              3,    true,  true,  false, false, 1 },
+    { "len16",           WSECHO_LONG_LEN, 1,    false, false, false, false, 64 },
+    { "len16-frag",      WSECHO_LONG_LEN, 5,    true,  true,  false, false, 13 },
+    { "text-dropped",    16,              1,    false, false, true,  false, 64 },
+    { "close",           16,              2,    false, true,  false, true,  4 },
+};
+
+#define WSECHO_SCENARIOS                (sizeof(scenarios) / sizeof(scenarios[0]))
+
+
+static const uint8_t ping_data[] = { 'p', 'i', 'n', 'g', '-', '7' };
+static const uint8_t close_data[] = { WSECHO_CLOSE_STATUS >> 8, WSECHO_CLOSE_STATUS & 0xFF, 'b', 'y', 'e' };
+
+static bool verbose;
+
+/* state of the running scenario */
+static const wsecho_scenario * scenario;
+static wsecho_result result;
+static tcoap_handle handle;
+static tcoap_ws_receiver receiver;
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+static uint16_t client_mid;
+
+static uint8_t uplink[WSECHO_MAX_STREAM];   /* stream of client */
+static uint32_t uplink_len;
+static uint32_t uplink_pos;                 /* the first frame which is not checked yet */
+static uint8_t last_mask[TCOAP_WS_MASK_LEN];
+
+static uint8_t downlink[WSECHO_MAX_STREAM]; /* stream of server */
+static uint32_t downlink_len;
+
+static uint8_t req_payload[WSECHO_LONG_LEN];
+
+
+static void run_scenario(const wsecho_scenario * const sc);
+static bool next_frame(wsecho_frame * const frame);
+static void check_frame(const wsecho_frame * const frame);
+static bool server_rx(const wsecho_frame * const frame);
+static void put_frame(const uint8_t first, const uint8_t * data, const uint32_t len);
+static bool passed(void);
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result_data);
+static uint32_t rnd(void);
+static void usage(const char * name);
+
+
+
+int main(int argc, char ** argv)
+{
+    uint32_t failed;
+    uint32_t i;
+    bool ok;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vh")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    for (i = 0; i < sizeof(req_payload); ++i) {
+        req_payload[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    printf("%-14s %-6s %6s %4s %6s %6s %6s\n", "scenario", "result", "frames", "bad", "reused", "pongs", "closes");
+
+    failed = 0;
+
+    for (i = 0; i < WSECHO_SCENARIOS; ++i) {
+        run_scenario(&scenarios[i]);
+
+        ok = passed();
+
+        printf("%-14s %-6s %6u %4u %6u %6u %6u\n", scenarios[i].name, ok ? "ok" : "FAILED",
+               result.frames, result.bad_frames, result.reused_masks, result.pongs, result.closes);
+
+        if (!ok) {
+            failed++;
+        }
+    }
+
+    printf("%u of %u scenarios failed\n", failed, (uint32_t)WSECHO_SCENARIOS);
+
+    return failed ? 1 : 0;
+}
+
+
+
+/**
+ * @brief Send one request on a fresh handle and receiver, then check the
+ *        frames which the client sent after the response
+ *
+ * @param sc - scenario
+ */
+static void run_scenario(const wsecho_scenario * const sc)
+{
+    tcoap_request_descriptor reqd;
+    wsecho_frame frame;
+    tcoap_error err;
+
+    scenario = sc;
+    memset(&result, 0, sizeof(result));
+    memset(last_mask, 0, sizeof(last_mask));
+    uplink_len = 0;
+    uplink_pos = 0;
+
+    memset(&handle, 0, sizeof(handle));
+    handle.name = "wsecho";
+    handle.transport = TCOAP_WS;
+
+    tcoap_ws_receiver_init(&receiver, &handle);
+
+    memset(&reqd, 0, sizeof(reqd));
+    reqd.type = TCOAP_MESSAGE_CON;
+    reqd.code = sc->payload_len ? TCOAP_REQ_POST : TCOAP_REQ_GET;
+    reqd.tkl = WSECHO_TOKEN_LEN;
+    reqd.payload.buf = req_payload;
+    reqd.payload.len = sc->payload_len;
+    reqd.response_callback = response_callback;
+
+    err = tcoap_send_coap_request(&handle, &reqd);
+
+    /* the answers to control frames of server */
+    while (next_frame(&frame)) {
+        check_frame(&frame);
+    }
+
+    if (verbose) {
+        fprintf(stderr, "%s: err %d, answered %d, %u bytes from client, %u bytes from server\n", sc->name, err,
+                result.answered, uplink_len, downlink_len);
+    }
+
+    if (err != TCOAP_OK) {
+        result.answered = false;
+    }
+}
+
+
+/**
+ * @brief Take the next whole frame of client from the stream and unmask it
+ *
+ * @param frame - the frame
+ *
+ * @return false if there is no whole frame
+ */
+static bool next_frame(wsecho_frame * const frame)
+{
+    const uint8_t * header;
+    uint32_t avail;
+    uint32_t idx;
+    uint32_t i;
+
+    header = uplink + uplink_pos;
+    avail = uplink_len - uplink_pos;
+
+    if (avail < 2) {
+        return false;
+    }
+
+    frame->opcode = header[0];
+    frame->len = header[1] & 0x7F;
+    idx = 2;
+
+    if (frame->len == 126) {
+        if (avail < 4) {
+            return false;
+        }
+
+        frame->len = ((uint32_t)header[2] << 8) | header[3];
+        idx = 4;
+
+    } else if (frame->len == 127) {
+        if (avail < 10) {
+            return false;
+        }
+
+        frame->len = ((uint32_t)header[6] << 24) | ((uint32_t)header[7] << 16) | ((uint32_t)header[8] << 8) | header[9];
+        idx = 10;
+    }
+
+    /* rfc6455 5.1: all frames of client are masked */
+    if (!(header[1] & WSECHO_MASK_BIT)) {
+        frame->opcode |= WSECHO_RSV_BITS;
+    } else {
+        if (avail < idx + TCOAP_WS_MASK_LEN) {
+            return false;
+        }
+
+        memcpy(frame->mask, header + idx, TCOAP_WS_MASK_LEN);
+        idx += TCOAP_WS_MASK_LEN;
+    }
+
+    if (avail < idx + frame->len) {
+        return false;
+    }
+
+    if (header[1] & WSECHO_MASK_BIT) {
+        for (i = 0; i < frame->len; ++i) {
+            uplink[uplink_pos + idx + i] ^= frame->mask[i & (TCOAP_WS_MASK_LEN - 1)];
+        }
+    }
+
+    frame->data = uplink + uplink_pos + idx;
+    uplink_pos += idx + frame->len;
+
+    return true;
+}
+
+
+/**
+ * @brief Check the frame of client, count the answers to control frames
+ *
+ * @param frame - the frame
+ */
+static void check_frame(const wsecho_frame * const frame)
+{
+    result.frames++;
+
+    /* a frame which was not masked is marked by RSV bits in 'next_frame' */
+    if (!(frame->opcode & WSECHO_FIN_BIT) || (frame->opcode & WSECHO_RSV_BITS)) {
+        result.bad_frames++;
+        return;
+    }
+
+    /* rfc6455 5.3: the key should be unpredictable */
+    if (memcmp(frame->mask, last_mask, TCOAP_WS_MASK_LEN) == 0) {
+        result.reused_masks++;
+    }
+
+    memcpy(last_mask, frame->mask, TCOAP_WS_MASK_LEN);
+
+    switch (frame->opcode & 0x0F) {
+        case TCOAP_WS_BINARY_FRAME:
+            break;
+
+        case TCOAP_WS_PONG_FRAME:
+            if (frame->len == sizeof(ping_data) && memcmp(frame->data, ping_data, frame->len) == 0) {
+                result.pongs++;
+            }
+            break;
+
+        case TCOAP_WS_CLOSE_FRAME:
+            /* only the status code is echoed */
+            if (frame->len == 2 && memcmp(frame->data, close_data, 2) == 0) {
+                result.closes++;
+            }
+            break;
+
+        default:
+            result.bad_frames++;
+            break;
+    }
+}
+
+
+/**
+ * @brief Echo server: answer the request by the frames of scenario
+ *
+ * @param frame - the request of client
+ *
+ * @return false if the frame is not a request of CoAP over WebSockets
+ */
+static bool server_rx(const wsecho_frame * const frame)
+{
+    static uint8_t resp[TCOAP_MAX_PDU_SIZE];
+
+    const uint8_t * payload;
+    uint32_t payload_len;
+    uint32_t resp_len;
+    uint32_t tkl;
+    uint32_t offset;
+    uint32_t part;
+    uint32_t i;
+
+    if ((frame->opcode & 0x0F) != TCOAP_WS_BINARY_FRAME || frame->len < 2) {
+        return false;
+    }
+
+    /* rfc8323 4.2: the length is elided, the request has no options */
+    tkl = frame->data[0] & 0x0F;
+
+    if (frame->data[0] >> 4 || 2 + tkl > frame->len) {
+        return false;
+    }
+
+    payload = frame->data + 2 + tkl;
+    payload_len = frame->len - 2 - tkl;
+
+    if (payload_len) {
+        payload++;
+        payload_len--;
+    }
+
+    resp_len = 0;
+    resp[resp_len++] = (uint8_t)tkl;
+    resp[resp_len++] = WSECHO_RESP_CODE;
+    memcpy(resp + resp_len, frame->data + 2, tkl);
+    resp_len += tkl;
+
+    if (payload_len) {
+        resp[resp_len++] = 0xFF;
+        memcpy(resp + resp_len, payload, payload_len);
+        resp_len += payload_len;
+    }
+
+    downlink_len = 0;
+
+    if (scenario->text) {
+        put_frame(WSECHO_FIN_BIT | TCOAP_WS_TEXT_FRAME, (const uint8_t *)"text", 4);
+    }
+
+    for (i = 0, offset = 0; i < scenario->fragments; ++i, offset += part) {
+
+        part = (resp_len - offset) / (scenario->fragments - i);
+
+        put_frame((i + 1 == scenario->fragments ? WSECHO_FIN_BIT : 0) | (i ? TCOAP_WS_CONTINUATION_FRAME : TCOAP_WS_BINARY_FRAME),
+                  resp + offset, part);
+
+        /* rfc6455 5.4: control frames may be injected in the middle of a fragmented message */
+        if (!i && scenario->ping) {
+            put_frame(WSECHO_FIN_BIT | TCOAP_WS_PING_FRAME, ping_data, sizeof(ping_data));
+        }
+    }
+
+    if (scenario->close) {
+        put_frame(WSECHO_FIN_BIT | TCOAP_WS_CLOSE_FRAME, close_data, sizeof(close_data));
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Append a frame of server to the downlink stream
+ *
+ * @param first - the first byte of header: FIN and opcode
+ * @param data - payload of frame
+ * @param len - its length
+ */
+static void put_frame(const uint8_t first, const uint8_t * data, const uint32_t len)
+{
+    uint8_t * frame;
+    uint32_t mask;
+    uint32_t idx;
+    uint32_t i;
+
+    frame = downlink + downlink_len;
+    frame[0] = first;
+    idx = 2;
+
+    if (len < 126) {
+        frame[1] = (uint8_t)len;
+    } else {
+        frame[1] = 126;
+        frame[idx++] = (uint8_t)(len >> 8);
+        frame[idx++] = (uint8_t)len;
+    }
+
+    mask = rnd();
+
+    if (scenario->masked) {
+        frame[1] |= WSECHO_MASK_BIT;
+        memcpy(frame + idx, &mask, TCOAP_WS_MASK_LEN);
+        idx += TCOAP_WS_MASK_LEN;
+    }
+
+    for (i = 0; i < len; ++i) {
+        frame[idx + i] = scenario->masked ? data[i] ^ frame[idx - TCOAP_WS_MASK_LEN + (i & (TCOAP_WS_MASK_LEN - 1))] : data[i];
+    }
+
+    downlink_len += idx + len;
+}
+
+
+static bool passed(void)
+{
+    return result.answered && !result.bad_frames && !result.reused_masks
+            && result.pongs == (scenario->ping ? 1u : 0u)
+            && result.closes == (scenario->close ? 1u : 0u)
+            && result.close_signals == result.closes;
+}
+
+
+static void response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result_data)
+{
+    (void)reqd;
+
+    result.answered = result_data->resp_code == WSECHO_RESP_CODE && result_data->payload.len == scenario->payload_len
+            && (!scenario->payload_len || memcmp(result_data->payload.buf, req_payload, scenario->payload_len) == 0);
+}
+
+
+/**
+ * @brief xorshift64* generator
+ *
+ */
+static uint32_t rnd(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+
+    return (uint32_t)((rng * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-v]\n"
+                    "  -v  trace scenarios to stderr\n", name);
+}
+
+
+
+/*
+ * Stream of client goes to the server, waiting feeds the stream of server to
+ * the receiver.
+ */
+
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    (void)handle;
+
+    if (len > sizeof(uplink) - uplink_len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    memcpy(uplink + uplink_len, buf, len);
+    uplink_len += len;
+
+    return TCOAP_OK;
+}
+
+
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    wsecho_frame frame;
+    uint32_t offset;
+    uint32_t part;
+    bool request;
+
+    (void)handle;
+    (void)timeout_ms;
+
+    request = false;
+
+    while (!request && next_frame(&frame)) {
+        check_frame(&frame);
+        request = server_rx(&frame);
+    }
+
+    if (!request) {
+        return TCOAP_TIMEOUT_ERROR;
+    }
+
+    /* the answers to control frames are sent from here */
+    for (offset = 0; offset < downlink_len; offset += part) {
+        part = downlink_len - offset < scenario->chunk ? downlink_len - offset : scenario->chunk;
+        tcoap_ws_receiver_feed(&receiver, downlink + offset, part);
+    }
+
+    return handle->response.len ? TCOAP_OK : TCOAP_TIMEOUT_ERROR;
+}
+
+
+tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal)
+{
+    (void)handle;
+
+    if (signal == TCOAP_CLOSE_DID_RECEIVE) {
+        result.close_signals++;
+    }
+
+    return TCOAP_OK;
+}
+
+
+uint16_t tcoap_get_message_id(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return client_mid++;
+}
+
+
+tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl)
+{
+    uint32_t value;
+    uint32_t i;
+
+    (void)handle;
+
+    value = 0;
+
+    for (i = 0; i < tkl; ++i) {
+        if (!(i & 3)) {
+            value = rnd();
+        }
+
+        token[i] = (uint8_t)(value >> ((i & 3) * 8));
+    }
+
+    return TCOAP_OK;
+}
+
+
+#if defined(TCOAP_LIVENESS_ENABLED) || defined(TCOAP_STATS_ENABLED) || defined(TCOAP_CAPTURE_ENABLED)
+uint32_t tcoap_get_time_ms(tcoap_handle * const handle)
+{
+    (void)handle;
+
+    return 0;
+}
+#endif /* TCOAP_LIVENESS_ENABLED || TCOAP_STATS_ENABLED || TCOAP_CAPTURE_ENABLED */
+
+
+void tcoap_debug_print_packet(tcoap_handle * const handle, const char * msg, uint8_t * data, const uint32_t len)
+{
+    (void)handle; (void)msg; (void)data; (void)len;
+}
+
+
+void tcoap_debug_print_options(tcoap_handle * const handle, const char * msg, const tcoap_option_data * options)
+{
+    (void)handle; (void)msg; (void)options;
+}
+
+
+void tcoap_debug_print_payload(tcoap_handle * const handle, const char * msg, const tcoap_data * const payload)
+{
+    (void)handle; (void)msg; (void)payload;
+}
+
+
+tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len)
+{
+    *block = malloc(min_len);
+
+    return *block != NULL ? TCOAP_OK : TCOAP_NO_FREE_MEM_ERROR;
+}
+
+
+tcoap_error tcoap_free_mem_block(uint8_t * block, const uint32_t min_len)
+{
+    (void)min_len;
+    free(block);
+
+    return TCOAP_OK;
+}
+
+
+void mem_copy(void * dst, const void * src, uint32_t cnt)
+{
+    memmove(dst, src, cnt);
+}
+
+
+bool mem_cmp(const void * dst, const void * src, uint32_t cnt)
+{
+    return memcmp(dst, src, cnt) == 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * tcoap_port_common.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: hooks of 'tcoap' which are the same for all backends of Linux port.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+
+#include "tcoap_port_linux.h"
+
+
+
+/**
+ * @brief Signals of 'tcoap', they are passed to the 'signal_callback' of port
+ *
+ */
+tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal)
+{
+    tcoap_linux_port * port;
+
+    port = TCOAP_LINUX_PORT(handle);
+
+    if (signal == TCOAP_RESPONSE_DID_RECEIVE) {
+        port->response_ready = true;
+    }
+
+    if (port->signal_callback != NULL) {
+        port->signal_callback(port, signal);
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Message ID is incremented from the random initial value
+ *
+ */
+uint16_t tcoap_get_message_id(tcoap_handle * const handle)
+{
+    return TCOAP_LINUX_PORT(handle)->message_id++;
+}
+
+
+/**
+ * @brief Token (and the masking key of WebSocket) should be unpredictable, rfc7252 5.3.1
+ *
+ */
+tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl)
+{
+    (void)handle;
+
+    if (getrandom(token, tkl, 0) != (ssize_t)tkl) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    return TCOAP_OK;
+}
+
+
+#if defined(TCOAP_LIVENESS_ENABLED) || defined(TCOAP_STATS_ENABLED) || defined(TCOAP_CAPTURE_ENABLED)
+/**
+ * @brief Monotonic time, it is not affected by changing of system time
+ *
+ */
+uint32_t tcoap_get_time_ms(tcoap_handle * const handle)
+{
+    struct timespec ts;
+
+    (void)handle;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)ts.tv_sec * 1000u + (uint32_t)(ts.tv_nsec / 1000000);
+}
+#endif /* TCOAP_LIVENESS_ENABLED || TCOAP_STATS_ENABLED || TCOAP_CAPTURE_ENABLED */
+
+
+#ifdef TCOAP_TRACE_ENABLED
+/**
+ * @brief Phases of the exchange are stamped into 'trace_ns' of port
+ *
+ */
+void tcoap_trace(tcoap_handle * const handle, const tcoap_trace_point point)
+{
+    tcoap_linux_port * port;
+    struct timespec ts;
+
+    port = TCOAP_LINUX_PORT(handle);
+
+    if (point == TCOAP_TRACE_REQUEST_START) {
+        memset(port->trace_ns, 0, sizeof(port->trace_ns));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    port->trace_ns[point] = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif /* TCOAP_TRACE_ENABLED */
+
+
+/**
+ * @brief Debug output goes to stderr
+ *
+ */
+void tcoap_debug_print_packet(tcoap_handle * const handle, const char * msg, uint8_t * data, const uint32_t len)
+{
+    uint32_t i;
+
+    fprintf(stderr, "%s: %s", handle->name != NULL ? handle->name : "tcoap", msg);
+
+    for (i = 0; i < len; i++) {
+        fprintf(stderr, " %02x", data[i]);
+    }
+
+    fprintf(stderr, "\n");
+}
+
+
+void tcoap_debug_print_options(tcoap_handle * const handle, const char * msg, const tcoap_option_data * options)
+{
+    fprintf(stderr, "%s: %s", handle->name != NULL ? handle->name : "tcoap", msg);
+
+    for (; options != NULL; options = options->next) {
+        fprintf(stderr, " %u[%u]", options->num, options->len);
+    }
+
+    fprintf(stderr, "\n");
+}
+
+
+void tcoap_debug_print_payload(tcoap_handle * const handle, const char * msg, const tcoap_data * const payload)
+{
+    tcoap_debug_print_packet(handle, msg, payload->buf, payload->len);
+}
+
+
+tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len)
+{
+    *block = malloc(min_len);
+
+    return *block != NULL ? TCOAP_OK : TCOAP_NO_FREE_MEM_ERROR;
+}
+
+
+tcoap_error tcoap_free_mem_block(uint8_t * block, const uint32_t min_len)
+{
+    (void)min_len;
+
+    free(block);
+
+    return TCOAP_OK;
+}
+
+
+void mem_copy(void * dst, const void * src, uint32_t cnt)
+{
+    memmove(dst, src, cnt);
+}
+
+
+bool mem_cmp(const void * dst, const void * src, uint32_t cnt)
+{
+    return memcmp(dst, src, cnt) == 0;
+}
+
@@ -0,0 +1,538 @@
+/**
+ * tcoap_port_linux.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tcoap_port_linux.h"
+
+#ifndef TCOAP_LINUX_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+
+
+#define TCOAP_LINUX_MAX_EVENTS       2
+
+
+
+static tcoap_error connect_socket(tcoap_linux_port * const port, const struct addrinfo * const ai);
+static tcoap_error wait_socket(tcoap_linux_port * const port, const uint32_t events, const uint32_t timeout_ms);
+static tcoap_error arm_timer(tcoap_linux_port * const port, const uint32_t timeout_ms);
+static tcoap_error receive(tcoap_linux_port * const port);
+static void deliver(tcoap_linux_port * const port);
+static void close_fd(int * const fd);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_linux_port_open(tcoap_linux_port * const port, const char * host, const char * service, const uint16_t transport)
+{
+    tcoap_error err;
+    struct addrinfo hints;
+    struct addrinfo * res;
+    struct addrinfo * ai;
+    struct epoll_event ev;
+
+    if (transport != TCOAP_UDP && transport != TCOAP_TCP) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    port->handle.transport = transport;
+    port->sock = -1;
+    port->response_ready = false;
+    port->rx_cnt = 0;
+    port->rx_idx = 0;
+
+    tcoap_tcp_framer_init(&port->framer, &port->handle, port->framer_buf, sizeof(port->framer_buf));
+
+    /* rfc7252 4.4: the initial Message ID should be randomized */
+    if (getrandom(&port->message_id, sizeof(port->message_id), 0) != (ssize_t)sizeof(port->message_id)) {
+        port->message_id = (uint16_t)time(NULL);
+    }
+
+    port->epfd = epoll_create1(EPOLL_CLOEXEC);
+    port->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (port->epfd < 0 || port->timerfd < 0) {
+        err = TCOAP_NO_FREE_MEM_ERROR;
+        goto return_err_label;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = port->timerfd;
+
+    if (epoll_ctl(port->epfd, EPOLL_CTL_ADD, port->timerfd, &ev) < 0) {
+        err = TCOAP_NO_FREE_MEM_ERROR;
+        goto return_err_label;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = transport == TCOAP_UDP ? SOCK_DGRAM : SOCK_STREAM;
+
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        err = TCOAP_PARAM_ERROR;
+        goto return_err_label;
+    }
+
+    err = TCOAP_WRONG_STATE_ERROR;
+
+    for (ai = res; ai != NULL && err != TCOAP_OK; ai = ai->ai_next) {
+        err = connect_socket(port, ai);
+    }
+
+    freeaddrinfo(res);
+
+    if (err != TCOAP_OK) {
+        goto return_err_label;
+    }
+
+    return TCOAP_OK;
+
+/***********/
+return_err_label:
+/***********/
+
+    tcoap_linux_port_close(port);
+    return err;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_linux_port_close(tcoap_linux_port * const port)
+{
+    close_fd(&port->sock);
+    close_fd(&port->timerfd);
+    close_fd(&port->epfd);
+
+    port->rx_cnt = 0;
+    port->rx_idx = 0;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_linux_port_poll(tcoap_linux_port * const port, const uint32_t timeout_ms)
+{
+    tcoap_error err;
+    struct epoll_event events[TCOAP_LINUX_MAX_EVENTS];
+    int n;
+    int i;
+
+    /* nothing is awaited between exchanges */
+    port->response_ready = false;
+
+    deliver(port);
+
+    n = epoll_wait(port->epfd, events, TCOAP_LINUX_MAX_EVENTS, (int)timeout_ms);
+
+    if (n < 0) {
+        return errno == EINTR ? TCOAP_OK : TCOAP_WRONG_STATE_ERROR;
+    }
+
+    for (i = 0; i < n; i++) {
+
+        if (events[i].data.fd != port->sock) {
+            continue;
+        }
+
+        err = receive(port);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+
+        deliver(port);
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Send data to the server. The non-blocking socket is waited for
+ *        writability if its buffer is full.
+ *
+ */
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    tcoap_linux_port * port;
+    tcoap_error err;
+    uint32_t sent;
+    ssize_t n;
+
+    port = TCOAP_LINUX_PORT(handle);
+    sent = 0;
+
+    while (sent < len) {
+
+        n = send(port->sock, buf + sent, len - sent, MSG_NOSIGNAL);
+
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+
+        switch (errno) {
+            case EINTR:
+            /* rfc7252: the datagram may be lost anyway, the error of previous one is just reported */
+            case ECONNREFUSED:
+                break;
+
+            case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+            case EWOULDBLOCK:
+#endif
+                err = wait_socket(port, EPOLLOUT, TCOAP_LINUX_IO_TIMEOUT_MS);
+
+                if (err != TCOAP_OK) {
+                    return err;
+                }
+                break;
+
+            default:
+                return TCOAP_WRONG_STATE_ERROR;
+        }
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Wait for the response: readiness of socket and the deadline
+ *        (timerfd) are multiplexed by epoll. Received packets are
+ *        delivered to the handle one by one until the awaited one.
+ *
+ */
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    tcoap_linux_port * port;
+    tcoap_error err;
+    struct epoll_event events[TCOAP_LINUX_MAX_EVENTS];
+    bool expired;
+    int n;
+    int i;
+
+    port = TCOAP_LINUX_PORT(handle);
+    port->response_ready = false;
+
+    err = arm_timer(port, timeout_ms);
+
+    if (err != TCOAP_OK) {
+        return err;
+    }
+
+    for (;;) {
+
+        /* the rest of previous batch goes first */
+        deliver(port);
+
+        if (port->response_ready) {
+            break;
+        }
+
+        n = epoll_wait(port->epfd, events, TCOAP_LINUX_MAX_EVENTS, -1);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            err = TCOAP_WRONG_STATE_ERROR;
+            break;
+        }
+
+        expired = false;
+
+        for (i = 0; i < n && err == TCOAP_OK; i++) {
+            if (events[i].data.fd == port->timerfd) {
+                expired = true;
+            } else {
+                err = receive(port);
+            }
+        }
+
+        if (err != TCOAP_OK) {
+            break;
+        }
+
+        /* the response which has arrived together with expiring is accepted */
+        if (expired) {
+            deliver(port);
+
+            if (!port->response_ready) {
+                err = TCOAP_TIMEOUT_ERROR;
+            }
+            break;
+        }
+    }
+
+    arm_timer(port, 0);
+
+    return err;
+}
+
+
+/**
+ * @brief Create the non-blocking socket and connect it to the address
+ *
+ * @param port - pointer on the port
+ * @param ai - address of server
+ *
+ * @return status of operation
+ */
+static tcoap_error connect_socket(tcoap_linux_port * const port, const struct addrinfo * const ai)
+{
+    tcoap_error err;
+    struct epoll_event ev;
+    socklen_t len;
+    int sock_err;
+    int one;
+
+    port->sock = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+
+    if (port->sock < 0) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = port->sock;
+
+    if (epoll_ctl(port->epfd, EPOLL_CTL_ADD, port->sock, &ev) < 0) {
+        err = TCOAP_NO_FREE_MEM_ERROR;
+        goto return_err_label;
+    }
+
+    /* the exchange is stop-and-wait, so small segments should not be delayed */
+    if (ai->ai_socktype == SOCK_STREAM) {
+        one = 1;
+        setsockopt(port->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    /* UDP socket is connected as well, datagrams of other peers are filtered by kernel */
+    if (connect(port->sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+
+        if (errno != EINPROGRESS) {
+            err = TCOAP_WRONG_STATE_ERROR;
+            goto return_err_label;
+        }
+
+        err = wait_socket(port, EPOLLOUT, TCOAP_LINUX_IO_TIMEOUT_MS);
+
+        if (err != TCOAP_OK) {
+            goto return_err_label;
+        }
+
+        len = sizeof(sock_err);
+
+        if (getsockopt(port->sock, SOL_SOCKET, SO_ERROR, &sock_err, &len) < 0 || sock_err) {
+            err = TCOAP_WRONG_STATE_ERROR;
+            goto return_err_label;
+        }
+    }
+
+    return TCOAP_OK;
+
+/***********/
+return_err_label:
+/***********/
+
+    close_fd(&port->sock);
+    return err;
+}
+
+
+/**
+ * @brief Wait for the events of socket (e.g. writability), the interest in
+ *        the readability is restored after it
+ *
+ * @param port - pointer on the port
+ * @param events - awaited events of epoll
+ * @param timeout_ms - timeout of waiting
+ *
+ * @return status of operation
+ */
+static tcoap_error wait_socket(tcoap_linux_port * const port, const uint32_t events, const uint32_t timeout_ms)
+{
+    tcoap_error err;
+    struct epoll_event ev;
+    struct epoll_event ready[TCOAP_LINUX_MAX_EVENTS];
+    int n;
+    int i;
+
+    ev.events = events;
+    ev.data.fd = port->sock;
+
+    if (epoll_ctl(port->epfd, EPOLL_CTL_MOD, port->sock, &ev) < 0) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    err = TCOAP_TIMEOUT_ERROR;
+
+    do {
+        n = epoll_wait(port->epfd, ready, TCOAP_LINUX_MAX_EVENTS, (int)timeout_ms);
+    } while (n < 0 && errno == EINTR);
+
+    for (i = 0; i < n; i++) {
+        if (ready[i].data.fd == port->sock) {
+            err = TCOAP_OK;
+        }
+    }
+
+    ev.events = EPOLLIN;
+    epoll_ctl(port->epfd, EPOLL_CTL_MOD, port->sock, &ev);
+
+    return n < 0 ? TCOAP_WRONG_STATE_ERROR : err;
+}
+
+
+/**
+ * @brief Arm the deadline of waiting
+ *
+ * @param port - pointer on the port
+ * @param timeout_ms - timeout, 0 disarms the timer
+ *
+ * @return status of operation
+ */
+static tcoap_error arm_timer(tcoap_linux_port * const port, const uint32_t timeout_ms)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = timeout_ms / 1000;
+    its.it_value.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+
+    /* the count of expirations is reset as well */
+    if (timerfd_settime(port->timerfd, 0, &its, NULL) < 0) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Receive the available data of socket. Datagrams are received by
+ *        a batch, TCP stream by one chunk.
+ *
+ * @param port - pointer on the port
+ *
+ * @return status of operation ('TCOAP_WRONG_STATE_ERROR' if connection was closed)
+ */
+static tcoap_error receive(tcoap_linux_port * const port)
+{
+    struct mmsghdr msgs[TCOAP_LINUX_RX_BATCH];
+    struct iovec iovs[TCOAP_LINUX_RX_BATCH];
+    ssize_t n;
+    int i;
+
+    /* the previous data is not delivered yet, the socket keeps the new one */
+    if (port->rx_idx < port->rx_cnt) {
+        return TCOAP_OK;
+    }
+
+    port->rx_cnt = 0;
+    port->rx_idx = 0;
+
+    if (port->handle.transport == TCOAP_TCP) {
+
+        n = recv(port->sock, port->rx_buf, sizeof(port->rx_buf), MSG_DONTWAIT);
+
+        if (!n) {
+            return TCOAP_WRONG_STATE_ERROR;
+        }
+
+    } else {
+
+        memset(msgs, 0, sizeof(msgs));
+
+        for (i = 0; i < TCOAP_LINUX_RX_BATCH; i++) {
+            iovs[i].iov_base = port->rx_buf[i];
+            iovs[i].iov_len = TCOAP_MAX_PDU_SIZE;
+
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        n = recvmmsg(port->sock, msgs, TCOAP_LINUX_RX_BATCH, MSG_DONTWAIT, NULL);
+
+        /* too long datagrams are rejected by the handle as overflowed */
+        for (i = 0; i < n; i++) {
+            port->rx_len[i] = msgs[i].msg_hdr.msg_flags & MSG_TRUNC ? TCOAP_MAX_PDU_SIZE + 1 : msgs[i].msg_len;
+        }
+    }
+
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNREFUSED
+                ? TCOAP_OK : TCOAP_WRONG_STATE_ERROR;
+    }
+
+    port->rx_cnt = n;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Deliver received packets to the handle until the awaited one
+ *
+ * @param port - pointer on the port
+ *
+ */
+static void deliver(tcoap_linux_port * const port)
+{
+    tcoap_error err;
+
+    while (port->rx_idx < port->rx_cnt && !port->response_ready) {
+
+        if (port->handle.transport == TCOAP_TCP) {
+            port->rx_idx += tcoap_tcp_framer_feed_frame(&port->framer,
+                    (const uint8_t *)port->rx_buf + port->rx_idx, port->rx_cnt - port->rx_idx, &err);
+        } else {
+            tcoap_rx_packet(&port->handle, port->rx_buf[port->rx_idx], port->rx_len[port->rx_idx]);
+            port->rx_idx++;
+        }
+    }
+}
+
+
+/**
+ * @brief Close the file descriptor if it is opened
+ *
+ * @param fd - pointer on the descriptor
+ *
+ */
+static void close_fd(int * const fd)
+{
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+#endif /* TCOAP_LINUX_IO_URING */
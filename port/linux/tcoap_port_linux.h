@@ -0,0 +1,179 @@
+/**
+ * tcoap_port_linux.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: reference port for Linux. It implements all extern hooks of 'tcoap'
+ *       over a UDP or TCP socket, TCP stream is cut by the framer. There are
+ *       two backends with the same API:
+ *
+ *       - epoll (default, 'tcoap_port_linux.c'): readiness of non-blocking
+ *         socket and the deadline of waiting (timerfd) are multiplexed by
+ *         epoll, datagrams are received by batches (recvmmsg);
+ *
+ *       - io_uring ('TCOAP_LINUX_IO_URING', 'tcoap_port_uring.c', Linux 5.19+):
+ *         the multishot receive fills the ring of provided buffers, so the
+ *         data is received without syscalls per datagram, the deadline is
+ *         the timeout of waiting for completions.
+ *
+ *       All sources of the port ('tcoap_port_*.c') should be built, the
+ *       backend is selected by the flag.
+ *
+ *       Each exchange is single-threaded: the response is received in the
+ *       context of 'tcoap_wait_event', so the port needs no threads and locks.
+ *
+ */
+
+
+#ifndef __TCOAP_PORT_LINUX_H
+#define __TCOAP_PORT_LINUX_H
+
+
+#include "tcoap.h"
+#include "tcoap_tcp.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifndef TCOAP_LINUX_RX_BATCH
+#define TCOAP_LINUX_RX_BATCH            8         /* rx buffers (power of 2 for io_uring) */
+#endif /* TCOAP_LINUX_RX_BATCH */
+
+#ifdef TCOAP_LINUX_IO_URING
+#ifndef TCOAP_LINUX_URING_ENTRIES
+#define TCOAP_LINUX_URING_ENTRIES       8
+#endif /* TCOAP_LINUX_URING_ENTRIES */
+#endif /* TCOAP_LINUX_IO_URING */
+
+#ifndef TCOAP_LINUX_IO_TIMEOUT_MS
+#define TCOAP_LINUX_IO_TIMEOUT_MS       5000      /* connecting, sending while the socket buffer is full */
+#endif /* TCOAP_LINUX_IO_TIMEOUT_MS */
+
+
+#define TCOAP_LINUX_PORT(h)             ((tcoap_linux_port *)(h))
+
+
+struct tcoap_linux_port;
+
+
+/**
+ * @brief Callback for signals of 'tcoap' (see 'tcoap_out_signal')
+ *
+ */
+typedef void (*tcoap_linux_signal_callback)(struct tcoap_linux_port * const port, const tcoap_out_signal signal);
+
+
+typedef struct tcoap_linux_port {
+
+    tcoap_handle handle;          /* it must be the first, hooks find the port by the handle */
+
+    tcoap_linux_signal_callback signal_callback;   /* optional */
+
+    int sock;
+
+    bool response_ready;          /* the awaited packet was delivered to the handle */
+    uint16_t message_id;
+
+    /* received data which is not delivered yet, it is delivered packet by packet,
+     * so the response is not overwritten by the next packet of the same batch.
+     * The extra byte reveals datagrams which are longer than the PDU */
+    uint8_t rx_buf[TCOAP_LINUX_RX_BATCH][TCOAP_MAX_PDU_SIZE + 1];
+    uint32_t rx_len[TCOAP_LINUX_RX_BATCH];
+
+#ifdef TCOAP_LINUX_IO_URING
+    int ring_fd;
+    uint8_t * ring;               /* mapped rings of submissions and completions */
+    uint32_t ring_size;
+    uint8_t * sqes;
+    uint32_t sqes_size;
+    uint32_t to_submit;
+
+    uint32_t * sq_head;
+    uint32_t * sq_tail;
+    uint32_t * sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+
+    uint32_t * cq_head;
+    uint32_t * cq_tail;
+    uint8_t * cqes;
+    uint32_t cq_mask;
+
+    void * buf_ring;              /* ring of provided buffers, they are 'rx_buf' */
+    uint16_t buf_tail;
+
+    uint8_t rx_bid[TCOAP_LINUX_RX_BATCH];   /* filled buffers in order of receiving */
+    uint32_t rx_head;
+    uint32_t rx_cnt;              /* number of filled buffers */
+    uint32_t rx_offset;           /* TCP: delivered bytes of the first buffer */
+
+    bool recv_armed;              /* multishot receive is active */
+    bool rx_closed;               /* connection was closed or failed */
+
+    bool tx_done;
+    int tx_res;
+#else
+    int epfd;
+    int timerfd;
+
+    uint32_t rx_cnt;              /* UDP: received datagrams, TCP: received bytes */
+    uint32_t rx_idx;              /* UDP: next datagram, TCP: next byte */
+#endif /* TCOAP_LINUX_IO_URING */
+
+    tcoap_tcp_framer framer;
+    uint8_t framer_buf[TCOAP_MAX_PDU_SIZE];
+
+#ifdef TCOAP_TRACE_ENABLED
+    /* monotonic timestamps of phases of the last exchange (ns), 0 if a phase was
+     * not passed. They are kept until the next exchange starts */
+    uint64_t trace_ns[TCOAP_TRACE_REQUEST_END + 1];
+#endif /* TCOAP_TRACE_ENABLED */
+
+} tcoap_linux_port;
+
+
+/**
+ * @brief Open connection with the server. The fields 'name', 'headroom' and
+ *        'tailroom' of handle and 'signal_callback' should be set before.
+ *        For CoAP over TCP the 'tcoap_start_connection' should be called after.
+ *
+ * @param port - pointer on the port
+ * @param host - host name or address of server
+ * @param service - port of server (e.g. "5683")
+ * @param transport - 'TCOAP_UDP' or 'TCOAP_TCP'
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_linux_port_open(tcoap_linux_port * const port, const char * host, const char * service, const uint16_t transport);
+
+
+/**
+ * @brief Close connection with the server
+ *
+ * @param port - pointer on the port
+ *
+ */
+void tcoap_linux_port_close(tcoap_linux_port * const port);
+
+
+/**
+ * @brief Process data of server between exchanges (e.g. Ping of server is
+ *        caught for 'tcoap_keepalive' if liveness is enabled)
+ *
+ * @param port - pointer on the port
+ * @param timeout_ms - maximum time of waiting for data
+ *
+ * @return status of operation ('TCOAP_WRONG_STATE_ERROR' if connection was closed)
+ */
+tcoap_error tcoap_linux_port_poll(tcoap_linux_port * const port, const uint32_t timeout_ms);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_PORT_LINUX_H */
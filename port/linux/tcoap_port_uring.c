@@ -0,0 +1,692 @@
+/**
+ * tcoap_port_uring.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tcoap_port_linux.h"
+
+#ifdef TCOAP_LINUX_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+
+#define TCOAP_URING_RECV             1
+#define TCOAP_URING_SEND             2
+
+#define TCOAP_URING_BGID             0         /* group of provided buffers */
+
+
+
+static tcoap_error setup_ring(tcoap_linux_port * const port);
+static tcoap_error setup_buf_ring(tcoap_linux_port * const port);
+static tcoap_error connect_socket(tcoap_linux_port * const port, const struct addrinfo * const ai);
+static struct io_uring_sqe * get_sqe(tcoap_linux_port * const port);
+static void provide_buffer(tcoap_linux_port * const port, const uint16_t bid);
+static void arm_recv(tcoap_linux_port * const port);
+static tcoap_error enter(tcoap_linux_port * const port, const uint32_t timeout_ms);
+static void reap(tcoap_linux_port * const port);
+static void deliver(tcoap_linux_port * const port);
+static uint32_t get_time_ms(void);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_linux_port_open(tcoap_linux_port * const port, const char * host, const char * service, const uint16_t transport)
+{
+    tcoap_error err;
+    struct addrinfo hints;
+    struct addrinfo * res;
+    struct addrinfo * ai;
+
+    if (transport != TCOAP_UDP && transport != TCOAP_TCP) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    port->handle.transport = transport;
+    port->sock = -1;
+    port->ring_fd = -1;
+    port->ring = NULL;
+    port->sqes = NULL;
+    port->buf_ring = NULL;
+    port->to_submit = 0;
+    port->buf_tail = 0;
+    port->rx_head = 0;
+    port->rx_cnt = 0;
+    port->rx_offset = 0;
+    port->recv_armed = false;
+    port->rx_closed = false;
+    port->response_ready = false;
+
+    tcoap_tcp_framer_init(&port->framer, &port->handle, port->framer_buf, sizeof(port->framer_buf));
+
+    /* rfc7252 4.4: the initial Message ID should be randomized */
+    if (getrandom(&port->message_id, sizeof(port->message_id), 0) != (ssize_t)sizeof(port->message_id)) {
+        port->message_id = (uint16_t)time(NULL);
+    }
+
+    err = setup_ring(port);
+
+    if (err != TCOAP_OK) {
+        goto return_err_label;
+    }
+
+    err = setup_buf_ring(port);
+
+    if (err != TCOAP_OK) {
+        goto return_err_label;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = transport == TCOAP_UDP ? SOCK_DGRAM : SOCK_STREAM;
+
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        err = TCOAP_PARAM_ERROR;
+        goto return_err_label;
+    }
+
+    err = TCOAP_WRONG_STATE_ERROR;
+
+    for (ai = res; ai != NULL && err != TCOAP_OK; ai = ai->ai_next) {
+        err = connect_socket(port, ai);
+    }
+
+    freeaddrinfo(res);
+
+    if (err != TCOAP_OK) {
+        goto return_err_label;
+    }
+
+    /* the receiving is armed once, it fills buffers until they are exhausted */
+    arm_recv(port);
+
+    return TCOAP_OK;
+
+/***********/
+return_err_label:
+/***********/
+
+    tcoap_linux_port_close(port);
+    return err;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_linux_port_close(tcoap_linux_port * const port)
+{
+    if (port->sock >= 0) {
+        close(port->sock);
+        port->sock = -1;
+    }
+
+    /* requests in flight are cancelled by closing of the ring */
+    if (port->ring_fd >= 0) {
+        close(port->ring_fd);
+        port->ring_fd = -1;
+    }
+
+    if (port->buf_ring != NULL) {
+        munmap(port->buf_ring, TCOAP_LINUX_RX_BATCH * sizeof(struct io_uring_buf));
+        port->buf_ring = NULL;
+    }
+
+    if (port->sqes != NULL) {
+        munmap(port->sqes, port->sqes_size);
+        port->sqes = NULL;
+    }
+
+    if (port->ring != NULL) {
+        munmap(port->ring, port->ring_size);
+        port->ring = NULL;
+    }
+
+    port->rx_cnt = 0;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_linux_port_poll(tcoap_linux_port * const port, const uint32_t timeout_ms)
+{
+    tcoap_error err;
+
+    /* nothing is awaited between exchanges */
+    port->response_ready = false;
+
+    deliver(port);
+
+    err = enter(port, timeout_ms);
+
+    if (err != TCOAP_OK && err != TCOAP_TIMEOUT_ERROR) {
+        return err;
+    }
+
+    reap(port);
+    deliver(port);
+
+    return port->rx_closed ? TCOAP_WRONG_STATE_ERROR : TCOAP_OK;
+}
+
+
+/**
+ * @brief Send data to the server. The submission is completed within the call,
+ *        so the data may be placed anywhere (e.g. on the stack of caller).
+ *
+ */
+tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    tcoap_linux_port * port;
+    tcoap_error err;
+    struct io_uring_sqe * sqe;
+    uint32_t sent;
+    uint32_t deadline;
+    int32_t remaining;
+
+    port = TCOAP_LINUX_PORT(handle);
+    sent = 0;
+
+    while (sent < len) {
+
+        sqe = get_sqe(port);
+
+        if (sqe == NULL) {
+            return TCOAP_BUSY_ERROR;
+        }
+
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = port->sock;
+        sqe->addr = (uint64_t)(uintptr_t)(buf + sent);
+        sqe->len = len - sent;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = TCOAP_URING_SEND;
+
+        port->tx_done = false;
+        deadline = get_time_ms() + TCOAP_LINUX_IO_TIMEOUT_MS;
+
+        /* the send and arrived data are completed by one syscall */
+        while (!port->tx_done) {
+
+            remaining = (int32_t)(deadline - get_time_ms());
+
+            /* the send is still in flight, the connection should be closed */
+            if (remaining <= 0) {
+                return TCOAP_TIMEOUT_ERROR;
+            }
+
+            err = enter(port, remaining);
+
+            if (err != TCOAP_OK && err != TCOAP_TIMEOUT_ERROR) {
+                return err;
+            }
+
+            reap(port);
+        }
+
+        if (port->tx_res < 0) {
+            /* rfc7252: the datagram may be lost anyway, the error of previous one is just reported */
+            if (port->tx_res == -EINTR || port->tx_res == -ECONNREFUSED) {
+                continue;
+            }
+
+            return TCOAP_WRONG_STATE_ERROR;
+        }
+
+        sent += port->tx_res;
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Wait for the response: completions of the multishot receive are
+ *        awaited with the timeout, filled buffers are delivered to the handle
+ *        one by one until the awaited packet.
+ *
+ */
+tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t timeout_ms)
+{
+    tcoap_linux_port * port;
+    tcoap_error err;
+    uint32_t deadline;
+    int32_t remaining;
+
+    port = TCOAP_LINUX_PORT(handle);
+    port->response_ready = false;
+    deadline = get_time_ms() + timeout_ms;
+
+    for (;;) {
+
+        /* the rest of previous buffers goes first */
+        deliver(port);
+
+        if (port->response_ready) {
+            return TCOAP_OK;
+        }
+
+        if (port->rx_closed) {
+            return TCOAP_WRONG_STATE_ERROR;
+        }
+
+        remaining = (int32_t)(deadline - get_time_ms());
+
+        if (remaining <= 0) {
+            return TCOAP_TIMEOUT_ERROR;
+        }
+
+        err = enter(port, remaining);
+
+        if (err != TCOAP_OK && err != TCOAP_TIMEOUT_ERROR) {
+            return err;
+        }
+
+        reap(port);
+    }
+}
+
+
+/**
+ * @brief Create io_uring instance and map its rings
+ *
+ * @param port - pointer on the port
+ *
+ * @return status of operation
+ */
+static tcoap_error setup_ring(tcoap_linux_port * const port)
+{
+    struct io_uring_params params;
+    uint32_t sq_size;
+    uint32_t cq_size;
+
+    memset(&params, 0, sizeof(params));
+
+    port->ring_fd = syscall(__NR_io_uring_setup, TCOAP_LINUX_URING_ENTRIES, &params);
+
+    if (port->ring_fd < 0) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    /* both rings in one mapping (5.4) and the timeout of waiting (5.11) are required */
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    port->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    port->ring = mmap(NULL, port->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, port->ring_fd, IORING_OFF_SQ_RING);
+
+    if (port->ring == MAP_FAILED) {
+        port->ring = NULL;
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    port->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    port->sqes = mmap(NULL, port->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, port->ring_fd, IORING_OFF_SQES);
+
+    if (port->sqes == MAP_FAILED) {
+        port->sqes = NULL;
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    port->sq_head = (uint32_t *)(port->ring + params.sq_off.head);
+    port->sq_tail = (uint32_t *)(port->ring + params.sq_off.tail);
+    port->sq_array = (uint32_t *)(port->ring + params.sq_off.array);
+    port->sq_mask = *(uint32_t *)(port->ring + params.sq_off.ring_mask);
+    port->sq_entries = params.sq_entries;
+
+    port->cq_head = (uint32_t *)(port->ring + params.cq_off.head);
+    port->cq_tail = (uint32_t *)(port->ring + params.cq_off.tail);
+    port->cqes = port->ring + params.cq_off.cqes;
+    port->cq_mask = *(uint32_t *)(port->ring + params.cq_off.ring_mask);
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Register the ring of provided buffers, the rx buffers of port are
+ *        given to the kernel for the multishot receive
+ *
+ * @param port - pointer on the port
+ *
+ * @return status of operation
+ */
+static tcoap_error setup_buf_ring(tcoap_linux_port * const port)
+{
+    struct io_uring_buf_reg reg;
+    uint16_t bid;
+
+    port->buf_ring = mmap(NULL, TCOAP_LINUX_RX_BATCH * sizeof(struct io_uring_buf),
+            PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+    if (port->buf_ring == MAP_FAILED) {
+        port->buf_ring = NULL;
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)port->buf_ring;
+    reg.ring_entries = TCOAP_LINUX_RX_BATCH;
+    reg.bgid = TCOAP_URING_BGID;
+
+    if (syscall(__NR_io_uring_register, port->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    for (bid = 0; bid < TCOAP_LINUX_RX_BATCH; bid++) {
+        provide_buffer(port, bid);
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Create the socket and connect it to the address
+ *
+ * @param port - pointer on the port
+ * @param ai - address of server
+ *
+ * @return status of operation
+ */
+static tcoap_error connect_socket(tcoap_linux_port * const port, const struct addrinfo * const ai)
+{
+    struct timeval tv;
+    int one;
+
+    port->sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+
+    if (port->sock < 0) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    /* the connecting is limited by the timeout of sending */
+    tv.tv_sec = TCOAP_LINUX_IO_TIMEOUT_MS / 1000;
+    tv.tv_usec = (TCOAP_LINUX_IO_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(port->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    /* the exchange is stop-and-wait, so small segments should not be delayed */
+    if (ai->ai_socktype == SOCK_STREAM) {
+        one = 1;
+        setsockopt(port->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    /* UDP socket is connected as well, datagrams of other peers are filtered by kernel */
+    if (connect(port->sock, ai->ai_addr, ai->ai_addrlen) < 0) {
+        close(port->sock);
+        port->sock = -1;
+
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Get a free submission entry, it is submitted by the next 'enter'
+ *
+ * @param port - pointer on the port
+ *
+ * @return pointer on the cleared entry, NULL if the ring is full
+ */
+static struct io_uring_sqe * get_sqe(tcoap_linux_port * const port)
+{
+    struct io_uring_sqe * sqe;
+    uint32_t tail;
+    uint32_t idx;
+
+    tail = *port->sq_tail;
+
+    if (tail - __atomic_load_n(port->sq_head, __ATOMIC_ACQUIRE) >= port->sq_entries) {
+        return NULL;
+    }
+
+    idx = tail & port->sq_mask;
+    sqe = (struct io_uring_sqe *)port->sqes + idx;
+
+    memset(sqe, 0, sizeof(*sqe));
+    port->sq_array[idx] = idx;
+
+    __atomic_store_n(port->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    port->to_submit++;
+
+    return sqe;
+}
+
+
+/**
+ * @brief Give the rx buffer back to the kernel
+ *
+ * @param port - pointer on the port
+ * @param bid - index of buffer
+ *
+ */
+static void provide_buffer(tcoap_linux_port * const port, const uint16_t bid)
+{
+    struct io_uring_buf_ring * br;
+    struct io_uring_buf * buf;
+
+    br = port->buf_ring;
+    buf = &br->bufs[port->buf_tail & (TCOAP_LINUX_RX_BATCH - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)port->rx_buf[bid];
+    buf->len = sizeof(port->rx_buf[bid]);
+    buf->bid = bid;
+
+    port->buf_tail++;
+    __atomic_store_n(&br->tail, port->buf_tail, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Arm the multishot receive into the provided buffers
+ *
+ * @param port - pointer on the port
+ *
+ */
+static void arm_recv(tcoap_linux_port * const port)
+{
+    struct io_uring_sqe * sqe;
+
+    sqe = get_sqe(port);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = port->sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = TCOAP_URING_BGID;
+    sqe->user_data = TCOAP_URING_RECV;
+
+    port->recv_armed = true;
+}
+
+
+/**
+ * @brief Submit the queued entries and wait for at least one completion
+ *
+ * @param port - pointer on the port
+ * @param timeout_ms - timeout of waiting
+ *
+ * @return status of operation
+ */
+static tcoap_error enter(tcoap_linux_port * const port, const uint32_t timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    long res;
+
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    res = syscall(__NR_io_uring_enter, port->ring_fd, port->to_submit, 1,
+            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+    if (res < 0) {
+        return errno == ETIME || errno == EINTR ? TCOAP_TIMEOUT_ERROR : TCOAP_WRONG_STATE_ERROR;
+    }
+
+    port->to_submit -= res;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Process completions: filled buffers are queued for delivering
+ *
+ * @param port - pointer on the port
+ *
+ */
+static void reap(tcoap_linux_port * const port)
+{
+    struct io_uring_cqe * cqe;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t idx;
+    uint16_t bid;
+
+    head = *port->cq_head;
+    tail = __atomic_load_n(port->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+
+        cqe = (struct io_uring_cqe *)port->cqes + (head & port->cq_mask);
+
+        if (cqe->user_data == TCOAP_URING_SEND) {
+            port->tx_res = cqe->res;
+            port->tx_done = true;
+            continue;
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            port->recv_armed = false;
+        }
+
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+
+            bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+            /* TCP connection was closed by the server */
+            if (cqe->res <= 0) {
+                provide_buffer(port, bid);
+            } else {
+                idx = (port->rx_head + port->rx_cnt) & (TCOAP_LINUX_RX_BATCH - 1);
+
+                port->rx_bid[idx] = bid;
+                port->rx_len[bid] = cqe->res;
+                port->rx_cnt++;
+            }
+        }
+
+        if (cqe->res == 0 && port->handle.transport == TCOAP_TCP) {
+            port->rx_closed = true;
+        } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECONNREFUSED && cqe->res != -EINTR) {
+            port->rx_closed = true;
+        }
+    }
+
+    __atomic_store_n(port->cq_head, head, __ATOMIC_RELEASE);
+
+    /* the receiving is stopped when all buffers are filled, it is rearmed
+     * when some of them are given back */
+    if (!port->recv_armed && !port->rx_closed && port->rx_cnt < TCOAP_LINUX_RX_BATCH) {
+        arm_recv(port);
+    }
+}
+
+
+/**
+ * @brief Deliver filled buffers to the handle until the awaited packet,
+ *        delivered buffers are given back to the kernel
+ *
+ * @param port - pointer on the port
+ *
+ */
+static void deliver(tcoap_linux_port * const port)
+{
+    tcoap_error err;
+    uint16_t bid;
+
+    while (port->rx_cnt && !port->response_ready) {
+
+        bid = port->rx_bid[port->rx_head];
+
+        if (port->handle.transport == TCOAP_TCP) {
+
+            port->rx_offset += tcoap_tcp_framer_feed_frame(&port->framer,
+                    port->rx_buf[bid] + port->rx_offset, port->rx_len[bid] - port->rx_offset, &err);
+
+            if (port->rx_offset < port->rx_len[bid]) {
+                continue;
+            }
+
+            port->rx_offset = 0;
+
+        } else {
+            /* the datagram which has filled the whole buffer is longer than the PDU */
+            tcoap_rx_packet(&port->handle, port->rx_buf[bid], port->rx_len[bid]);
+        }
+
+        port->rx_head = (port->rx_head + 1) & (TCOAP_LINUX_RX_BATCH - 1);
+        port->rx_cnt--;
+
+        provide_buffer(port, bid);
+    }
+
+    if (!port->recv_armed && !port->rx_closed && port->rx_cnt < TCOAP_LINUX_RX_BATCH) {
+        arm_recv(port);
+    }
+}
+
+
+/**
+ * @brief Get monotonic time
+ *
+ * @return time in ms
+ */
+static uint32_t get_time_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)ts.tv_sec * 1000u + (uint32_t)(ts.tv_nsec / 1000000);
+}
+
+#endif /* TCOAP_LINUX_IO_URING */
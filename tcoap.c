@@ -11,12 +11,15 @@
 
 #include "tcoap_udp.h"
 #include "tcoap_tcp.h"
+#include "tcoap_sms.h"
 #include "tcoap_utils.h"
 
 
 
 static tcoap_error init_coap_driver(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd);
 static void deinit_coap_driver(tcoap_handle * handle);
+static void csm_response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
+static void pong_response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
 
 
 
@@ -47,36 +50,256 @@ tcoap_error tcoap_send_coap_request(tcoap_handle * const handle, const tcoap_req
     }
 
     TCOAP_SET_STATUS(handle, TCOAP_SENDING_PACKET);
+    handle->reqd = reqd;
+
+    TCOAP_TRACE(handle, TCOAP_TRACE_REQUEST_START);
+
     err = init_coap_driver(handle, reqd);
 
     if (err == TCOAP_OK) {
 
+        TCOAP_STATS_INC(handle, requests);
+        TCOAP_STATS_SENT(handle);
+
         switch (handle->transport) {
             case TCOAP_UDP:
+#ifdef TCOAP_SMS_ENABLED
+            case TCOAP_SMS:
+                /* the SMS bearer carries messages of CoAP over UDP */
+#endif /* TCOAP_SMS_ENABLED */
                 err = tcoap_send_coap_request_udp(handle, reqd);
                 break;
 
             case TCOAP_TCP:
+            case TCOAP_WS:
+                /* messages over WebSockets differ from TCP ones by the elided length only */
                 err = tcoap_send_coap_request_tcp(handle, reqd);
                 break;
 
-            case TCOAP_SMS:
             default:
-                /* not supported yet */
                 err = TCOAP_PARAM_ERROR;
                 break;
         }
     }
 
+    handle->reqd = NULL;
     deinit_coap_driver(handle);
 
+    TCOAP_RESET_STATUS(handle, TCOAP_RTT_PENDING);
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    /* the server was reached, so the connection is not idle */
+    if (err == TCOAP_OK || err == TCOAP_NRST_ANSWER) {
+        handle->last_activity_ms = tcoap_get_time_ms(handle);
+    }
+#endif /* TCOAP_LIVENESS_ENABLED */
+
     TCOAP_RESET_STATUS(handle, TCOAP_SENDING_PACKET);
+    TCOAP_TRACE(handle, TCOAP_TRACE_REQUEST_END);
+
     tcoap_tx_signal(handle, TCOAP_ROUTINE_PACKET_DID_FINISH);
 
     return err;
 }
 
 
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_start_connection(tcoap_handle * const handle)
+{
+    tcoap_request_descriptor csm = {0};
+    tcoap_option_data opt_max_size;
+    tcoap_option_data opt_bwt;
+    uint8_t max_size[4];
+
+    /* settings of the previous connection are not valid anymore */
+    handle->max_message_size = 0;
+    handle->block_wise_transfer = false;
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    handle->last_activity_ms = tcoap_get_time_ms(handle);
+    handle->pong_pending = false;
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+    if (!TCOAP_RELIABLE_TRANSPORT(handle)) {
+        return TCOAP_OK;
+    }
+
+    opt_max_size.num = TCOAP_CSM_MAX_MESSAGE_SIZE_OPT;
+    opt_max_size.value = max_size;
+    opt_max_size.len = encoding_uint_option(max_size, TCOAP_MAX_PDU_SIZE);
+    opt_max_size.next = &opt_bwt;
+
+    opt_bwt.num = TCOAP_CSM_BLOCK_WISE_TRANSFER_OPT;
+    opt_bwt.value = max_size;
+    opt_bwt.len = 0;
+    opt_bwt.next = NULL;
+
+    csm.type = TCOAP_MESSAGE_NON;
+    csm.code = TCOAP_TCP_SIGNAL_CSM_701;
+    csm.options = &opt_max_size;
+
+    /* the CSM of server is applied by the transport, the callback just makes it awaited */
+    csm.response_callback = csm_response_callback;
+
+    return tcoap_send_coap_request(handle, &csm);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t tcoap_get_max_message_size(const tcoap_handle * const handle)
+{
+    uint32_t size;
+
+    if (!TCOAP_RELIABLE_TRANSPORT(handle)) {
+        return TCOAP_MAX_PDU_SIZE;
+    }
+
+    size = handle->max_message_size ? handle->max_message_size : TCOAP_TCP_DEFAULT_MAX_MESSAGE_SIZE;
+
+    return size < TCOAP_MAX_PDU_SIZE ? size : TCOAP_MAX_PDU_SIZE;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_send_ping(tcoap_handle * const handle)
+{
+    tcoap_error err;
+    tcoap_request_descriptor ping = {0};
+#ifdef TCOAP_LIVENESS_ENABLED
+    uint32_t start_ms;
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+    ping.type = TCOAP_MESSAGE_CON;
+
+    if (TCOAP_RELIABLE_TRANSPORT(handle)) {
+        ping.code = TCOAP_TCP_SIGNAL_PING_702;
+        ping.response_callback = pong_response_callback;
+    } else {
+        /* rfc7252 4.3: "CoAP ping", the empty CON is answered by RST */
+        ping.code = TCOAP_CODE_EMPTY_MSG;
+        ping.response_callback = NULL;
+    }
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    start_ms = tcoap_get_time_ms(handle);
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+    err = tcoap_send_coap_request(handle, &ping);
+
+    if (err == TCOAP_NRST_ANSWER) {
+        err = TCOAP_OK;
+    }
+
+    if (err == TCOAP_OK) {
+
+#ifdef TCOAP_LIVENESS_ENABLED
+        /* an answer on the retransmitted ping may belong to any copy of it (Karn's algorithm) */
+        if (!TCOAP_CHECK_STATUS(handle, TCOAP_RETRANSMITTED)) {
+            handle->rtt_ms = tcoap_get_time_ms(handle) - start_ms;
+        }
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+        tcoap_tx_signal(handle, TCOAP_PONG_DID_RECEIVE);
+    }
+
+    return err;
+}
+
+
+#ifdef TCOAP_LIVENESS_ENABLED
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_keepalive(tcoap_handle * const handle)
+{
+    tcoap_error err;
+    uint32_t idle_ms;
+
+    if (TCOAP_CHECK_STATUS(handle, TCOAP_SENDING_PACKET)) {
+        return TCOAP_BUSY_ERROR;
+    }
+
+    /* answer the Ping of server which was received between exchanges */
+    if (handle->pong_pending) {
+        handle->pong_pending = false;
+
+        err = tcoap_send_pong_tcp(handle, handle->pong_token, handle->pong_tkl);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+    }
+
+    idle_ms = handle->keepalive_idle_ms ? handle->keepalive_idle_ms : TCOAP_KEEPALIVE_IDLE_MS;
+
+    if (tcoap_get_time_ms(handle) - handle->last_activity_ms < idle_ms) {
+        return TCOAP_OK;
+    }
+
+    return tcoap_send_ping(handle);
+}
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+
+#ifdef TCOAP_STATS_ENABLED
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_get_stats(const tcoap_handle * const handle, tcoap_stats * const stats)
+{
+    const volatile uint32_t * src;
+    uint32_t * dst;
+    uint32_t seq;
+    uint32_t i;
+
+    dst = (uint32_t *)stats;
+    src = (const volatile uint32_t *)&handle->stats;
+
+    /* the copy is repeated while an update is in progress or has happened meanwhile */
+    do {
+        seq = handle->stats_seq;
+
+        for (i = 0; i < sizeof(tcoap_stats) / sizeof(uint32_t); ++i) {
+            dst[i] = src[i];
+        }
+
+    } while ((seq & 1) || seq != handle->stats_seq);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_reset_stats(tcoap_handle * const handle)
+{
+    volatile uint32_t * dst;
+    uint32_t i;
+
+    dst = (volatile uint32_t *)&handle->stats;
+
+    handle->stats_seq++;
+
+    for (i = 0; i < sizeof(tcoap_stats) / sizeof(uint32_t); ++i) {
+        dst[i] = 0;
+    }
+
+    handle->stats_seq++;
+}
+#endif /* TCOAP_STATS_ENABLED */
+
+
 /**
  * @brief See description in the header file.
  *
@@ -88,10 +311,13 @@ tcoap_error tcoap_rx_byte(tcoap_handle * const handle, const uint8_t byte)
         if (handle->response.len < TCOAP_MAX_PDU_SIZE) {
             handle->response.buf[handle->response.len++] = byte;
 
+            TCOAP_STATS_RX(handle, 1, handle->response.len);
+
             tcoap_tx_signal(handle, TCOAP_RESPONSE_BYTE_DID_RECEIVE);
             return TCOAP_OK;
         }
 
+        TCOAP_STATS_INC(handle, rx_overflows);
         return TCOAP_RX_BUFF_FULL_ERROR;
     }
 
@@ -105,19 +331,39 @@ tcoap_error tcoap_rx_byte(tcoap_handle * const handle, const uint8_t byte)
  */
 tcoap_error tcoap_rx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
 {
+#ifdef TCOAP_LIVENESS_ENABLED
+    handle->last_activity_ms = tcoap_get_time_ms(handle);
+#endif /* TCOAP_LIVENESS_ENABLED */
+
     if (TCOAP_CHECK_STATUS(handle, TCOAP_WAITING_RESP)) {
 
-        mem_copy(handle->response.buf, buf, len < TCOAP_MAX_PDU_SIZE ? len : TCOAP_MAX_PDU_SIZE);
+#ifdef TCOAP_SMS_ENABLED
+        /* a message may be split into several SMS */
+        if (handle->transport == TCOAP_SMS) {
+            return tcoap_sms_rx_packet(handle, buf, len);
+        }
+#endif /* TCOAP_SMS_ENABLED */
+
+        mem_copy(handle->response.buf, buf, len <= TCOAP_MAX_PDU_SIZE ? len : TCOAP_MAX_PDU_SIZE);
         handle->response.len = len;
 
-        if (len < TCOAP_MAX_PDU_SIZE) {
+        if (len <= TCOAP_MAX_PDU_SIZE) {
+            TCOAP_STATS_RX(handle, len, len);
+
             tcoap_tx_signal(handle, TCOAP_RESPONSE_DID_RECEIVE);
             return TCOAP_OK;
         }
 
+        TCOAP_STATS_INC(handle, rx_overflows);
         return TCOAP_RX_BUFF_FULL_ERROR;
     }
 
+#ifdef TCOAP_LIVENESS_ENABLED
+    if (TCOAP_RELIABLE_TRANSPORT(handle) && tcoap_tcp_catch_ping(handle, buf, len)) {
+        return TCOAP_OK;
+    }
+#endif /* TCOAP_LIVENESS_ENABLED */
+
     return TCOAP_WRONG_STATE_ERROR;
 }
 
@@ -138,21 +384,32 @@ static tcoap_error init_coap_driver(tcoap_handle * const handle, const tcoap_req
     handle->request.len = 0;
     handle->response.len = 0;
 
+    TCOAP_RESET_STATUS(handle, TCOAP_RETRANSMITTED);
+
     if (reqd->code == TCOAP_CODE_EMPTY_MSG && reqd->tkl) {
         return TCOAP_PARAM_ERROR;
     }
 
+    if (reqd->payload_writer != NULL && reqd->payload_producer != NULL) {
+        return TCOAP_PARAM_ERROR;
+    }
+
     if (handle->request.buf == NULL) {
-        err = tcoap_alloc_mem_block(&handle->request.buf, TCOAP_MAX_PDU_SIZE);
+        handle->tx_block_len = TCOAP_TX_BLOCK_LEN(handle);
+        err = TCOAP_ALLOC_BLOCK(handle, &handle->tx_block, handle->tx_block_len);
 
         if (err != TCOAP_OK) {
+            handle->tx_block = NULL;
             return err;
         }
+
+        /* the packet is assembled after the headroom of lower layers, options of response are decoded there */
+        handle->request.buf = handle->tx_block + TCOAP_ALIGN_UP((uint32_t)handle->headroom);
     }
 
     if (reqd->type == TCOAP_MESSAGE_CON || reqd->response_callback != NULL) {
         if (handle->response.buf == NULL) {
-            err = tcoap_alloc_mem_block(&handle->response.buf, TCOAP_MAX_PDU_SIZE);
+            err = TCOAP_ALLOC_BLOCK(handle, &handle->response.buf, TCOAP_MAX_PDU_SIZE);
         }
     }
 
@@ -169,12 +426,16 @@ static tcoap_error init_coap_driver(tcoap_handle * const handle, const tcoap_req
 static void deinit_coap_driver(tcoap_handle * handle)
 {
     if (handle->response.buf != NULL) {
-        tcoap_free_mem_block(handle->response.buf, TCOAP_MAX_PDU_SIZE);
+        (void)TCOAP_FREE_BLOCK(handle, handle->response.buf, TCOAP_MAX_PDU_SIZE);
         handle->response.buf = NULL;
     }
 
     if (handle->request.buf != NULL) {
-        tcoap_free_mem_block(handle->request.buf, TCOAP_MAX_PDU_SIZE);
+        /* the driver may still read the tx buffer */
+        (void)TCOAP_TX_DRAIN(handle);
+
+        (void)TCOAP_FREE_BLOCK(handle, handle->tx_block, handle->tx_block_len);
+        handle->tx_block = NULL;
         handle->request.buf = NULL;
     }
 
@@ -183,3 +444,33 @@ static void deinit_coap_driver(tcoap_handle * handle)
 }
 
 
+/**
+ * @brief Callback for the response on CSM
+ *
+ * @param reqd - pointer on the request data
+ * @param result - pointer on result data
+ *
+ */
+static void csm_response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    (void)reqd;
+    (void)result;
+
+    /* nothing to do, the CSM of server was already applied to the handle */
+}
+
+
+/**
+ * @brief Callback for the Pong
+ *
+ * @param reqd - pointer on the request data
+ * @param result - pointer on result data
+ *
+ */
+static void pong_response_callback(const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result)
+{
+    (void)reqd;
+    (void)result;
+
+    /* nothing to do, the Pong is reported by 'tcoap_send_ping' */
+}
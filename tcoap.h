@@ -63,10 +63,49 @@ extern "C" {
 #define TCOAP_ACK_RANDOM_FACTOR         130       /* 1.3 -> 130 to rid from float */
 #endif /* TCOAP_ACK_RANDOM_FACTOR */
 
+#ifndef TCOAP_SMS_RESP_TIMEOUT_MS
+#define TCOAP_SMS_RESP_TIMEOUT_MS       180000    /* delivery of SMS may take minutes */
+#endif /* TCOAP_SMS_RESP_TIMEOUT_MS */
+
+#ifndef TCOAP_SMS_ACK_TIMEOUT_MS
+#define TCOAP_SMS_ACK_TIMEOUT_MS        60000
+#endif /* TCOAP_SMS_ACK_TIMEOUT_MS */
+
+#ifndef TCOAP_SMS_MAX_RETRANSMIT
+#define TCOAP_SMS_MAX_RETRANSMIT        2         /* each retransmission costs one or more SMS */
+#endif /* TCOAP_SMS_MAX_RETRANSMIT */
+
 #ifndef TCOAP_MAX_PDU_SIZE
 #define TCOAP_MAX_PDU_SIZE              96        /* maximum size of a CoAP PDU */
 #endif /* TCOAP_MAX_PDU_SIZE */
 
+#define TCOAP_TCP_DEFAULT_MAX_MESSAGE_SIZE  1152  /* rfc8323, 5.3.1 */
+
+#define TCOAP_MAX_TOKEN_LEN             8
+
+/* options of response are decoded into the tx buffer, so the packet is aligned as a pointer */
+#ifndef TCOAP_BUF_ALIGN
+#define TCOAP_BUF_ALIGN                 sizeof(void *)     /* a power of two */
+#endif /* TCOAP_BUF_ALIGN */
+
+#define TCOAP_ALIGN_UP(n)               (((n) + TCOAP_BUF_ALIGN - 1) & ~(TCOAP_BUF_ALIGN - 1))
+
+#ifdef TCOAP_LIVENESS_ENABLED
+#ifndef TCOAP_KEEPALIVE_IDLE_MS
+#define TCOAP_KEEPALIVE_IDLE_MS         30000     /* idle interval of connection before keepalive ping */
+#endif /* TCOAP_KEEPALIVE_IDLE_MS */
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+#ifdef TCOAP_STATS_ENABLED
+#ifndef TCOAP_STATS_RTT_BUCKETS
+#define TCOAP_STATS_RTT_BUCKETS         8         /* buckets of RTT histogram */
+#endif /* TCOAP_STATS_RTT_BUCKETS */
+
+#ifndef TCOAP_STATS_RTT_MIN_MS
+#define TCOAP_STATS_RTT_MIN_MS          16        /* upper bound of the first bucket, bound of each next one is doubled */
+#endif /* TCOAP_STATS_RTT_MIN_MS */
+#endif /* TCOAP_STATS_ENABLED */
+
 
 
 typedef enum {
@@ -85,7 +124,9 @@ typedef enum {
     TCOAP_WRONG_STATE_ERROR,
 
     TCOAP_NO_OPTIONS_ERROR,
-    TCOAP_WRONG_OPTIONS_ERROR
+    TCOAP_WRONG_OPTIONS_ERROR,
+
+    TCOAP_WRONG_PAYLOAD_ERROR
 
 } tcoap_error;
 
@@ -104,16 +145,43 @@ typedef enum {
 
     TCOAP_RESPONSE_BYTE_DID_RECEIVE,
     TCOAP_RESPONSE_TO_LONG_ERROR,
-    TCOAP_RESPONSE_DID_RECEIVE
+    TCOAP_RESPONSE_DID_RECEIVE,
+
+    TCOAP_PING_DID_RECEIVE,          /* Ping of server was answered by Pong (TCP) */
+    TCOAP_PONG_DID_RECEIVE,          /* our ping was answered, 'rtt_ms' of handle is updated if liveness is enabled */
+    TCOAP_CLOSE_DID_RECEIVE          /* Close of server was answered (WebSocket), the connection should be closed */
 
 } tcoap_out_signal;
 
 
+#ifdef TCOAP_TRACE_ENABLED
+/**
+ * Phase boundaries of an exchange which are reported to 'tcoap_trace'.
+ * Phases which are not passed (e.g. no ACK for NON) are not reported.
+ *
+ */
+typedef enum {
+
+    TCOAP_TRACE_REQUEST_START = 0,   /* 'tcoap_send_coap_request' is called */
+    TCOAP_TRACE_ASSEMBLED,           /* the tx buffer is allocated and the request is assembled */
+    TCOAP_TRACE_SENT,                /* the request is passed to 'tcoap_tx_data' */
+    TCOAP_TRACE_RETRANSMITTED,       /* the request is retransmitted (UDP) */
+    TCOAP_TRACE_ACK_RECEIVED,        /* ACK (or piggybacked response) is received (UDP) */
+    TCOAP_TRACE_RESPONSE_RECEIVED,   /* the response is received and checked */
+    TCOAP_TRACE_OPTIONS_DECODED,     /* options of response are decoded */
+    TCOAP_TRACE_CALLBACK_DONE,       /* 'response_callback' is returned */
+    TCOAP_TRACE_REQUEST_END          /* 'tcoap_send_coap_request' returns (with any status) */
+
+} tcoap_trace_point;
+#endif /* TCOAP_TRACE_ENABLED */
+
+
 typedef enum {
 
     TCOAP_UDP = 0,
     TCOAP_TCP,
-    TCOAP_SMS
+    TCOAP_SMS,
+    TCOAP_WS                 /* CoAP over WebSockets, see 'tcoap_ws.h' */
 
 } tcoap_transport;
 
@@ -216,6 +284,23 @@ typedef enum {
 } tcoap_option;
 
 
+/**
+ * Options of signaling messages (CoAP over TCP), rfc8323 (5).
+ * Numbers of these options are specific for the code of signal.
+ *
+ */
+typedef enum {
+
+    TCOAP_CSM_MAX_MESSAGE_SIZE_OPT         = 2,   /* 7.01 CSM */
+    TCOAP_CSM_BLOCK_WISE_TRANSFER_OPT      = 4,   /* 7.01 CSM */
+    TCOAP_PING_CUSTODY_OPT                 = 2,   /* 7.02 Ping, 7.03 Pong */
+    TCOAP_RELEASE_ALTERNATIVE_ADDRESS_OPT  = 2,   /* 7.04 Release */
+    TCOAP_RELEASE_HOLD_OFF_OPT             = 4,   /* 7.04 Release */
+    TCOAP_ABORT_BAD_CSM_OPT                = 2    /* 7.05 Abort */
+
+} tcoap_signal_option;
+
+
 typedef enum {
 
     TCOAP_TEXT_PLAIN = 0,   /* default value */
@@ -273,6 +358,79 @@ typedef struct tcoap_result_data {
 } tcoap_result_data;
 
 
+/**
+ * Precompiled part of request: encoded options and, optionally, the payload
+ * marker with a fixed payload prefix. See 'tcoap_compile_request_template'.
+ *
+ */
+typedef struct tcoap_request_template {
+
+    tcoap_data body;
+    bool payload_marker;           /* true if 'body' is ended by the payload marker and prefix */
+
+} tcoap_request_template;
+
+
+/**
+ * Reasons why a received packet is not accepted as the answer to request
+ *
+ */
+typedef enum {
+
+    TCOAP_REJECT_SHORT = 0,        /* shorter than the header or than the lengths in it */
+    TCOAP_REJECT_VERSION,
+    TCOAP_REJECT_TYPE,
+    TCOAP_REJECT_EMPTY,            /* Empty ACK or RST carries a token or data */
+    TCOAP_REJECT_MID,              /* message ID does not match the request */
+    TCOAP_REJECT_TKL,
+    TCOAP_REJECT_TOKEN,
+    TCOAP_REJECT_CODE,             /* not a response code */
+    TCOAP_REJECT_OPTIONS,          /* options are malformed */
+
+    TCOAP_REJECT_REASONS
+
+} tcoap_reject_reason;
+
+
+#ifdef TCOAP_STATS_ENABLED
+/**
+ * Statistics of handle. The bucket 'i' of RTT histogram counts answers which
+ * were received earlier than 'TCOAP_STATS_RTT_MIN_MS << i' ms after sending,
+ * the last bucket counts the rest. RTT of retransmitted requests is ambiguous,
+ * so it is not counted. Bytes are counted for CoAP messages without framing
+ * of lower layers (e.g. WebSocket, SMS).
+ *
+ */
+typedef struct tcoap_stats {
+
+    uint32_t requests;             /* started exchanges */
+    uint32_t retransmissions;
+    uint32_t ack_timeouts;         /* CON was not acknowledged after all retransmissions */
+    uint32_t resp_timeouts;        /* response was not received */
+    uint32_t rsts;
+    uint32_t invalid_packets;      /* received packets which are not the awaited answer */
+    uint32_t rx_overflows;         /* received packets which did not fit into the rx buffer */
+    uint32_t rejects[TCOAP_REJECT_REASONS];   /* invalid packets and malformed options by reason */
+
+    uint32_t bytes_out;
+    uint32_t bytes_in;
+
+    uint32_t peak_tx_len;          /* the longest sent message (use of the tx buffer) */
+    uint32_t peak_rx_len;          /* the longest received message (use of the rx buffer) */
+
+    uint32_t rtt[TCOAP_STATS_RTT_BUCKETS];
+
+} tcoap_stats;
+#endif /* TCOAP_STATS_ENABLED */
+
+
+/**
+ * Descriptor of request. It should be zero-initialized before its fields are
+ * set (e.g. 'tcoap_request_descriptor reqd = {0};' or 'memset'): new optional
+ * fields are added to it from time to time and the lib uses them whenever
+ * they are not NULL.
+ *
+ */
 typedef struct tcoap_request_descriptor {
 
     uint8_t type;
@@ -282,6 +440,38 @@ typedef struct tcoap_request_descriptor {
     tcoap_data payload;            /* should not be NULL */
     tcoap_option_data * options;   /* should be NULL if there are no options */
 
+    const tcoap_request_template * tpl;   /* should be NULL if the request is not precompiled, overrides 'options' */
+
+    /**
+     * @brief Callback for writing payload directly into the packet (e.g. through
+     *        the 'tcoap_cbor_writer'), so payload is not copied. Should be NULL
+     *        if it is not used, otherwise 'payload' is ignored.
+     *
+     * @param reqd - pointer on the request data (struct 'tcoap_request_descriptor')
+     * @param buf - pointer on the payload area of packet (after the payload marker)
+     * @param max_len - free space in the packet
+     *
+     * @return length of written payload
+     */
+    uint32_t (* payload_writer) (const struct tcoap_request_descriptor * const reqd, uint8_t * const buf, const uint32_t max_len);
+
+    /**
+     * @brief Callback for pulling of payload while it is being sent, so a large
+     *        payload is not staged in memory (CoAP over TCP only). Should be NULL
+     *        if it is not used, otherwise 'payload.len' is the total length of
+     *        payload and 'payload.buf' is ignored. It may not be used together
+     *        with the 'payload_writer'.
+     *
+     * @param reqd - pointer on the request data (struct 'tcoap_request_descriptor')
+     * @param buf - pointer on buffer for the next part of payload
+     * @param offset - offset of the part in the payload
+     * @param max_len - length of buffer (it is not greater than the rest of payload)
+     *
+     * @return length of written part, 0 aborts the sending (the connection
+     *         should be closed, since the frame is not complete)
+     */
+    uint32_t (* payload_producer) (const struct tcoap_request_descriptor * const reqd, uint8_t * const buf, const uint32_t offset, const uint32_t max_len);
+
     /**
      * @brief Callback with results of request
      *
@@ -290,6 +480,20 @@ typedef struct tcoap_request_descriptor {
      */
     void (* response_callback) (const struct tcoap_request_descriptor * const reqd, const struct tcoap_result_data * const result);
 
+    /**
+     * @brief Callback for streaming of payload of response which does not fit
+     *        into the rx buffer (CoAP over TCP, see 'tcoap_tcp_framer'). Should be
+     *        NULL if it is not used. The payload is delivered by chunks as they
+     *        are received (from the context of 'tcoap_tcp_framer_feed'), then the
+     *        'response_callback' is called with the code and options of response
+     *        and with the empty payload.
+     *
+     * @param reqd - pointer on the request data (struct 'tcoap_request_descriptor')
+     * @param chunk - pointer on the next part of payload
+     * @param offset - offset of the chunk in the payload
+     */
+    void (* payload_chunk_callback) (const struct tcoap_request_descriptor * const reqd, const tcoap_data * const chunk, const uint32_t offset);
+
 } tcoap_request_descriptor;
 
 
@@ -303,12 +507,70 @@ typedef struct tcoap_handle {
     tcoap_data request;
     tcoap_data response;
 
+    /* the request starts at 'TCOAP_ALIGN_UP(headroom)' in the tx buffer, so there may be more
+     * free space before it than it was asked (e.g. 16 bytes for the 13 bytes of DTLS record)
+     */
+    uint16_t headroom;             /* free space before the request in the tx buffer for lower layers (e.g. DTLS, SLIP) */
+    uint16_t tailroom;             /* free space after 'request.buf + TCOAP_MAX_PDU_SIZE' for lower layers (e.g. MAC, CRC) */
+
+    uint8_t * tx_block;            /* the tx buffer as it was allocated, so the room may be changed meanwhile */
+    uint32_t tx_block_len;
+
+    const tcoap_request_descriptor * reqd;   /* request which is being processed, NULL if there is no one */
+
+#ifdef TCOAP_SMS_ENABLED
+    uint16_t sms_ref;              /* reference number of the concatenated SMS which is being received */
+    uint16_t sms_segments;         /* mask of its received segments */
+    uint8_t sms_total;             /* number of its segments, not more than 'TCOAP_SMS_MAX_SEGMENTS' */
+    uint32_t sms_len;              /* length of its received segments */
+#endif /* TCOAP_SMS_ENABLED */
+
+    uint32_t max_message_size;     /* Max-Message-Size of peer (TCP, WebSockets), 0 until the CSM of peer is received */
+    bool block_wise_transfer;      /* peer supports Block-wise transfer (TCP, WebSockets) */
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    uint32_t keepalive_idle_ms;    /* idle interval before keepalive ping, 0 - use 'TCOAP_KEEPALIVE_IDLE_MS' */
+    uint32_t last_activity_ms;     /* time of the last exchange with the server */
+    uint32_t rtt_ms;               /* RTT of the last answered ping */
+
+    volatile bool pong_pending;    /* Ping of server was received between exchanges (TCP, WebSockets) */
+    uint8_t pong_tkl;
+    uint8_t pong_token[TCOAP_MAX_TOKEN_LEN];
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+#ifdef TCOAP_STATS_ENABLED
+    volatile uint32_t stats_seq;   /* odd while the statistics are being updated */
+    uint32_t stats_sent_ms;        /* time of sending of the current request */
+    tcoap_stats stats;             /* read it by 'tcoap_get_stats' */
+#endif /* TCOAP_STATS_ENABLED */
+
+#ifdef TCOAP_CAPTURE_ENABLED
+    struct tcoap_capture * capture;   /* ring for capture of messages, NULL if it is stopped (see 'tcoap_capture.h') */
+#endif /* TCOAP_CAPTURE_ENABLED */
+
+#ifdef TCOAP_TX_QUEUE_ENABLED
+    struct tcoap_tx_queue * tx_queue; /* asynchronous transmission, NULL - by 'tcoap_tx_data' (see 'tcoap_tx_queue.h') */
+#endif /* TCOAP_TX_QUEUE_ENABLED */
+
+#ifdef TCOAP_POOL_ENABLED
+    struct tcoap_pool * pool;      /* blocks for buffers, NULL - by 'tcoap_alloc_mem_block' (see 'tcoap_pool.h') */
+    uint32_t pool_quota;           /* the most blocks which the handle may hold, 0 - no limit */
+    uint32_t pool_used;            /* blocks which the handle holds */
+#endif /* TCOAP_POOL_ENABLED */
+
 } tcoap_handle;
 
 
 /**
  * @brief In this function user should implement a transmission given data via 
  *        hardware interface (e.g. serial port)
+ *
+ *        If 'buf' is the 'request.buf' of handle, there are at least 'headroom'
+ *        bytes before it and 'tailroom' bytes after 'request.buf + TCOAP_MAX_PDU_SIZE',
+ *        so lower layers may add their headers and trailers in place without
+ *        copying. A trailer at 'buf + len' has 'TCOAP_MAX_PDU_SIZE' - 'len' +
+ *        'tailroom' bytes. The packet itself should be kept intact: it is retransmitted
+ *        and it is used for checking of response.
  * 
  */
 extern tcoap_error tcoap_tx_data(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
@@ -329,6 +591,47 @@ extern tcoap_error tcoap_wait_event(tcoap_handle * const handle, const uint32_t
 extern tcoap_error tcoap_tx_signal(tcoap_handle * const handle, const tcoap_out_signal signal);
 
 
+#ifdef TCOAP_TRACE_ENABLED
+/**
+ * @brief Through this function the 'tcoap' lib reports phase boundaries of
+ *        the exchange (see 'tcoap_trace_point'), so the user may take a
+ *        timestamp (e.g. a cycle counter) and find where the time goes.
+ *        It is called from the context of 'tcoap_send_coap_request', so it
+ *        should be short. It is needed only if 'TCOAP_TRACE_ENABLED' is defined.
+ *
+ */
+extern void tcoap_trace(tcoap_handle * const handle, const tcoap_trace_point point);
+#endif /* TCOAP_TRACE_ENABLED */
+
+
+#ifdef TCOAP_TX_QUEUE_ENABLED
+struct tcoap_tx_desc;
+
+/**
+ * @brief In this function user should implement a start of transmission of
+ *        the descriptor (e.g. setup of DMA channel) and return at once. The
+ *        end of transmission is reported by 'tcoap_tx_queue_complete'.
+ *        It is called instead of 'tcoap_tx_data' if 'tx_queue' of handle is
+ *        set, from the context of 'tcoap_send_coap_request' or of the driver
+ *        (by 'tcoap_tx_queue_complete'). It is needed only if
+ *        'TCOAP_TX_QUEUE_ENABLED' is defined.
+ *
+ */
+extern tcoap_error tcoap_tx_start(tcoap_handle * const handle, const struct tcoap_tx_desc * const desc);
+
+
+/**
+ * @brief In this function user should implement a waiting of the end of any
+ *        transmission (e.g. on the semaphore which is given by the interrupt
+ *        after 'tcoap_tx_queue_complete'). If it returns an error, the driver
+ *        should be stopped: all queued descriptors are forgotten.
+ *        It is needed only if 'TCOAP_TX_QUEUE_ENABLED' is defined.
+ *
+ */
+extern tcoap_error tcoap_wait_tx(tcoap_handle * const handle);
+#endif /* TCOAP_TX_QUEUE_ENABLED */
+
+
 /**
  * @brief In this function user should implement a generating of message id.
  * 
@@ -343,6 +646,18 @@ extern uint16_t tcoap_get_message_id(tcoap_handle * const handle);
 extern tcoap_error tcoap_fill_token(tcoap_handle * const handle, uint8_t * token, const uint32_t tkl);
 
 
+#if defined(TCOAP_LIVENESS_ENABLED) || defined(TCOAP_STATS_ENABLED) || defined(TCOAP_CAPTURE_ENABLED)
+/**
+ * @brief In this function user should implement a getting of monotonic time
+ *        in milliseconds (e.g. a tick counter). Overflow of counter is allowed.
+ *        It is needed only if 'TCOAP_LIVENESS_ENABLED', 'TCOAP_STATS_ENABLED'
+ *        or 'TCOAP_CAPTURE_ENABLED' is defined.
+ *
+ */
+extern uint32_t tcoap_get_time_ms(tcoap_handle * const handle);
+#endif /* TCOAP_LIVENESS_ENABLED || TCOAP_STATS_ENABLED || TCOAP_CAPTURE_ENABLED */
+
+
 /**
  * @brief These functions are using for debug purpose, if user will enable debug mode.
  * 
@@ -356,7 +671,13 @@ extern void tcoap_debug_print_payload(tcoap_handle * const handle, const char *
  * @brief In this function user should implement an allocating block of memory.
  *        In simple case it may be a static buffer. The 'TCOAP' will make
  *        two calls of this function before starting work (for rx and tx buffers).
- *        So, you should have minimum two separate blocks of memory.
+ *        So, you should have minimum two separate blocks of memory. The tx block
+ *        is longer than 'TCOAP_MAX_PDU_SIZE' by 'headroom' (rounded up by
+ *        'TCOAP_ALIGN_UP') + 'tailroom' of handle. Blocks should be aligned
+ *        as a pointer ('TCOAP_BUF_ALIGN').
+ *        With 'TCOAP_POOL_ENABLED' it may take blocks from 'tcoap_pool', then
+ *        handles and exchanges may share it. It is not called for handles
+ *        which have own 'pool'.
  * 
  */
 extern tcoap_error tcoap_alloc_mem_block(uint8_t ** block, const uint32_t min_len);
@@ -403,11 +724,99 @@ void tcoap_debug(tcoap_handle * const handle, const bool enable);
 tcoap_error tcoap_send_coap_request(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd);
 
 
+/**
+ * @brief Start a new connection with the server. For CoAP over TCP and
+ *        WebSockets it sends the CSM (Capabilities and Settings Message) and
+ *        waits for the CSM of server, so the negotiated limits (see
+ *        'tcoap_get_max_message_size') become known. A CSM of server which
+ *        arrives later is applied as well.
+ *        It should be called each time when the connection is established.
+ *
+ * @param handle - coap handle
+ *
+ * @return status of operation
+ *
+ */
+tcoap_error tcoap_start_connection(tcoap_handle * const handle);
+
+
+/**
+ * @brief Get maximum size of message which may be sent to the server.
+ *        It is limited by the 'TCOAP_MAX_PDU_SIZE' and by the Max-Message-Size
+ *        of server for CoAP over TCP and WebSockets.
+ *
+ * @param handle - coap handle
+ *
+ * @return maximum size of message
+ *
+ */
+uint32_t tcoap_get_max_message_size(const tcoap_handle * const handle);
+
+
+/**
+ * @brief Check that the server is alive. For CoAP over TCP it sends the Ping
+ *        signal and waits for the Pong, for CoAP over UDP it sends the "CoAP ping"
+ *        (an empty CON message which is answered by RST). The answer is
+ *        reported through the 'TCOAP_PONG_DID_RECEIVE' signal.
+ *
+ * @param handle - coap handle
+ *
+ * @return status of operation ('TCOAP_OK' if the server did answer)
+ *
+ */
+tcoap_error tcoap_send_ping(tcoap_handle * const handle);
+
+
+#ifdef TCOAP_LIVENESS_ENABLED
+/**
+ * @brief Keep the connection alive (e.g. NAT binding). It should be called
+ *        periodically while there is no other exchange. The ping is sent only
+ *        if the connection was idle longer than 'keepalive_idle_ms' of handle,
+ *        so every exchange with the server postpones it. Also the Ping of server
+ *        which was received between exchanges is answered here.
+ *        RTT of every answered ping is stored into 'rtt_ms' of handle.
+ *
+ * @param handle - coap handle
+ *
+ * @return status of operation
+ *
+ */
+tcoap_error tcoap_keepalive(tcoap_handle * const handle);
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+
+#ifdef TCOAP_STATS_ENABLED
+/**
+ * @brief Get statistics of handle. The copy is consistent: it is repeated if
+ *        the statistics were updated meanwhile (e.g. by 'tcoap_rx_packet' from
+ *        an interrupt or another thread).
+ *
+ * @param handle - coap handle
+ * @param stats - pointer on struct for the copy
+ *
+ */
+void tcoap_get_stats(const tcoap_handle * const handle, tcoap_stats * const stats);
+
+
+/**
+ * @brief Reset statistics of handle
+ *
+ * @param handle - coap handle
+ *
+ */
+void tcoap_reset_stats(tcoap_handle * const handle);
+#endif /* TCOAP_STATS_ENABLED */
+
+
 /**
  * @brief Receive a packet step-by-step (sequence of bytes).
  *        You may to use it if you communicate with server over serial port
  *        or you haven't a free mem for cumulative buffer. Detecting of the
  *        end of packet is a user responsibility (through byte-timeout).
+ *        For CoAP over TCP the end of packet may be detected by the framer
+ *        instead, see 'tcoap_tcp_framer' in the 'tcoap_tcp.h'.
+ *        It signals every byte and drops bytes out of exchange, an interrupt
+ *        may use the 'tcoap_rx_ring' ('tcoap_rx_ring.h') instead.
  *
  * @param handle - coap handle
  * @param byte - received byte
@@ -419,7 +828,9 @@ tcoap_error tcoap_rx_byte(tcoap_handle * const handle, const uint8_t byte);
 
 
 /**
- * @brief Receive whole packet
+ * @brief Receive whole packet. For the SMS bearer ('TCOAP_SMS_ENABLED') it
+ *        is the User Data of received SMS (with the User Data Header, if any),
+ *        segments of concatenated SMS are reassembled.
  *
  * @param handle - coap handle
  * @param buf - pointer on buffer with data
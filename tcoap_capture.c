@@ -0,0 +1,304 @@
+/**
+ * tcoap_capture.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_capture.h"
+#include "tcoap_utils.h"
+
+
+#ifdef TCOAP_CAPTURE_ENABLED
+
+
+#define TCOAP_CAPTURE_PCAP_MAGIC        0xa1b2c3d4    /* it is written in the host order, readers detect it */
+#define TCOAP_CAPTURE_LINKTYPE_IPV4     228
+#define TCOAP_CAPTURE_SNAPLEN           65535
+
+#define TCOAP_CAPTURE_PROTO_TCP         6
+#define TCOAP_CAPTURE_PROTO_UDP         17
+
+#define TCOAP_CAPTURE_CLIENT_PORT       49152
+#define TCOAP_CAPTURE_SERVER_PORT       5683
+
+
+/* addresses of the client and server (TEST-NET-1, rfc5737) */
+static const uint8_t client_addr[4] = { 192, 0, 2, 1 };
+static const uint8_t server_addr[4] = { 192, 0, 2, 2 };
+
+
+static void put_u16(uint8_t * const buf, const uint16_t value);
+static void put_u32(uint8_t * const buf, const uint32_t value);
+static uint32_t record_len(const tcoap_capture * const capture, const uint32_t offset);
+static uint8_t * reserve(tcoap_capture * const capture, const uint32_t len);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_capture_init(tcoap_capture * const capture, uint8_t * const buf, const uint32_t size)
+{
+    capture->buf = buf;
+    capture->size = size;
+
+    capture->head = 0;
+    capture->tail = 0;
+    capture->end = 0;
+    capture->wrapped = false;
+
+    capture->count = 0;
+    capture->overwritten = 0;
+
+    capture->tcp_seq[TCOAP_CAPTURE_TX] = 1;
+    capture->tcp_seq[TCOAP_CAPTURE_RX] = 1;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_capture_packet(tcoap_handle * const handle, const tcoap_capture_direction dir, const uint8_t * buf, const uint32_t len)
+{
+    tcoap_capture_prefixed(handle, dir, NULL, 0, buf, len);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_capture_prefixed(tcoap_handle * const handle, const tcoap_capture_direction dir, const uint8_t * prefix, const uint32_t prefix_len, const uint8_t * buf, const uint32_t data_len)
+{
+    tcoap_capture * const capture = handle->capture;
+
+    uint8_t * rec;
+    uint8_t * ip;
+    uint8_t * l4;
+    uint32_t rec_header[4];
+    uint32_t l4_len;
+    uint32_t time_ms;
+    uint32_t len;
+    bool tcp;
+
+    len = prefix_len + data_len;
+    tcp = TCOAP_RELIABLE_TRANSPORT(handle);
+    l4_len = tcp ? TCOAP_CAPTURE_TCP_HEADER_LEN : TCOAP_CAPTURE_UDP_HEADER_LEN;
+
+    rec = reserve(capture, TCOAP_CAPTURE_RECORD_HEADER_LEN + TCOAP_CAPTURE_IPV4_HEADER_LEN + l4_len + len);
+
+    if (rec == NULL) {
+        return;
+    }
+
+    /* record header (host order) */
+    time_ms = tcoap_get_time_ms(handle);
+
+    rec_header[0] = time_ms / 1000;
+    rec_header[1] = (time_ms % 1000) * 1000;
+    rec_header[2] = TCOAP_CAPTURE_IPV4_HEADER_LEN + l4_len + len;
+    rec_header[3] = rec_header[2];
+
+    mem_copy(rec, rec_header, TCOAP_CAPTURE_RECORD_HEADER_LEN);
+
+    /* IPv4 header (network order), the checksum is not calculated */
+    ip = rec + TCOAP_CAPTURE_RECORD_HEADER_LEN;
+
+    ip[0] = 0x45;
+    ip[1] = 0;
+    ip[2] = (uint8_t)((TCOAP_CAPTURE_IPV4_HEADER_LEN + l4_len + len) >> 8);
+    ip[3] = (uint8_t)(TCOAP_CAPTURE_IPV4_HEADER_LEN + l4_len + len);
+    ip[4] = 0;
+    ip[5] = 0;
+    ip[6] = 0x40;      /* don't fragment */
+    ip[7] = 0;
+    ip[8] = 64;
+    ip[9] = tcp ? TCOAP_CAPTURE_PROTO_TCP : TCOAP_CAPTURE_PROTO_UDP;
+    ip[10] = 0;
+    ip[11] = 0;
+    mem_copy(ip + 12, dir == TCOAP_CAPTURE_TX ? client_addr : server_addr, 4);
+    mem_copy(ip + 16, dir == TCOAP_CAPTURE_TX ? server_addr : client_addr, 4);
+
+    /* UDP or TCP header, checksums are not calculated */
+    l4 = ip + TCOAP_CAPTURE_IPV4_HEADER_LEN;
+
+    put_u16(l4, dir == TCOAP_CAPTURE_TX ? TCOAP_CAPTURE_CLIENT_PORT : TCOAP_CAPTURE_SERVER_PORT);
+    put_u16(l4 + 2, dir == TCOAP_CAPTURE_TX ? TCOAP_CAPTURE_SERVER_PORT : TCOAP_CAPTURE_CLIENT_PORT);
+
+    if (tcp) {
+        /* sequence numbers are continuous, so the stream is reassembled */
+        put_u32(l4 + 4, capture->tcp_seq[dir]);
+        put_u32(l4 + 8, capture->tcp_seq[dir == TCOAP_CAPTURE_TX ? TCOAP_CAPTURE_RX : TCOAP_CAPTURE_TX]);
+        l4[12] = (TCOAP_CAPTURE_TCP_HEADER_LEN / 4) << 4;
+        l4[13] = 0x18;     /* PSH, ACK */
+        put_u16(l4 + 14, 0xffff);
+        put_u32(l4 + 16, 0);
+
+        capture->tcp_seq[dir] += len;
+    } else {
+        put_u16(l4 + 4, (uint16_t)(TCOAP_CAPTURE_UDP_HEADER_LEN + len));
+        put_u16(l4 + 6, 0);
+    }
+
+    if (prefix_len) {
+        mem_copy(l4 + l4_len, prefix, prefix_len);
+    }
+
+    mem_copy(l4 + l4_len + prefix_len, buf, data_len);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t tcoap_capture_dump(const tcoap_capture * const capture, tcoap_capture_writer writer, void * ctx)
+{
+    uint8_t header[TCOAP_CAPTURE_FILE_HEADER_LEN];
+    uint32_t value;
+    uint16_t version[2];
+    uint32_t len;
+
+    /* the global header is in the host order like records */
+    value = TCOAP_CAPTURE_PCAP_MAGIC;
+    mem_copy(header, &value, 4);
+
+    version[0] = 2;
+    version[1] = 4;
+    mem_copy(header + 4, version, 4);
+
+    value = 0;
+    mem_copy(header + 8, &value, 4);      /* thiszone */
+    mem_copy(header + 12, &value, 4);     /* sigfigs */
+
+    value = TCOAP_CAPTURE_SNAPLEN;
+    mem_copy(header + 16, &value, 4);
+
+    value = TCOAP_CAPTURE_LINKTYPE_IPV4;
+    mem_copy(header + 20, &value, 4);
+
+    writer(ctx, header, sizeof(header));
+    len = sizeof(header);
+
+    if (!capture->count) {
+        return len;
+    }
+
+    if (capture->wrapped) {
+        writer(ctx, capture->buf + capture->tail, capture->end - capture->tail);
+        len += capture->end - capture->tail;
+
+        if (capture->head) {
+            writer(ctx, capture->buf, capture->head);
+            len += capture->head;
+        }
+    } else {
+        writer(ctx, capture->buf + capture->tail, capture->head - capture->tail);
+        len += capture->head - capture->tail;
+    }
+
+    return len;
+}
+
+
+
+/**
+ * @brief Reserve space for a record, the oldest records are overwritten
+ *
+ * @param capture - pointer on the ring
+ * @param len - length of record
+ *
+ * @return pointer on the space, NULL if the record is longer than the ring
+ */
+static uint8_t * reserve(tcoap_capture * const capture, const uint32_t len)
+{
+    uint8_t * rec;
+
+    if (len > capture->size) {
+        return NULL;
+    }
+
+    for (;;) {
+
+        if (!capture->wrapped) {
+
+            if (capture->head + len <= capture->size) {
+                break;
+            }
+
+            if (!capture->count) {
+                capture->head = 0;
+                capture->tail = 0;
+                break;
+            }
+
+            /* wrap at the end of the last record */
+            capture->end = capture->head;
+            capture->head = 0;
+            capture->wrapped = true;
+        }
+
+        if (capture->head + len <= capture->tail) {
+            break;
+        }
+
+        /* overwrite the oldest record */
+        capture->tail += record_len(capture, capture->tail);
+        capture->count--;
+        capture->overwritten++;
+
+        if (capture->tail == capture->end) {
+            capture->tail = 0;
+            capture->wrapped = false;
+        }
+    }
+
+    rec = capture->buf + capture->head;
+
+    capture->head += len;
+    capture->count++;
+
+    return rec;
+}
+
+
+/**
+ * @brief Length of the record including its header
+ *
+ * @param capture - pointer on the ring
+ * @param offset - offset of the record
+ *
+ * @return length of the record
+ */
+static uint32_t record_len(const tcoap_capture * const capture, const uint32_t offset)
+{
+    uint32_t incl_len;
+
+    mem_copy(&incl_len, capture->buf + offset + 8, 4);
+
+    return TCOAP_CAPTURE_RECORD_HEADER_LEN + incl_len;
+}
+
+
+static void put_u16(uint8_t * const buf, const uint16_t value)
+{
+    buf[0] = (uint8_t)(value >> 8);
+    buf[1] = (uint8_t)value;
+}
+
+
+static void put_u32(uint8_t * const buf, const uint32_t value)
+{
+    buf[0] = (uint8_t)(value >> 24);
+    buf[1] = (uint8_t)(value >> 16);
+    buf[2] = (uint8_t)(value >> 8);
+    buf[3] = (uint8_t)value;
+}
+
+
+#endif /* TCOAP_CAPTURE_ENABLED */
@@ -0,0 +1,154 @@
+/**
+ * tcoap_capture.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: capture of exchanges into a ring in memory in the pcap format, so it
+ *       does not change timings like the debug output does. Sent and received
+ *       CoAP messages are stored with timestamps ('tcoap_get_time_ms') and
+ *       synthetic IPv4 and UDP (or TCP) headers (port 5683), so the dump may
+ *       be opened in Wireshark and is decoded by its CoAP dissector. When the
+ *       ring is full the oldest packets are overwritten.
+ *
+ *       Messages are captured without framing of lower layers (e.g. SMS,
+ *       WebSocket). Messages of CoAP over WebSockets have the elided length,
+ *       so they are captured as messages of CoAP over TCP: the real length
+ *       header (rfc8323 3.2) is written instead of the first byte, then the
+ *       stream is decoded by the CoAP over TCP dissector and 'tcoap-replay'.
+ *       Signals which are answered by the library itself (Ping/Pong out of
+ *       exchange) are not captured.
+ *
+ *       It is compiled only if 'TCOAP_CAPTURE_ENABLED' is defined.
+ *
+ */
+
+
+#ifndef __TCOAP_CAPTURE_H
+#define __TCOAP_CAPTURE_H
+
+
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef TCOAP_CAPTURE_ENABLED
+
+
+#define TCOAP_CAPTURE_FILE_HEADER_LEN   24        /* pcap global header */
+#define TCOAP_CAPTURE_RECORD_HEADER_LEN 16        /* pcap record header */
+#define TCOAP_CAPTURE_IPV4_HEADER_LEN   20
+#define TCOAP_CAPTURE_UDP_HEADER_LEN    8
+#define TCOAP_CAPTURE_TCP_HEADER_LEN    20
+
+/* the longest overhead of the captured message */
+#define TCOAP_CAPTURE_OVERHEAD          (TCOAP_CAPTURE_RECORD_HEADER_LEN + TCOAP_CAPTURE_IPV4_HEADER_LEN + TCOAP_CAPTURE_TCP_HEADER_LEN)
+
+
+typedef enum {
+
+    TCOAP_CAPTURE_TX = 0,
+    TCOAP_CAPTURE_RX
+
+} tcoap_capture_direction;
+
+
+/**
+ * Ring of pcap records. Records are not split at the end of buffer: if a
+ * record does not fit before the end, the ring wraps at this place.
+ *
+ */
+typedef struct tcoap_capture {
+
+    uint8_t * buf;
+    uint32_t size;
+
+    uint32_t head;           /* offset of the next record */
+    uint32_t tail;           /* offset of the oldest record */
+    uint32_t end;            /* end of records after 'tail' if the ring is wrapped */
+    bool wrapped;
+
+    uint32_t count;          /* records in the ring */
+    uint32_t overwritten;    /* the oldest records which were overwritten */
+
+    uint32_t tcp_seq[2];     /* synthetic sequence numbers of TCP by direction */
+
+} tcoap_capture;
+
+
+/**
+ * @brief Callback for writing of the dump (e.g. into a file or to UART)
+ *
+ * @param ctx - user context
+ * @param buf - pointer on the next part of dump
+ * @param len - length of the part
+ */
+typedef void (*tcoap_capture_writer)(void * ctx, const uint8_t * buf, const uint32_t len);
+
+
+/**
+ * @brief Init the capture ring. It should be assigned to 'capture' of handle
+ *        to start the capture, NULL stops it.
+ *
+ * @param capture - pointer on the ring
+ * @param buf - buffer for records
+ * @param size - size of buffer, a message is captured if it is not longer than
+ *               'size - TCOAP_CAPTURE_OVERHEAD'
+ *
+ */
+void tcoap_capture_init(tcoap_capture * const capture, uint8_t * const buf, const uint32_t size);
+
+
+/**
+ * @brief Capture a message. Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param dir - direction of message
+ * @param buf - pointer on the message
+ * @param len - length of the message
+ *
+ */
+void tcoap_capture_packet(tcoap_handle * const handle, const tcoap_capture_direction dir, const uint8_t * buf, const uint32_t len);
+
+
+/**
+ * @brief Capture a message with bytes which are written before it in the
+ *        record (e.g. the length header of message of CoAP over WebSockets).
+ *        Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param dir - direction of message
+ * @param prefix - pointer on the bytes before the message
+ * @param prefix_len - number of these bytes
+ * @param buf - pointer on the message
+ * @param data_len - length of the message
+ *
+ */
+void tcoap_capture_prefixed(tcoap_handle * const handle, const tcoap_capture_direction dir, const uint8_t * prefix, const uint32_t prefix_len, const uint8_t * buf, const uint32_t data_len);
+
+
+/**
+ * @brief Dump the ring as a pcap file (the global header, then records from
+ *        the oldest one). The capture should be stopped while dumping.
+ *
+ * @param capture - pointer on the ring
+ * @param writer - callback for writing of the dump, it is called several times
+ * @param ctx - user context for the writer
+ *
+ * @return length of the dump
+ */
+uint32_t tcoap_capture_dump(const tcoap_capture * const capture, tcoap_capture_writer writer, void * ctx);
+
+
+#endif /* TCOAP_CAPTURE_ENABLED */
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_CAPTURE_H */
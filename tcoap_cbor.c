@@ -0,0 +1,660 @@
+/**
+ * tcoap_cbor.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_cbor.h"
+
+
+#define TCOAP_CBOR_MAJOR_UINT        0
+#define TCOAP_CBOR_MAJOR_NINT        1
+#define TCOAP_CBOR_MAJOR_BYTES       2
+#define TCOAP_CBOR_MAJOR_TEXT        3
+#define TCOAP_CBOR_MAJOR_ARRAY       4
+#define TCOAP_CBOR_MAJOR_MAP         5
+#define TCOAP_CBOR_MAJOR_TAG         6
+#define TCOAP_CBOR_MAJOR_SIMPLE      7
+
+#define TCOAP_CBOR_AI_1BYTE          24
+#define TCOAP_CBOR_AI_2BYTES         25
+#define TCOAP_CBOR_AI_4BYTES         26
+#define TCOAP_CBOR_AI_8BYTES         27
+#define TCOAP_CBOR_AI_INDEFINITE     31
+
+#define TCOAP_CBOR_FALSE_VAL         20
+#define TCOAP_CBOR_TRUE_VAL          21
+#define TCOAP_CBOR_NULL_VAL          22
+#define TCOAP_CBOR_UNDEFINED_VAL     23
+
+#define TCOAP_CBOR_INDEFINITE_ITEMS  UINT64_MAX
+
+
+/**
+ * Auxiliary data structures
+ *
+ */
+typedef union {
+
+    float f;
+    uint32_t u;
+
+} tcoap_cbor_float;
+
+
+typedef union {
+
+    double d;
+    uint64_t u;
+
+} tcoap_cbor_double;
+
+
+
+static uint32_t head_len(const uint64_t value);
+static void put_head(uint8_t * buf, const uint8_t major, const uint64_t value, const uint32_t len);
+static tcoap_error write_head(tcoap_cbor_writer * const writer, const uint8_t major, const uint64_t value);
+static tcoap_error write_string(tcoap_cbor_writer * const writer, const uint8_t major, const uint8_t * data, const uint32_t len);
+static float decode_half(const uint16_t half);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_cbor_writer_init(tcoap_cbor_writer * const writer, uint8_t * const buf, const uint32_t len)
+{
+    writer->buf = buf;
+    writer->len = len;
+    writer->idx = 0;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_uint(tcoap_cbor_writer * const writer, const uint64_t value)
+{
+    return write_head(writer, TCOAP_CBOR_MAJOR_UINT, value);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_int(tcoap_cbor_writer * const writer, const int64_t value)
+{
+    if (value < 0) {
+        /* -1 - value without overflow */
+        return write_head(writer, TCOAP_CBOR_MAJOR_NINT, ~(uint64_t)value);
+    }
+
+    return write_head(writer, TCOAP_CBOR_MAJOR_UINT, (uint64_t)value);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_bytes(tcoap_cbor_writer * const writer, const uint8_t * data, const uint32_t len)
+{
+    return write_string(writer, TCOAP_CBOR_MAJOR_BYTES, data, len);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_text(tcoap_cbor_writer * const writer, const char * text, const uint32_t len)
+{
+    return write_string(writer, TCOAP_CBOR_MAJOR_TEXT, (const uint8_t *)text, len);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_array(tcoap_cbor_writer * const writer, const uint32_t items)
+{
+    return write_head(writer, TCOAP_CBOR_MAJOR_ARRAY, items);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_map(tcoap_cbor_writer * const writer, const uint32_t pairs)
+{
+    return write_head(writer, TCOAP_CBOR_MAJOR_MAP, pairs);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_indefinite_array(tcoap_cbor_writer * const writer)
+{
+    if (writer->idx == writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    writer->buf[writer->idx++] = (TCOAP_CBOR_MAJOR_ARRAY << 5) | TCOAP_CBOR_AI_INDEFINITE;
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_indefinite_map(tcoap_cbor_writer * const writer)
+{
+    if (writer->idx == writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    writer->buf[writer->idx++] = (TCOAP_CBOR_MAJOR_MAP << 5) | TCOAP_CBOR_AI_INDEFINITE;
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_break(tcoap_cbor_writer * const writer)
+{
+    if (writer->idx == writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    writer->buf[writer->idx++] = (TCOAP_CBOR_MAJOR_SIMPLE << 5) | TCOAP_CBOR_AI_INDEFINITE;
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_tag(tcoap_cbor_writer * const writer, const uint64_t tag)
+{
+    return write_head(writer, TCOAP_CBOR_MAJOR_TAG, tag);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_bool(tcoap_cbor_writer * const writer, const bool value)
+{
+    return write_head(writer, TCOAP_CBOR_MAJOR_SIMPLE, value ? TCOAP_CBOR_TRUE_VAL : TCOAP_CBOR_FALSE_VAL);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_null(tcoap_cbor_writer * const writer)
+{
+    return write_head(writer, TCOAP_CBOR_MAJOR_SIMPLE, TCOAP_CBOR_NULL_VAL);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_float(tcoap_cbor_writer * const writer, const float value)
+{
+    tcoap_cbor_float fl;
+
+    if (writer->idx + 5 > writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    fl.f = value;
+    put_head(writer->buf + writer->idx, TCOAP_CBOR_MAJOR_SIMPLE, fl.u, 5);
+    writer->idx += 5;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_write_double(tcoap_cbor_writer * const writer, const double value)
+{
+    tcoap_cbor_double dbl;
+
+    if (writer->idx + 9 > writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    dbl.d = value;
+    put_head(writer->buf + writer->idx, TCOAP_CBOR_MAJOR_SIMPLE, dbl.u, 9);
+    writer->idx += 9;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_cbor_reader_init(tcoap_cbor_reader * const reader, const tcoap_data * const payload)
+{
+    reader->buf = payload->buf;
+    reader->len = payload->len;
+    reader->idx = 0;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+bool tcoap_cbor_reader_is_end(const tcoap_cbor_reader * const reader)
+{
+    return reader->idx >= reader->len;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_read(tcoap_cbor_reader * const reader, tcoap_cbor_item * const item)
+{
+    uint32_t idx;
+    uint32_t len;
+    uint8_t major;
+    uint8_t ai;
+    tcoap_cbor_float fl;
+    tcoap_cbor_double dbl;
+
+    idx = reader->idx;
+
+    if (idx >= reader->len) {
+        return TCOAP_WRONG_PAYLOAD_ERROR;
+    }
+
+    major = reader->buf[idx] >> 5;
+    ai = reader->buf[idx++] & 0x1F;
+
+    item->indefinite = false;
+    item->data = NULL;
+    item->fval = 0;
+    item->val = 0;
+
+    /* argument */
+    if (ai < TCOAP_CBOR_AI_1BYTE) {
+        item->val = ai;
+    } else if (ai <= TCOAP_CBOR_AI_8BYTES) {
+        len = 1u << (ai - TCOAP_CBOR_AI_1BYTE);
+
+        if (idx + len > reader->len) {
+            return TCOAP_WRONG_PAYLOAD_ERROR;
+        }
+
+        while (len--) {
+            item->val <<= 8;
+            item->val |= reader->buf[idx++];
+        }
+    } else if (ai == TCOAP_CBOR_AI_INDEFINITE) {
+        if (major == TCOAP_CBOR_MAJOR_UINT || major == TCOAP_CBOR_MAJOR_NINT || major == TCOAP_CBOR_MAJOR_TAG) {
+            return TCOAP_WRONG_PAYLOAD_ERROR;
+        }
+
+        item->indefinite = true;
+    } else {
+        return TCOAP_WRONG_PAYLOAD_ERROR;
+    }
+
+    switch (major) {
+        case TCOAP_CBOR_MAJOR_UINT:
+            item->type = TCOAP_CBOR_UINT;
+            break;
+
+        case TCOAP_CBOR_MAJOR_NINT:
+            item->type = TCOAP_CBOR_NINT;
+            break;
+
+        case TCOAP_CBOR_MAJOR_BYTES:
+        case TCOAP_CBOR_MAJOR_TEXT:
+            item->type = major == TCOAP_CBOR_MAJOR_BYTES ? TCOAP_CBOR_BYTES : TCOAP_CBOR_TEXT;
+
+            /* chunks of indefinite string will be read as separate items */
+            if (!item->indefinite) {
+                if (item->val > reader->len - idx) {
+                    return TCOAP_WRONG_PAYLOAD_ERROR;
+                }
+
+                item->data = reader->buf + idx;
+                idx += (uint32_t)item->val;
+            }
+            break;
+
+        case TCOAP_CBOR_MAJOR_ARRAY:
+            item->type = TCOAP_CBOR_ARRAY;
+            break;
+
+        case TCOAP_CBOR_MAJOR_MAP:
+            item->type = TCOAP_CBOR_MAP;
+            break;
+
+        case TCOAP_CBOR_MAJOR_TAG:
+            item->type = TCOAP_CBOR_TAG;
+            break;
+
+        default:
+            switch (ai) {
+                case TCOAP_CBOR_FALSE_VAL:
+                    item->type = TCOAP_CBOR_FALSE;
+                    break;
+
+                case TCOAP_CBOR_TRUE_VAL:
+                    item->type = TCOAP_CBOR_TRUE;
+                    break;
+
+                case TCOAP_CBOR_NULL_VAL:
+                    item->type = TCOAP_CBOR_NULL;
+                    break;
+
+                case TCOAP_CBOR_UNDEFINED_VAL:
+                    item->type = TCOAP_CBOR_UNDEFINED;
+                    break;
+
+                case TCOAP_CBOR_AI_2BYTES:
+                    item->type = TCOAP_CBOR_FLOAT;
+                    item->fval = decode_half((uint16_t)item->val);
+                    break;
+
+                case TCOAP_CBOR_AI_4BYTES:
+                    item->type = TCOAP_CBOR_FLOAT;
+                    fl.u = (uint32_t)item->val;
+                    item->fval = fl.f;
+                    break;
+
+                case TCOAP_CBOR_AI_8BYTES:
+                    item->type = TCOAP_CBOR_FLOAT;
+                    dbl.u = item->val;
+                    item->fval = dbl.d;
+                    break;
+
+                case TCOAP_CBOR_AI_INDEFINITE:
+                    item->type = TCOAP_CBOR_BREAK;
+                    item->indefinite = false;
+                    break;
+
+                default:
+                    item->type = TCOAP_CBOR_SIMPLE;
+                    break;
+            }
+            break;
+    }
+
+    reader->idx = idx;
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_cbor_skip(tcoap_cbor_reader * const reader)
+{
+    tcoap_error err;
+    tcoap_cbor_item item;
+
+    uint64_t remaining[TCOAP_CBOR_MAX_NESTING];
+    uint64_t nested;
+    uint32_t depth;
+
+    depth = 0;
+    remaining[0] = 1;
+
+    do {
+
+        if (remaining[depth] == 0) {
+            if (depth == 0) {
+                break;
+            }
+
+            depth--;
+            continue;
+        }
+
+        err = tcoap_cbor_read(reader, &item);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+
+        if (item.type == TCOAP_CBOR_BREAK) {
+            if (remaining[depth] != TCOAP_CBOR_INDEFINITE_ITEMS) {
+                return TCOAP_WRONG_PAYLOAD_ERROR;
+            }
+
+            depth--;
+            continue;
+        }
+
+        if (remaining[depth] != TCOAP_CBOR_INDEFINITE_ITEMS) {
+            remaining[depth]--;
+        }
+
+        /* items which should be skipped together with the current one */
+        switch (item.type) {
+            case TCOAP_CBOR_ARRAY:
+                nested = item.indefinite ? TCOAP_CBOR_INDEFINITE_ITEMS : item.val;
+                break;
+
+            case TCOAP_CBOR_MAP:
+                nested = item.indefinite ? TCOAP_CBOR_INDEFINITE_ITEMS : item.val * 2;
+                break;
+
+            case TCOAP_CBOR_BYTES:
+            case TCOAP_CBOR_TEXT:
+                nested = item.indefinite ? TCOAP_CBOR_INDEFINITE_ITEMS : 0;
+                break;
+
+            case TCOAP_CBOR_TAG:
+                nested = 1;
+                break;
+
+            default:
+                nested = 0;
+                break;
+        }
+
+        if (nested) {
+            if (++depth == TCOAP_CBOR_MAX_NESTING) {
+                return TCOAP_WRONG_PAYLOAD_ERROR;
+            }
+
+            remaining[depth] = nested;
+        }
+
+    } while (1);
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Calculate length of head of data item
+ *
+ * @param value - argument of data item
+ *
+ * @return length of head
+ */
+static uint32_t head_len(const uint64_t value)
+{
+    if (value < TCOAP_CBOR_AI_1BYTE) {
+        return 1;
+    } else if (value <= 0xFF) {
+        return 2;
+    } else if (value <= 0xFFFF) {
+        return 3;
+    } else if (value <= 0xFFFFFFFF) {
+        return 5;
+    }
+
+    return 9;
+}
+
+
+/**
+ * @brief Put head of data item into the buffer
+ *
+ * @param buf - pointer on buffer
+ * @param major - major type
+ * @param value - argument of data item
+ * @param len - length of head, see 'head_len'
+ *
+ */
+static void put_head(uint8_t * buf, const uint8_t major, const uint64_t value, const uint32_t len)
+{
+    uint32_t idx;
+
+    switch (len) {
+        case 1:
+            buf[0] = (major << 5) | (uint8_t)value;
+            return;
+
+        case 2:
+            buf[0] = (major << 5) | TCOAP_CBOR_AI_1BYTE;
+            break;
+
+        case 3:
+            buf[0] = (major << 5) | TCOAP_CBOR_AI_2BYTES;
+            break;
+
+        case 5:
+            buf[0] = (major << 5) | TCOAP_CBOR_AI_4BYTES;
+            break;
+
+        default:
+            buf[0] = (major << 5) | TCOAP_CBOR_AI_8BYTES;
+            break;
+    }
+
+    /* network byte order */
+    for (idx = len - 1; idx > 0; idx--) {
+        buf[idx] = (uint8_t)(value >> ((len - 1 - idx) * 8));
+    }
+}
+
+
+/**
+ * @brief Encode head of data item
+ *
+ * @param writer - pointer on the writer
+ * @param major - major type
+ * @param value - argument of data item
+ *
+ * @return status of operation
+ */
+static tcoap_error write_head(tcoap_cbor_writer * const writer, const uint8_t major, const uint64_t value)
+{
+    uint32_t len;
+
+    len = head_len(value);
+
+    if (writer->idx + len > writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    put_head(writer->buf + writer->idx, major, value, len);
+    writer->idx += len;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Encode byte or text string
+ *
+ * @param writer - pointer on the writer
+ * @param major - major type
+ * @param data - pointer on string
+ * @param len - length of string
+ *
+ * @return status of operation
+ */
+static tcoap_error write_string(tcoap_cbor_writer * const writer, const uint8_t major, const uint8_t * data, const uint32_t len)
+{
+    uint32_t hlen;
+
+    hlen = head_len(len);
+
+    if (writer->idx + hlen + len > writer->len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    put_head(writer->buf + writer->idx, major, len, hlen);
+    writer->idx += hlen;
+
+    mem_copy(writer->buf + writer->idx, data, len);
+    writer->idx += len;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Convert half-precision float to single-precision float
+ *
+ * @param half - half-precision float
+ *
+ * @return single-precision float
+ */
+static float decode_half(const uint16_t half)
+{
+    tcoap_cbor_float fl;
+    uint32_t exp;
+    uint32_t mant;
+    int32_t shift;
+
+    exp = (half >> 10) & 0x1F;
+    mant = half & 0x03FF;
+
+    fl.u = (uint32_t)(half & 0x8000) << 16;
+
+    if (exp == 0x1F) {
+        /* infinity or NaN */
+        fl.u |= (0xFFu << 23) | (mant << 13);
+    } else if (exp) {
+        fl.u |= ((exp + 112) << 23) | (mant << 13);
+    } else if (mant) {
+        /* subnormal value */
+        shift = -1;
+
+        do {
+            shift++;
+            mant <<= 1;
+        } while (!(mant & 0x0400));
+
+        fl.u |= ((uint32_t)(112 - shift) << 23) | ((mant & 0x03FF) << 13);
+    }
+
+    return fl.f;
+}
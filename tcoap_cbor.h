@@ -0,0 +1,174 @@
+/**
+ * tcoap_cbor.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: Streaming CBOR (rfc7049) writer and pull reader for payloads with
+ *       the 'TCOAP_APPLICATION_CBOR' content format. The writer encodes
+ *       straight into the packet (see 'payload_writer' in the request
+ *       descriptor), the reader walks the received payload in place.
+ *
+ */
+
+
+#ifndef __TCOAP_CBOR_H
+#define __TCOAP_CBOR_H
+
+
+#include <stdint.h>
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifndef TCOAP_CBOR_MAX_NESTING
+#define TCOAP_CBOR_MAX_NESTING          8         /* maximum nesting of arrays/maps for skipping */
+#endif /* TCOAP_CBOR_MAX_NESTING */
+
+
+
+typedef enum {
+
+    TCOAP_CBOR_UINT = 0,
+    TCOAP_CBOR_NINT,         /* negative integer */
+    TCOAP_CBOR_BYTES,
+    TCOAP_CBOR_TEXT,
+    TCOAP_CBOR_ARRAY,
+    TCOAP_CBOR_MAP,
+    TCOAP_CBOR_TAG,
+
+    TCOAP_CBOR_FALSE,
+    TCOAP_CBOR_TRUE,
+    TCOAP_CBOR_NULL,
+    TCOAP_CBOR_UNDEFINED,
+    TCOAP_CBOR_SIMPLE,
+    TCOAP_CBOR_FLOAT,
+    TCOAP_CBOR_BREAK
+
+} tcoap_cbor_type;
+
+
+typedef struct tcoap_cbor_writer {
+
+    uint8_t * buf;
+    uint32_t len;            /* size of buffer */
+    uint32_t idx;            /* length of encoded data */
+
+} tcoap_cbor_writer;
+
+
+typedef struct tcoap_cbor_reader {
+
+    const uint8_t * buf;
+    uint32_t len;
+    uint32_t idx;
+
+} tcoap_cbor_reader;
+
+
+typedef struct tcoap_cbor_item {
+
+    uint8_t type;            /* see 'tcoap_cbor_type' */
+    bool indefinite;         /* indefinite length string/array/map */
+
+    /**
+     * UINT: value, NINT: -1 - value, BYTES/TEXT: length,
+     * ARRAY: number of items, MAP: number of pairs, TAG: tag,
+     * SIMPLE: simple value
+     */
+    uint64_t val;
+    double fval;             /* FLOAT: value */
+
+    const uint8_t * data;    /* BYTES/TEXT: pointer on data inside of the payload */
+
+} tcoap_cbor_item;
+
+
+
+/**
+ * @brief Init CBOR writer
+ *
+ * @param writer - pointer on the writer
+ * @param buf - buffer for encoding (e.g. the 'buf' from the payload writer of request)
+ * @param len - length of buffer
+ *
+ */
+void tcoap_cbor_writer_init(tcoap_cbor_writer * const writer, uint8_t * const buf, const uint32_t len);
+
+
+/**
+ * @brief Encode data items. Every function either encodes the whole item or
+ *        nothing (and returns 'TCOAP_NO_FREE_MEM_ERROR'), so the writer always
+ *        contains a sequence of complete items.
+ *
+ * @param writer - pointer on the writer
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_cbor_write_uint(tcoap_cbor_writer * const writer, const uint64_t value);
+tcoap_error tcoap_cbor_write_int(tcoap_cbor_writer * const writer, const int64_t value);
+tcoap_error tcoap_cbor_write_bytes(tcoap_cbor_writer * const writer, const uint8_t * data, const uint32_t len);
+tcoap_error tcoap_cbor_write_text(tcoap_cbor_writer * const writer, const char * text, const uint32_t len);
+tcoap_error tcoap_cbor_write_array(tcoap_cbor_writer * const writer, const uint32_t items);
+tcoap_error tcoap_cbor_write_map(tcoap_cbor_writer * const writer, const uint32_t pairs);
+tcoap_error tcoap_cbor_write_indefinite_array(tcoap_cbor_writer * const writer);
+tcoap_error tcoap_cbor_write_indefinite_map(tcoap_cbor_writer * const writer);
+tcoap_error tcoap_cbor_write_break(tcoap_cbor_writer * const writer);
+tcoap_error tcoap_cbor_write_tag(tcoap_cbor_writer * const writer, const uint64_t tag);
+tcoap_error tcoap_cbor_write_bool(tcoap_cbor_writer * const writer, const bool value);
+tcoap_error tcoap_cbor_write_null(tcoap_cbor_writer * const writer);
+tcoap_error tcoap_cbor_write_float(tcoap_cbor_writer * const writer, const float value);
+tcoap_error tcoap_cbor_write_double(tcoap_cbor_writer * const writer, const double value);
+
+
+/**
+ * @brief Init CBOR reader
+ *
+ * @param reader - pointer on the reader
+ * @param payload - payload of response (e.g. 'payload' from 'tcoap_result_data')
+ *
+ */
+void tcoap_cbor_reader_init(tcoap_cbor_reader * const reader, const tcoap_data * const payload);
+
+
+/**
+ * @brief Check that all data was read
+ *
+ * @param reader - pointer on the reader
+ *
+ * @return true if there is no more data
+ */
+bool tcoap_cbor_reader_is_end(const tcoap_cbor_reader * const reader);
+
+
+/**
+ * @brief Read the next data item. Items of arrays and maps are read by next
+ *        calls (the reader does not build a tree), strings are not copied.
+ *
+ * @param reader - pointer on the reader
+ * @param item - pointer on the item for storing result
+ *
+ * @return status of operation ('TCOAP_WRONG_PAYLOAD_ERROR' if data is malformed or ended)
+ */
+tcoap_error tcoap_cbor_read(tcoap_cbor_reader * const reader, tcoap_cbor_item * const item);
+
+
+/**
+ * @brief Skip the next data item together with all nested items
+ *
+ * @param reader - pointer on the reader
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_cbor_skip(tcoap_cbor_reader * const reader);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_CBOR_H */
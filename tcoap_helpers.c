@@ -8,6 +8,7 @@
 
 
 #include "tcoap_helpers.h"
+#include "tcoap_utils.h"
 
 
 /**
@@ -45,6 +46,28 @@ uint16_t tcoap_decode_szx_to_size(const uint8_t szx)
 }
 
 
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint8_t tcoap_calc_block_szx(const tcoap_handle * const handle, const uint32_t overhead)
+{
+    uint32_t max_size;
+    uint8_t szx;
+
+    max_size = tcoap_get_max_message_size(handle);
+
+    for (szx = 6; szx > 0; szx--) {
+        /* block + payload marker */
+        if (tcoap_decode_szx_to_size(szx) + overhead + 1 <= max_size) {
+            break;
+        }
+    }
+
+    return szx;
+}
+
+
 /**
  * @brief See description in the header file.
  *
@@ -169,3 +192,114 @@ const tcoap_option_data * tcoap_find_option_by_number(const tcoap_option_data *
 }
 
 
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_compile_request_template(tcoap_request_template * const tpl,
+        const tcoap_option_data * options,
+        const tcoap_data * const prefix,
+        uint8_t * const buf,
+        const uint32_t len)
+{
+    uint32_t idx;
+
+    idx = options != NULL ? encoding_options_len(options) : 0;
+
+    if (prefix != NULL && prefix->len) {
+        idx += prefix->len + 1;
+    }
+
+    if (idx > len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    idx = 0;
+
+    if (options != NULL) {
+        idx += encoding_options(buf, options);
+    }
+
+    tpl->payload_marker = false;
+
+    if (prefix != NULL && prefix->len) {
+        idx += fill_payload(buf + idx, prefix);
+        tpl->payload_marker = true;
+    }
+
+    tpl->body.buf = buf;
+    tpl->body.len = idx;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_option_builder_init(tcoap_option_builder * const builder, tcoap_option_data * const options, const uint16_t capacity)
+{
+    builder->options = options;
+    builder->capacity = capacity;
+    builder->cnt = 0;
+    builder->head = NULL;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_option_builder_add(tcoap_option_builder * const builder, const uint16_t num, const uint8_t * value, const uint16_t len)
+{
+    tcoap_option_data * option;
+    tcoap_option_data ** link;
+
+    if (builder->cnt == builder->capacity) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    option = builder->options + builder->cnt++;
+
+    option->num = num;
+    option->len = len;
+    option->value = (uint8_t *)value;
+
+    /* insert after all options with the same or lower number, so
+     * repeatable options (e.g. Uri-Path) keep their relative order */
+    link = &builder->head;
+
+    while (*link != NULL && (*link)->num <= num) {
+        link = &(*link)->next;
+    }
+
+    option->next = *link;
+    *link = option;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_option_builder_encode(const tcoap_option_builder * const builder, uint8_t * const buf, const uint32_t len, uint32_t * const encoded_len)
+{
+    *encoded_len = 0;
+
+    if (builder->head == NULL) {
+        return TCOAP_NO_OPTIONS_ERROR;
+    }
+
+    if (encoding_options_len(builder->head) > len) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    *encoded_len = encoding_options(buf, builder->head);
+
+    return TCOAP_OK;
+}
+
+
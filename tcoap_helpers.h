@@ -53,6 +53,22 @@ typedef union tcoap_blockwise_data {
 } tcoap_blockwise_data;
 
 
+/**
+ * Builder of options. Options may be added in any order, the builder keeps
+ * them sorted by number (repeatable options keep their relative order).
+ *
+ */
+typedef struct tcoap_option_builder {
+
+    tcoap_option_data * options;   /* storage for options */
+    uint16_t capacity;             /* number of elements in the storage */
+    uint16_t cnt;                  /* number of added options */
+
+    tcoap_option_data * head;      /* sorted NULL terminated list of options, NULL if there are no options */
+
+} tcoap_option_builder;
+
+
 /**
  * @brief Get block size by SZX value
  *
@@ -62,6 +78,18 @@ typedef union tcoap_blockwise_data {
 uint16_t tcoap_decode_szx_to_size(const uint8_t szx);
 
 
+/**
+ * @brief Calculate the biggest SZX value for the block-wise transfer which
+ *        fits into the maximum message size (see 'tcoap_get_max_message_size')
+ *
+ * @param handle - coap handle
+ * @param overhead - length of header, token and options of message with block
+ *
+ * @return SZX value
+ */
+uint8_t tcoap_calc_block_szx(const tcoap_handle * const handle, const uint32_t overhead);
+
+
 /**
  * @brief Fill block2 option
  *
@@ -94,6 +122,63 @@ void tcoap_extract_block2_from_opt(const tcoap_option_data * const block2, tcoap
 const tcoap_option_data * tcoap_find_option_by_number(const tcoap_option_data * options, const uint16_t opt_num);
 
 
+/**
+ * @brief Compile a template of request. Options and a fixed prefix of payload
+ *        are encoded only once, then every request which refers to the template
+ *        (see 'tpl' in the 'tcoap_request_descriptor') will just copy them.
+ *
+ * @param tpl - pointer on the template
+ * @param options - list of options (in the ascending order), may be NULL
+ * @param prefix - fixed prefix of payload, may be NULL
+ * @param buf - buffer for storing encoded data, should be alive while the template is used
+ * @param len - length of buffer
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_compile_request_template(tcoap_request_template * const tpl,
+        const tcoap_option_data * options,
+        const tcoap_data * const prefix,
+        uint8_t * const buf,
+        const uint32_t len);
+
+
+/**
+ * @brief Init a builder of options
+ *
+ * @param builder - pointer on the builder
+ * @param options - storage for options
+ * @param capacity - number of elements in the storage
+ *
+ */
+void tcoap_option_builder_init(tcoap_option_builder * const builder, tcoap_option_data * const options, const uint16_t capacity);
+
+
+/**
+ * @brief Add an option to the builder
+ *
+ * @param builder - pointer on the builder
+ * @param num - number of option
+ * @param value - value of option, should be alive while the builder is used
+ * @param len - length of value
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_option_builder_add(tcoap_option_builder * const builder, const uint16_t num, const uint8_t * value, const uint16_t len);
+
+
+/**
+ * @brief Encode options of the builder
+ *
+ * @param builder - pointer on the builder
+ * @param buf - buffer for storing encoded options
+ * @param len - length of buffer
+ * @param encoded_len - pointer on variable for storing length of encoded options
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_option_builder_encode(const tcoap_option_builder * const builder, uint8_t * const buf, const uint32_t len, uint32_t * const encoded_len);
+
+
 #ifdef  __cplusplus
 }
 #endif
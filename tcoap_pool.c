@@ -0,0 +1,245 @@
+/**
+ * tcoap_pool.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_pool.h"
+#include "tcoap_utils.h"
+
+
+#ifdef TCOAP_POOL_ENABLED
+
+
+#define TCOAP_POOL_NONE                 0xFFFF    /* the end of free list */
+
+#define TCOAP_POOL_INDEX(h)             ((h) & 0xFFFF)
+#define TCOAP_POOL_NEXT_HEAD(h,i)       ((((h) + 0x10000) & 0xFFFF0000) | (i))
+
+
+static uint32_t get_link(const tcoap_pool * const pool, const uint32_t idx);
+static void set_link(tcoap_pool * const pool, const uint32_t idx, const uint32_t next);
+static void add_used(tcoap_pool * const pool, const int32_t delta);
+static void increment(volatile uint32_t * const counter);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_pool_init(tcoap_pool * const pool, uint8_t * const mem, const uint32_t block_len, const uint32_t blocks)
+{
+    uint32_t idx;
+
+    if (mem == NULL || block_len < 2 || !blocks || blocks > TCOAP_POOL_MAX_BLOCKS) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    /* the options of response decoded into a misaligned block fault on some cores */
+    if (((uintptr_t)mem | block_len) & (TCOAP_BUF_ALIGN - 1)) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    pool->mem = mem;
+    pool->block_len = block_len;
+    pool->blocks = blocks;
+
+    /* the links are kept in the free blocks */
+    for (idx = 0; idx < blocks; idx++) {
+        set_link(pool, idx, idx + 1 < blocks ? idx + 1 : TCOAP_POOL_NONE);
+    }
+
+    pool->head = 0;
+
+    pool->used = 0;
+    pool->high_water = 0;
+    pool->exhausted = 0;
+    pool->quota_rejects = 0;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_pool_alloc(tcoap_pool * const pool, tcoap_handle * const handle, uint8_t ** block, const uint32_t min_len)
+{
+    uint32_t head;
+    uint32_t idx;
+
+    if (min_len > pool->block_len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    if (handle != NULL && handle->pool_quota && handle->pool_used >= handle->pool_quota) {
+        increment(&pool->quota_rejects);
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    /* the counter of changes in the head protects from ABA: the block may be
+     * taken and returned by another task between reading of its link and CAS
+     */
+    do {
+        head = pool->head;
+        idx = TCOAP_POOL_INDEX(head);
+
+        if (idx == TCOAP_POOL_NONE) {
+            increment(&pool->exhausted);
+            return TCOAP_NO_FREE_MEM_ERROR;
+        }
+    } while (!TCOAP_POOL_CAS(&pool->head, head, TCOAP_POOL_NEXT_HEAD(head, get_link(pool, idx))));
+
+    add_used(pool, 1);
+
+    if (handle != NULL) {
+        handle->pool_used++;
+    }
+
+    *block = pool->mem + idx * pool->block_len;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_pool_free(tcoap_pool * const pool, tcoap_handle * const handle, uint8_t * block)
+{
+    uint32_t head;
+    uint32_t offset;
+    uint32_t idx;
+
+    if (block < pool->mem) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    offset = (uint32_t)(block - pool->mem);
+    idx = offset / pool->block_len;
+
+    if (idx >= pool->blocks || offset % pool->block_len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    do {
+        head = pool->head;
+        set_link(pool, idx, TCOAP_POOL_INDEX(head));
+    } while (!TCOAP_POOL_CAS(&pool->head, head, TCOAP_POOL_NEXT_HEAD(head, idx)));
+
+    add_used(pool, -1);
+
+    if (handle != NULL && handle->pool_used) {
+        handle->pool_used--;
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_pool_get_stats(const tcoap_pool * const pool, tcoap_pool_stats * const stats)
+{
+    stats->blocks = pool->blocks;
+    stats->used = pool->used;
+    stats->high_water = pool->high_water;
+    stats->exhausted = pool->exhausted;
+    stats->quota_rejects = pool->quota_rejects;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_pool_reset_stats(tcoap_pool * const pool)
+{
+    pool->exhausted = 0;
+    pool->quota_rejects = 0;
+    pool->high_water = pool->used;
+}
+
+
+
+/**
+ * @brief Read the link of free block, it is stored byte by byte, so blocks
+ *        need not be aligned
+ *
+ * @param pool - pointer on the pool
+ * @param idx - index of block
+ *
+ * @return index of the next free block
+ */
+static uint32_t get_link(const tcoap_pool * const pool, const uint32_t idx)
+{
+    const uint8_t * link;
+
+    link = pool->mem + idx * pool->block_len;
+
+    return link[0] | ((uint32_t)link[1] << 8);
+}
+
+
+/**
+ * @brief Write the link of free block
+ *
+ */
+static void set_link(tcoap_pool * const pool, const uint32_t idx, const uint32_t next)
+{
+    uint8_t * link;
+
+    link = pool->mem + idx * pool->block_len;
+
+    link[0] = (uint8_t)next;
+    link[1] = (uint8_t)(next >> 8);
+}
+
+
+/**
+ * @brief Change the number of used blocks and raise the high-water mark
+ *
+ * @param pool - pointer on the pool
+ * @param delta - +1 or -1
+ *
+ */
+static void add_used(tcoap_pool * const pool, const int32_t delta)
+{
+    uint32_t used;
+    uint32_t mark;
+
+    do {
+        used = pool->used;
+    } while (!TCOAP_POOL_CAS(&pool->used, used, used + delta));
+
+    used += delta;
+
+    do {
+        mark = pool->high_water;
+    } while (used > mark && !TCOAP_POOL_CAS(&pool->high_water, mark, used));
+}
+
+
+/**
+ * @brief Increment the counter of failures
+ *
+ */
+static void increment(volatile uint32_t * const counter)
+{
+    uint32_t value;
+
+    do {
+        value = *counter;
+    } while (!TCOAP_POOL_CAS(counter, value, value + 1));
+}
+
+
+#endif /* TCOAP_POOL_ENABLED */
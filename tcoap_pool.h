@@ -0,0 +1,155 @@
+/**
+ * tcoap_pool.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: pool of fixed-size blocks for the rx and tx buffers. Blocks are
+ *       taken and returned in constant time by a lock-free free list, so the
+ *       time of allocation does not depend on the use of pool and there is no
+ *       fragmentation. Several handles may share one pool, the 'pool_quota'
+ *       of handle limits the number of blocks which it may hold at once.
+ *       The pool counts its use: blocks in use, the high-water mark and the
+ *       failed allocations (the pool is exhausted or the quota is exceeded).
+ *
+ *       If 'pool' of handle is set, buffers of exchanges are taken from it,
+ *       otherwise 'tcoap_alloc_mem_block' and 'tcoap_free_mem_block' are
+ *       called, the port may implement them by 'tcoap_pool_alloc' and
+ *       'tcoap_pool_free' with a shared pool.
+ *
+ *       Every block should fit the tx buffer, i.e. it should be not shorter
+ *       than 'TCOAP_POOL_BLOCK_LEN' of the longest 'headroom' + 'tailroom'.
+ *       The memory and the length of block should be aligned as a pointer
+ *       ('TCOAP_BUF_ALIGN'), since options of response are decoded into the
+ *       tx buffer.
+ *       An exchange holds two blocks (tx and rx) while it is in progress.
+ *
+ *       It is compiled only if 'TCOAP_POOL_ENABLED' is defined.
+ *
+ */
+
+
+#ifndef __TCOAP_POOL_H
+#define __TCOAP_POOL_H
+
+
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef TCOAP_POOL_ENABLED
+
+
+/* the free list and the counters are changed by the task and by other tasks */
+#ifndef TCOAP_POOL_CAS
+#define TCOAP_POOL_CAS(p,o,n)           __sync_bool_compare_and_swap((p), (o), (n))
+#endif /* TCOAP_POOL_CAS */
+
+#define TCOAP_POOL_MAX_BLOCKS           0xFFFE    /* the index of block is 16 bits */
+
+/* length of block for buffers with the given room of lower layers, the headroom is rounded up by 'TCOAP_ALIGN_UP' */
+#define TCOAP_POOL_BLOCK_LEN(room)      TCOAP_ALIGN_UP(TCOAP_MAX_PDU_SIZE + (room) + TCOAP_BUF_ALIGN - 1)
+
+/* size of memory for the pool, e.g. static void * mem[TCOAP_POOL_MEM_SIZE(4, TCOAP_POOL_BLOCK_LEN(0)) / sizeof(void *)] */
+#define TCOAP_POOL_MEM_SIZE(n,len)      ((n) * (len))
+
+
+typedef struct tcoap_pool_stats {
+
+    uint32_t blocks;               /* number of blocks of pool */
+    uint32_t used;                 /* blocks in use */
+    uint32_t high_water;           /* the most blocks in use at once */
+    uint32_t exhausted;            /* allocations failed because there were no free blocks */
+    uint32_t quota_rejects;        /* allocations failed because of 'pool_quota' of handle */
+
+} tcoap_pool_stats;
+
+
+typedef struct tcoap_pool {
+
+    uint8_t * mem;
+    uint32_t block_len;
+    uint32_t blocks;
+
+    volatile uint32_t head;        /* the first free block (low half) and the counter of changes (high half) */
+
+    volatile uint32_t used;
+    volatile uint32_t high_water;
+    volatile uint32_t exhausted;
+    volatile uint32_t quota_rejects;
+
+} tcoap_pool;
+
+
+/**
+ * @brief Init the pool, all blocks are free
+ *
+ * @param pool - pointer on the pool
+ * @param mem - memory for blocks, 'TCOAP_POOL_MEM_SIZE' bytes aligned as a pointer
+ * @param block_len - length of block, not less than 2 and multiple of 'TCOAP_BUF_ALIGN'
+ * @param blocks - number of blocks, not more than 'TCOAP_POOL_MAX_BLOCKS'
+ *
+ * @return status of operation, 'TCOAP_PARAM_ERROR' if blocks are not aligned
+ */
+tcoap_error tcoap_pool_init(tcoap_pool * const pool, uint8_t * const mem, const uint32_t block_len, const uint32_t blocks);
+
+
+/**
+ * @brief Take a block from the pool
+ *
+ * @param pool - pointer on the pool
+ * @param handle - the owner of block, it is checked against its 'pool_quota',
+ *                 NULL if the quota is not needed
+ * @param block - in this variable will be stored pointer on the block
+ * @param min_len - needed length
+ *
+ * @return status of operation, 'TCOAP_NO_FREE_MEM_ERROR' if the pool is
+ *         exhausted or the quota is exceeded
+ */
+tcoap_error tcoap_pool_alloc(tcoap_pool * const pool, tcoap_handle * const handle, uint8_t ** block, const uint32_t min_len);
+
+
+/**
+ * @brief Return the block to the pool
+ *
+ * @param pool - pointer on the pool
+ * @param handle - the owner of block, the same as it was given to 'tcoap_pool_alloc'
+ * @param block - pointer on the block
+ *
+ * @return status of operation, 'TCOAP_PARAM_ERROR' if the block is not from the pool
+ */
+tcoap_error tcoap_pool_free(tcoap_pool * const pool, tcoap_handle * const handle, uint8_t * block);
+
+
+/**
+ * @brief Get counters of the pool
+ *
+ * @param pool - pointer on the pool
+ * @param stats - pointer on the struct for the counters
+ *
+ */
+void tcoap_pool_get_stats(const tcoap_pool * const pool, tcoap_pool_stats * const stats);
+
+
+/**
+ * @brief Clear the counters of failures, the high-water mark starts from the
+ *        current use
+ *
+ * @param pool - pointer on the pool
+ *
+ */
+void tcoap_pool_reset_stats(tcoap_pool * const pool);
+
+
+#endif /* TCOAP_POOL_ENABLED */
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_POOL_H */
@@ -0,0 +1,408 @@
+/**
+ * tcoap_rx_ring.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_rx_ring.h"
+#include "tcoap_utils.h"
+
+
+#ifdef TCOAP_RX_RING_ENABLED
+
+
+#define TCOAP_RX_RING_SKIP              0xFFFF    /* the rest of buffer is not used, the next frame is at its start */
+
+
+static bool write_stream(tcoap_rx_ring * const ring, const uint8_t * data, const uint32_t len);
+static void write_frame(tcoap_rx_ring * const ring, const uint8_t * data, const uint32_t len);
+static void begin_frame(tcoap_rx_ring * const ring);
+static bool publish(tcoap_rx_ring * const ring, const uint32_t head);
+static bool next_frame(const tcoap_rx_ring * const ring, uint32_t * const start, uint32_t * const len);
+static void release(tcoap_rx_ring * const ring, const uint32_t tail);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_rx_ring_init(tcoap_rx_ring * const ring, uint8_t * const buf, const uint32_t size, const tcoap_rx_ring_mode mode)
+{
+    if (size < 2 || (size & (size - 1)) != 0) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    if (mode == TCOAP_RX_RING_FRAMES && size < TCOAP_RX_RING_FRAME_ROOM) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    ring->buf = buf;
+    ring->mask = size - 1;
+    ring->mode = mode;
+
+    ring->head = 0;
+    ring->tail = 0;
+
+    ring->wr = 0;
+    ring->frame_start = 0;
+    ring->in_frame = false;
+    ring->overrun = false;
+
+    ring->dropped = 0;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+bool tcoap_rx_ring_write(tcoap_rx_ring * const ring, const uint8_t * data, const uint32_t len)
+{
+    if (!len) {
+        return false;
+    }
+
+    if (ring->mode == TCOAP_RX_RING_STREAM) {
+        return write_stream(ring, data, len);
+    }
+
+    write_frame(ring, data, len);
+
+    return false;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+bool tcoap_rx_ring_put(tcoap_rx_ring * const ring, const uint8_t byte)
+{
+    return tcoap_rx_ring_write(ring, &byte, 1);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+bool tcoap_rx_ring_end_frame(tcoap_rx_ring * const ring)
+{
+    uint32_t len;
+    uint32_t pos;
+
+    if (ring->mode != TCOAP_RX_RING_FRAMES || !ring->in_frame) {
+        return false;
+    }
+
+    ring->in_frame = false;
+    len = ring->wr - ring->frame_start - TCOAP_RX_RING_PREFIX_LEN;
+
+    /* the frame and the padding before it are discarded */
+    if (ring->overrun || !len) {
+        if (ring->overrun) {
+            ring->dropped++;
+        }
+
+        ring->wr = ring->head;
+        return false;
+    }
+
+    /* the rest of buffer is skipped, the consumer skips it without the marker
+     * if the marker does not fit
+     */
+    if (ring->frame_start != ring->head) {
+        pos = ring->head & ring->mask;
+
+        if (ring->mask + 1 - pos >= TCOAP_RX_RING_PREFIX_LEN) {
+            ring->buf[pos] = (uint8_t)TCOAP_RX_RING_SKIP;
+            ring->buf[pos + 1] = (uint8_t)(TCOAP_RX_RING_SKIP >> 8);
+        }
+    }
+
+    pos = ring->frame_start & ring->mask;
+
+    ring->buf[pos] = (uint8_t)len;
+    ring->buf[pos + 1] = (uint8_t)(len >> 8);
+
+    return publish(ring, ring->wr);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+bool tcoap_rx_ring_is_empty(const tcoap_rx_ring * const ring)
+{
+    TCOAP_RX_RING_BARRIER();
+
+    return ring->head == ring->tail;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_rx_ring_deliver(tcoap_rx_ring * const ring, tcoap_handle * const handle)
+{
+    tcoap_error err;
+    uint32_t start;
+    uint32_t len;
+
+    if (ring->mode != TCOAP_RX_RING_FRAMES || !next_frame(ring, &start, &len)) {
+        return TCOAP_TIMEOUT_ERROR;
+    }
+
+    /* a response which arrives before the waiting is started is not lost */
+    if (!TCOAP_CHECK_STATUS(handle, TCOAP_WAITING_RESP)) {
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    err = tcoap_rx_packet(handle, ring->buf + (start & ring->mask) + TCOAP_RX_RING_PREFIX_LEN, len);
+
+    release(ring, start + TCOAP_RX_RING_PREFIX_LEN + len);
+
+    return err;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t tcoap_rx_ring_peek(const tcoap_rx_ring * const ring, const uint8_t ** data)
+{
+    uint32_t tail;
+    uint32_t head;
+    uint32_t pos;
+    uint32_t len;
+
+    tail = ring->tail;
+    head = ring->head;
+
+    TCOAP_RX_RING_BARRIER();
+
+    pos = tail & ring->mask;
+    len = head - tail;
+
+    if (len > ring->mask + 1 - pos) {
+        len = ring->mask + 1 - pos;
+    }
+
+    *data = ring->buf + pos;
+
+    return len;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_rx_ring_consume(tcoap_rx_ring * const ring, const uint32_t len)
+{
+    release(ring, ring->tail + len);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_rx_ring_flush(tcoap_rx_ring * const ring)
+{
+    release(ring, ring->head);
+}
+
+
+
+/**
+ * @brief Write bytes of stream, the rest which does not fit is dropped
+ *
+ * @param ring - pointer on the ring
+ * @param data - pointer on received bytes
+ * @param len - number of bytes
+ *
+ * @return true if the consumer should be woken
+ */
+static bool write_stream(tcoap_rx_ring * const ring, const uint8_t * data, const uint32_t len)
+{
+    uint32_t free_len;
+    uint32_t cnt;
+    uint32_t pos;
+    uint32_t first;
+
+    free_len = ring->mask + 1 - (ring->wr - ring->tail);
+    cnt = len <= free_len ? len : free_len;
+
+    ring->dropped += len - cnt;
+
+    if (!cnt) {
+        return false;
+    }
+
+    pos = ring->wr & ring->mask;
+    first = ring->mask + 1 - pos;
+
+    if (first > cnt) {
+        first = cnt;
+    }
+
+    mem_copy(ring->buf + pos, data, first);
+
+    if (cnt > first) {
+        mem_copy(ring->buf, data + first, cnt - first);
+    }
+
+    ring->wr += cnt;
+
+    return publish(ring, ring->wr);
+}
+
+
+/**
+ * @brief Write bytes of the current frame. The frame is contiguous, so it
+ *        does not wrap.
+ *
+ */
+static void write_frame(tcoap_rx_ring * const ring, const uint8_t * data, const uint32_t len)
+{
+    uint32_t frame_len;
+
+    if (!ring->in_frame) {
+        begin_frame(ring);
+    }
+
+    if (ring->overrun) {
+        return;
+    }
+
+    frame_len = ring->wr - ring->frame_start - TCOAP_RX_RING_PREFIX_LEN;
+
+    if (len > TCOAP_RX_RING_MAX_FRAME - frame_len || ring->wr + len - ring->tail > ring->mask + 1) {
+        ring->overrun = true;
+        return;
+    }
+
+    mem_copy(ring->buf + (ring->wr & ring->mask), data, len);
+    ring->wr += len;
+}
+
+
+/**
+ * @brief Start a frame: if the rest of buffer is shorter than the longest
+ *        frame, the frame is started at the beginning of buffer
+ *
+ */
+static void begin_frame(tcoap_rx_ring * const ring)
+{
+    uint32_t rest;
+
+    rest = ring->mask + 1 - (ring->wr & ring->mask);
+
+    ring->frame_start = ring->wr + (rest < TCOAP_RX_RING_FRAME_ROOM ? rest : 0);
+    ring->wr = ring->frame_start + TCOAP_RX_RING_PREFIX_LEN;
+    ring->in_frame = true;
+    ring->overrun = false;
+}
+
+
+/**
+ * @brief Publish written data. The consumer is woken only if it has read all
+ *        data before, otherwise it sees the new data before going to sleep:
+ *        each side writes its index and then reads the index of other side.
+ *
+ * @param ring - pointer on the ring
+ * @param head - the new head
+ *
+ * @return true if the consumer should be woken
+ */
+static bool publish(tcoap_rx_ring * const ring, const uint32_t head)
+{
+    uint32_t old_head;
+
+    old_head = ring->head;
+
+    TCOAP_RX_RING_BARRIER();
+
+    ring->head = head;
+
+    TCOAP_RX_RING_BARRIER();
+
+    return ring->tail == old_head;
+}
+
+
+/**
+ * @brief Find the oldest published frame, padding at the end of buffer is
+ *        skipped
+ *
+ * @param ring - pointer on the ring
+ * @param start - in this variable will be stored position of the frame (of its length)
+ * @param len - in this variable will be stored length of the frame
+ *
+ * @return true if there is a frame
+ */
+static bool next_frame(const tcoap_rx_ring * const ring, uint32_t * const start, uint32_t * const len)
+{
+    uint32_t tail;
+    uint32_t head;
+    uint32_t pos;
+    uint32_t rest;
+    uint32_t frame_len;
+
+    tail = ring->tail;
+    head = ring->head;
+
+    TCOAP_RX_RING_BARRIER();
+
+    while (tail != head) {
+        pos = tail & ring->mask;
+        rest = ring->mask + 1 - pos;
+
+        if (rest < TCOAP_RX_RING_PREFIX_LEN) {
+            tail += rest;
+            continue;
+        }
+
+        frame_len = ring->buf[pos] | ((uint32_t)ring->buf[pos + 1] << 8);
+
+        if (frame_len == TCOAP_RX_RING_SKIP) {
+            tail += rest;
+            continue;
+        }
+
+        *start = tail;
+        *len = frame_len;
+
+        return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief Release data up to the new tail. Reading of data is completed before
+ *        the release, the release is visible before the next reading of head.
+ *
+ */
+static void release(tcoap_rx_ring * const ring, const uint32_t tail)
+{
+    TCOAP_RX_RING_BARRIER();
+
+    ring->tail = tail;
+
+    TCOAP_RX_RING_BARRIER();
+}
+
+
+#endif /* TCOAP_RX_RING_ENABLED */
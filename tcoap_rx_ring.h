@@ -0,0 +1,206 @@
+/**
+ * tcoap_rx_ring.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: lock-free ring between the receiving interrupt (the producer, e.g.
+ *       UART IRQ or DMA half/full transfer) and the protocol task (the
+ *       consumer, 'tcoap_wait_event'). Unlike 'tcoap_rx_byte' the interrupt
+ *       does not touch the handle, so it may run at full rate, bytes which
+ *       arrive between exchanges are kept in the ring, and the task is woken
+ *       once per frame (or per burst of stream) instead of once per byte.
+ *
+ *       There should be only one producer and only one consumer, then no
+ *       locks and no disabling of interrupts are needed.
+ *
+ *       Frames mode (UDP or SMS payload over serial line): the end of each
+ *       frame is marked by the producer (e.g. by the idle line interrupt or
+ *       byte-timeout), a frame is published at once when it is complete and
+ *       the task delivers it by 'tcoap_rx_ring_deliver'. A frame which does
+ *       not fit is dropped as a whole. Frames are never split at the end of
+ *       buffer: if the rest of buffer is shorter than 'TCOAP_MAX_PDU_SIZE',
+ *       the ring wraps at this place.
+ *
+ *       Stream mode (CoAP over TCP): bytes are published as soon as they are
+ *       written and the task drains them in bulk by 'tcoap_rx_ring_peek' and
+ *       'tcoap_rx_ring_consume', e.g. into 'tcoap_tcp_framer_feed_frame'.
+ *
+ *       It is compiled only if 'TCOAP_RX_RING_ENABLED' is defined.
+ *
+ */
+
+
+#ifndef __TCOAP_RX_RING_H
+#define __TCOAP_RX_RING_H
+
+
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef TCOAP_RX_RING_ENABLED
+
+
+/* orders accesses to the data and to indexes of ring, a compiler barrier is
+ * enough for single-core MCUs: __asm__ volatile ("" ::: "memory")
+ */
+#ifndef TCOAP_RX_RING_BARRIER
+#define TCOAP_RX_RING_BARRIER()         __sync_synchronize()
+#endif /* TCOAP_RX_RING_BARRIER */
+
+#define TCOAP_RX_RING_PREFIX_LEN        2         /* length of frame before each frame */
+
+/* the longest frame */
+#define TCOAP_RX_RING_MAX_FRAME         (TCOAP_MAX_PDU_SIZE < 0xFFFF ? TCOAP_MAX_PDU_SIZE : 0xFFFE)
+
+/* the minimum size of ring in the frames mode */
+#define TCOAP_RX_RING_FRAME_ROOM        (TCOAP_RX_RING_MAX_FRAME + TCOAP_RX_RING_PREFIX_LEN)
+
+
+typedef enum {
+
+    TCOAP_RX_RING_FRAMES = 0,
+    TCOAP_RX_RING_STREAM
+
+} tcoap_rx_ring_mode;
+
+
+typedef struct tcoap_rx_ring {
+
+    uint8_t * buf;
+    uint32_t mask;                 /* size of buffer - 1 */
+    tcoap_rx_ring_mode mode;
+
+    volatile uint32_t head;        /* published data, it is written by the producer only */
+    volatile uint32_t tail;        /* released data, it is written by the consumer only */
+
+    /* state of the producer */
+    uint32_t wr;                   /* the next byte of the current frame */
+    uint32_t frame_start;          /* the length of the current frame is stored here */
+    bool in_frame;
+    bool overrun;                  /* the current frame does not fit, it is dropped at its end */
+
+    volatile uint32_t dropped;     /* dropped frames (frames mode) or bytes (stream mode) */
+
+} tcoap_rx_ring;
+
+
+/**
+ * @brief Init the ring. It should be done before the interrupt is enabled.
+ *
+ * @param ring - pointer on the ring
+ * @param buf - buffer for data
+ * @param size - size of buffer, it should be a power of two. In the frames
+ *               mode it should be not less than 'TCOAP_RX_RING_FRAME_ROOM',
+ *               a few PDUs are recommended
+ * @param mode - frames or stream
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_rx_ring_init(tcoap_rx_ring * const ring, uint8_t * const buf, const uint32_t size, const tcoap_rx_ring_mode mode);
+
+
+/**
+ * @brief Write received data (producer). In the stream mode bytes which do
+ *        not fit are dropped, in the frames mode the whole frame is dropped.
+ *
+ * @param ring - pointer on the ring
+ * @param data - pointer on received bytes
+ * @param len - number of bytes
+ *
+ * @return true if the consumer should be woken (stream mode: the ring was
+ *         empty), false otherwise
+ */
+bool tcoap_rx_ring_write(tcoap_rx_ring * const ring, const uint8_t * data, const uint32_t len);
+
+
+/**
+ * @brief Write one received byte (producer)
+ *
+ * @param ring - pointer on the ring
+ * @param byte - received byte
+ *
+ * @return the same as 'tcoap_rx_ring_write'
+ */
+bool tcoap_rx_ring_put(tcoap_rx_ring * const ring, const uint8_t byte);
+
+
+/**
+ * @brief Mark the end of frame and publish it (producer, frames mode)
+ *
+ * @param ring - pointer on the ring
+ *
+ * @return true if the frame is published and the consumer should be woken
+ */
+bool tcoap_rx_ring_end_frame(tcoap_rx_ring * const ring);
+
+
+/**
+ * @brief Check whether there is published data (consumer)
+ *
+ * @param ring - pointer on the ring
+ *
+ * @return true if there is nothing to read
+ */
+bool tcoap_rx_ring_is_empty(const tcoap_rx_ring * const ring);
+
+
+/**
+ * @brief Deliver the oldest frame to the handle by 'tcoap_rx_packet' right
+ *        from the ring, without copying (consumer, frames mode). The frame is
+ *        kept if the handle does not wait for the response.
+ *
+ * @param ring - pointer on the ring
+ * @param handle - coap handle
+ *
+ * @return status of 'tcoap_rx_packet', 'TCOAP_WRONG_STATE_ERROR' if the frame
+ *         is kept, 'TCOAP_TIMEOUT_ERROR' if there is no frame
+ */
+tcoap_error tcoap_rx_ring_deliver(tcoap_rx_ring * const ring, tcoap_handle * const handle);
+
+
+/**
+ * @brief Get published data which are contiguous in the buffer (consumer,
+ *        stream mode). The data stay in the ring until they are consumed.
+ *
+ * @param ring - pointer on the ring
+ * @param data - in this variable will be stored pointer on the data
+ *
+ * @return length of the data
+ */
+uint32_t tcoap_rx_ring_peek(const tcoap_rx_ring * const ring, const uint8_t ** data);
+
+
+/**
+ * @brief Release the data which were processed (consumer, stream mode)
+ *
+ * @param ring - pointer on the ring
+ * @param len - number of bytes, not more than returned by 'tcoap_rx_ring_peek'
+ *
+ */
+void tcoap_rx_ring_consume(tcoap_rx_ring * const ring, const uint32_t len);
+
+
+/**
+ * @brief Drop all published data (consumer), e.g. when the connection is
+ *        established again
+ *
+ * @param ring - pointer on the ring
+ *
+ */
+void tcoap_rx_ring_flush(tcoap_rx_ring * const ring);
+
+
+#endif /* TCOAP_RX_RING_ENABLED */
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_RX_RING_H */
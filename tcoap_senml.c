@@ -0,0 +1,207 @@
+/**
+ * tcoap_senml.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_senml.h"
+
+
+#define TCOAP_SENML_MAX_EXACT_INT    9007199254740992.0    /* 2^53 */
+
+
+
+static uint32_t string_len(const char * str);
+static tcoap_error write_text(tcoap_cbor_writer * const cbor, const int64_t label, const char * text);
+static tcoap_error write_number(tcoap_cbor_writer * const cbor, const int64_t label, const double value);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_senml_begin(tcoap_senml_writer * const writer,
+        uint8_t * const buf,
+        const uint32_t len,
+        const char * base_name,
+        const double base_time)
+{
+    writer->records = 0;
+    writer->base_name = base_name;
+    writer->base_time = base_time;
+
+    if (len < 2) {
+        tcoap_cbor_writer_init(&writer->cbor, buf, 0);
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    /* the last byte is reserved for the break of the pack */
+    tcoap_cbor_writer_init(&writer->cbor, buf, len - 1);
+
+    return tcoap_cbor_write_indefinite_array(&writer->cbor);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_senml_add_record(tcoap_senml_writer * const writer, const tcoap_senml_record * const record)
+{
+    tcoap_error err;
+    tcoap_cbor_writer * cbor;
+    uint32_t rollback_idx;
+    uint32_t pairs;
+    double time;
+
+    cbor = &writer->cbor;
+    rollback_idx = cbor->idx;
+
+    if (!rollback_idx) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    /* the time is packed as a delta to the base time, zero delta is omitted */
+    time = record->time - writer->base_time;
+
+    pairs = 1;
+    pairs += record->name != NULL ? 1 : 0;
+    pairs += record->unit != NULL ? 1 : 0;
+    pairs += time != 0 ? 1 : 0;
+
+    if (!writer->records) {
+        pairs += writer->base_name != NULL ? 1 : 0;
+        pairs += writer->base_time != 0 ? 1 : 0;
+    }
+
+    err = tcoap_cbor_write_map(cbor, pairs);
+
+    /* base values are carried by the first record */
+    if (!writer->records) {
+        if (err == TCOAP_OK && writer->base_name != NULL) {
+            err = write_text(cbor, TCOAP_SENML_BASE_NAME, writer->base_name);
+        }
+
+        if (err == TCOAP_OK && writer->base_time != 0) {
+            err = write_number(cbor, TCOAP_SENML_BASE_TIME, writer->base_time);
+        }
+    }
+
+    if (err == TCOAP_OK && record->name != NULL) {
+        err = write_text(cbor, TCOAP_SENML_NAME, record->name);
+    }
+
+    if (err == TCOAP_OK && record->unit != NULL) {
+        err = write_text(cbor, TCOAP_SENML_UNIT, record->unit);
+    }
+
+    if (err == TCOAP_OK) {
+        err = write_number(cbor, TCOAP_SENML_VALUE, record->value);
+    }
+
+    if (err == TCOAP_OK && time != 0) {
+        err = write_number(cbor, TCOAP_SENML_TIME, time);
+    }
+
+    if (err != TCOAP_OK) {
+        cbor->idx = rollback_idx;
+        return err;
+    }
+
+    writer->records++;
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t tcoap_senml_end(tcoap_senml_writer * const writer)
+{
+    if (!writer->cbor.idx) {
+        return 0;
+    }
+
+    /* return the reserved byte */
+    writer->cbor.len += 1;
+    tcoap_cbor_write_break(&writer->cbor);
+
+    return writer->cbor.idx;
+}
+
+
+/**
+ * @brief Calculate length of NULL terminated string
+ *
+ * @param str - pointer on string
+ *
+ * @return length of string
+ */
+static uint32_t string_len(const char * str)
+{
+    uint32_t len;
+
+    for (len = 0; str[len]; len++);
+
+    return len;
+}
+
+
+/**
+ * @brief Encode label and text value
+ *
+ * @param cbor - pointer on the CBOR writer
+ * @param label - label of field
+ * @param text - NULL terminated string
+ *
+ * @return status of operation
+ */
+static tcoap_error write_text(tcoap_cbor_writer * const cbor, const int64_t label, const char * text)
+{
+    tcoap_error err;
+
+    err = tcoap_cbor_write_int(cbor, label);
+
+    if (err == TCOAP_OK) {
+        err = tcoap_cbor_write_text(cbor, text, string_len(text));
+    }
+
+    return err;
+}
+
+
+/**
+ * @brief Encode label and numeric value in the shortest form: integer,
+ *        single or double precision float.
+ *
+ * @param cbor - pointer on the CBOR writer
+ * @param label - label of field
+ * @param value - numeric value
+ *
+ * @return status of operation
+ */
+static tcoap_error write_number(tcoap_cbor_writer * const cbor, const int64_t label, const double value)
+{
+    tcoap_error err;
+
+    err = tcoap_cbor_write_int(cbor, label);
+
+    if (err != TCOAP_OK) {
+        return err;
+    }
+
+    if (value > -TCOAP_SENML_MAX_EXACT_INT && value < TCOAP_SENML_MAX_EXACT_INT && (double)(int64_t)value == value) {
+        return tcoap_cbor_write_int(cbor, (int64_t)value);
+    }
+
+    if ((double)(float)value == value) {
+        return tcoap_cbor_write_float(cbor, (float)value);
+    }
+
+    return tcoap_cbor_write_double(cbor, value);
+}
@@ -0,0 +1,121 @@
+/**
+ * tcoap_senml.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: Batch encoder of SenML records (rfc8428) in the CBOR representation.
+ *       It is intended to be used inside of the 'payload_writer' callback of
+ *       request, so records are packed directly into the packet until the
+ *       free space of PDU is over.
+ *
+ */
+
+
+#ifndef __TCOAP_SENML_H
+#define __TCOAP_SENML_H
+
+
+#include <stdint.h>
+#include "tcoap.h"
+#include "tcoap_cbor.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Integer labels of SenML-CBOR, rfc8428 (6)
+ *
+ */
+typedef enum {
+
+    TCOAP_SENML_BASE_VERSION   = -1,
+    TCOAP_SENML_BASE_NAME      = -2,
+    TCOAP_SENML_BASE_TIME      = -3,
+    TCOAP_SENML_BASE_UNIT      = -4,
+    TCOAP_SENML_BASE_VALUE     = -5,
+    TCOAP_SENML_BASE_SUM       = -6,
+
+    TCOAP_SENML_NAME           = 0,
+    TCOAP_SENML_UNIT           = 1,
+    TCOAP_SENML_VALUE          = 2,
+    TCOAP_SENML_STRING_VALUE   = 3,
+    TCOAP_SENML_BOOL_VALUE     = 4,
+    TCOAP_SENML_SUM            = 5,
+    TCOAP_SENML_TIME           = 6,
+    TCOAP_SENML_UPDATE_TIME    = 7,
+    TCOAP_SENML_DATA_VALUE     = 8
+
+} tcoap_senml_label;
+
+
+typedef struct tcoap_senml_record {
+
+    const char * name;       /* may be NULL if the base name is enough */
+    const char * unit;       /* may be NULL */
+    double time;             /* absolute time in seconds (the base time is subtracted) */
+    double value;
+
+} tcoap_senml_record;
+
+
+typedef struct tcoap_senml_writer {
+
+    tcoap_cbor_writer cbor;
+    uint32_t records;        /* number of records which were added */
+
+    const char * base_name;  /* may be NULL */
+    double base_time;
+
+} tcoap_senml_writer;
+
+
+/**
+ * @brief Start a batch of records (the pack). Base values will be put into
+ *        the first record.
+ *
+ * @param writer - pointer on the writer
+ * @param buf - buffer for encoding (e.g. the 'buf' from the payload writer of request)
+ * @param len - length of buffer
+ * @param base_name - base name, may be NULL, should be alive while the writer is used
+ * @param base_time - base time in seconds, times of records are encoded relative to it
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_senml_begin(tcoap_senml_writer * const writer,
+        uint8_t * const buf,
+        const uint32_t len,
+        const char * base_name,
+        const double base_time);
+
+
+/**
+ * @brief Add a record into the pack. The record is added either entirely or
+ *        not at all, so the pack is valid even when the buffer is over.
+ *
+ * @param writer - pointer on the writer
+ * @param record - pointer on the record
+ *
+ * @return status of operation ('TCOAP_NO_FREE_MEM_ERROR' if the record does not fit)
+ */
+tcoap_error tcoap_senml_add_record(tcoap_senml_writer * const writer, const tcoap_senml_record * const record);
+
+
+/**
+ * @brief Finish the pack
+ *
+ * @param writer - pointer on the writer
+ *
+ * @return length of encoded pack
+ */
+uint32_t tcoap_senml_end(tcoap_senml_writer * const writer);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_SENML_H */
@@ -0,0 +1,230 @@
+/**
+ * tcoap_sms.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_sms.h"
+#include "tcoap_utils.h"
+
+
+#ifdef TCOAP_SMS_ENABLED
+
+
+#define TCOAP_SMS_IEI_CONCAT_8BIT    0x00      /* concatenated SMS, 8-bit reference number */
+#define TCOAP_SMS_IEI_CONCAT_16BIT   0x08      /* concatenated SMS, 16-bit reference number */
+
+#define TCOAP_SMS_IEDL_CONCAT_8BIT   3
+#define TCOAP_SMS_IEDL_CONCAT_16BIT  4
+
+
+
+static tcoap_error rx_segment(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
+static void rx_complete(tcoap_handle * const handle, const uint32_t len);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_sms_tx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    tcoap_error err;
+    uint8_t sms[TCOAP_SMS_USER_DATA_LEN];
+
+    uint32_t total;
+    uint32_t offset;
+    uint32_t part;
+
+    /* one SMS without UDH */
+    if (len <= TCOAP_SMS_USER_DATA_LEN) {
+        return TCOAP_TX(handle, buf, len);
+    }
+
+    total = (len + TCOAP_SMS_SEGMENT_LEN - 1) / TCOAP_SMS_SEGMENT_LEN;
+
+    if (total > TCOAP_SMS_MAX_SEGMENTS) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    sms[0] = TCOAP_SMS_CONCAT_UDH_LEN - 1;
+    sms[1] = TCOAP_SMS_IEI_CONCAT_8BIT;
+    sms[2] = TCOAP_SMS_IEDL_CONCAT_8BIT;
+
+    /* a byte of Message ID is used as reference, so segments of
+     * a retransmitted message are interchangeable with the original ones */
+    sms[3] = buf[3];
+    sms[4] = total;
+    sms[5] = 0;
+
+    for (offset = 0; offset < len; offset += part) {
+
+        part = len - offset;
+
+        if (part > TCOAP_SMS_SEGMENT_LEN) {
+            part = TCOAP_SMS_SEGMENT_LEN;
+        }
+
+        sms[5]++;
+        mem_copy(sms + TCOAP_SMS_CONCAT_UDH_LEN, buf + offset, part);
+
+        err = TCOAP_TX(handle, sms, TCOAP_SMS_CONCAT_UDH_LEN + part);
+
+        /* the segment is in the local buffer */
+        if (err == TCOAP_OK) {
+            err = TCOAP_TX_DRAIN(handle);
+        }
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_sms_rx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    if (!len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    if (TCOAP_SMS_HAS_UDH(buf)) {
+        return rx_segment(handle, buf, len);
+    }
+
+    /* one SMS without UDH */
+    if (len > TCOAP_MAX_PDU_SIZE) {
+        TCOAP_STATS_INC(handle, rx_overflows);
+        return TCOAP_RX_BUFF_FULL_ERROR;
+    }
+
+    mem_copy(handle->response.buf, buf, len);
+    rx_complete(handle, len);
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Receive a segment of concatenated SMS. All segments except the last
+ *        one have the same length, so each segment is stored by its sequence
+ *        number right into the rx buffer. Segments may arrive in any order.
+ *
+ * @param handle - coap handle
+ * @param buf - pointer on the User Data of SMS
+ * @param len - length of data
+ *
+ * @return status of operation
+ */
+static tcoap_error rx_segment(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    uint32_t udh_len;
+    uint32_t idx;
+    uint32_t ref;
+    uint32_t total;
+    uint32_t seq;
+    uint32_t seg_len;
+    uint32_t part;
+    uint32_t offset;
+
+    udh_len = buf[0] + 1;
+
+    if (udh_len >= len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    /* find the concatenation element, other elements are skipped */
+    ref = 0;
+    total = 0;
+    seq = 0;
+
+    for (idx = 1; idx + 2 <= udh_len; idx += 2 + buf[idx + 1]) {
+
+        if (buf[idx] == TCOAP_SMS_IEI_CONCAT_8BIT && buf[idx + 1] == TCOAP_SMS_IEDL_CONCAT_8BIT
+                && idx + 2 + TCOAP_SMS_IEDL_CONCAT_8BIT <= udh_len) {
+
+            ref = buf[idx + 2];
+            total = buf[idx + 3];
+            seq = buf[idx + 4];
+            break;
+
+        } else if (buf[idx] == TCOAP_SMS_IEI_CONCAT_16BIT && buf[idx + 1] == TCOAP_SMS_IEDL_CONCAT_16BIT
+                && idx + 2 + TCOAP_SMS_IEDL_CONCAT_16BIT <= udh_len) {
+
+            ref = ((uint32_t)buf[idx + 2] << 8) | buf[idx + 3];
+            total = buf[idx + 4];
+            seq = buf[idx + 5];
+            break;
+        }
+    }
+
+    if (!total || total > TCOAP_SMS_MAX_SEGMENTS || !seq || seq > total) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    seg_len = TCOAP_SMS_USER_DATA_LEN - udh_len;
+    part = len - udh_len;
+    offset = (seq - 1) * seg_len;
+
+    if (part > seg_len || (seq < total && part != seg_len)) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    if (offset + part > TCOAP_MAX_PDU_SIZE) {
+        TCOAP_STATS_INC(handle, rx_overflows);
+        return TCOAP_RX_BUFF_FULL_ERROR;
+    }
+
+    /* a segment of another message, the incomplete one is abandoned */
+    if (!handle->sms_segments || handle->sms_ref != ref || handle->sms_total != total) {
+        handle->sms_ref = ref;
+        handle->sms_total = (uint8_t)total;
+        handle->sms_segments = 0;
+        handle->sms_len = 0;
+    }
+
+    /* duplicate (e.g. of retransmitted message) */
+    if (handle->sms_segments & (1u << (seq - 1))) {
+        return TCOAP_OK;
+    }
+
+    mem_copy(handle->response.buf + offset, buf + udh_len, part);
+
+    handle->sms_segments |= (1u << (seq - 1));
+    handle->sms_len += part;
+
+    if (handle->sms_segments == (uint16_t)((1u << total) - 1)) {
+        handle->sms_segments = 0;
+        rx_complete(handle, handle->sms_len);
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Finish receiving of message
+ *
+ * @param handle - coap handle
+ * @param len - length of message in the rx buffer
+ */
+static void rx_complete(tcoap_handle * const handle, const uint32_t len)
+{
+    handle->response.len = len;
+
+    TCOAP_STATS_RX(handle, len, len);
+    tcoap_tx_signal(handle, TCOAP_RESPONSE_DID_RECEIVE);
+}
+
+
+#endif /* TCOAP_SMS_ENABLED */
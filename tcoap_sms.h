@@ -0,0 +1,94 @@
+/**
+ * tcoap_sms.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: SMS bearer. It carries the messages of CoAP over UDP (the same binary
+ *       format, acknowledgement and retransmission) in the 8-bit data SMS.
+ *       A message which does not fit into one SMS is sent as a concatenated
+ *       SMS (3GPP TS 23.040, 9.2.3.24.1) and is reassembled on the receiving.
+ *
+ *       It is compiled only if 'TCOAP_SMS_ENABLED' is defined.
+ *
+ */
+
+
+#ifndef __TCOAP_SMS_H
+#define __TCOAP_SMS_H
+
+
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef TCOAP_SMS_ENABLED
+
+
+#define TCOAP_SMS_USER_DATA_LEN         140       /* user data of the 8-bit data SMS */
+#define TCOAP_SMS_CONCAT_UDH_LEN        6         /* UDHL + IEI + IEDL + ref + total + seq */
+#define TCOAP_SMS_SEGMENT_LEN           (TCOAP_SMS_USER_DATA_LEN - TCOAP_SMS_CONCAT_UDH_LEN)
+#define TCOAP_SMS_MAX_SEGMENTS          16
+
+
+/**
+ * The first byte of CoAP message always contains the version 1, the first byte
+ * of the User Data Header is its length. So the user should set the TP-UDHI flag
+ * of SMS if this macro is true for the data passed to 'tcoap_tx_data'.
+ *
+ */
+#define TCOAP_SMS_HAS_UDH(buf)          (((buf)[0] >> 6) != TCOAP_DEFAULT_VERSION)
+
+
+/**
+ *  User Data of the segment of concatenated SMS
+ *
+ *   0                   1                   2                   3
+ *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |   UDHL = 5    |   IEI = 0     |   IEDL = 3    |   Reference   |
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *  |    Total      |   Sequence    |   Part of CoAP message (up to 134 bytes) ...
+ *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ */
+
+
+/**
+ * @brief Send a CoAP message over SMS, it is segmented if needed.
+ *        Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param buf - pointer on the message
+ * @param len - length of the message
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_sms_tx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
+
+
+/**
+ * @brief Receive the User Data of SMS (either a whole message or a segment of
+ *        concatenated SMS). Do not use it directly, see 'tcoap_rx_packet'.
+ *
+ * @param handle - coap handle
+ * @param buf - pointer on the User Data of SMS (with UDH, if any)
+ * @param len - length of data
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_sms_rx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
+
+
+#endif /* TCOAP_SMS_ENABLED */
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_SMS_H */
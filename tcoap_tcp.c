@@ -8,6 +8,7 @@
 
 
 #include "tcoap_tcp.h"
+#include "tcoap_ws.h"
 #include "tcoap_utils.h"
 
 
@@ -22,6 +23,13 @@
 #define TCOAP_TCP_LEN_MED            269
 #define TCOAP_TCP_LEN_MAX            65805
 
+/* messages of CoAP over WebSockets are captured with the real length */
+#ifdef TCOAP_CAPTURE_ENABLED
+#define TCOAP_CAPTURE_MESSAGE(h,d,b,l,m)   ((h)->capture != NULL ? capture_message((h), (d), (b), (l), (m)) : (void)0)
+#else
+#define TCOAP_CAPTURE_MESSAGE(h,d,b,l,m)
+#endif /* TCOAP_CAPTURE_ENABLED */
+
 
 /**
  * Auxiliary data structures
@@ -50,10 +58,278 @@ typedef struct {
 
 
 static void asemble_request(tcoap_handle * const handle, tcoap_data * const request, const tcoap_request_descriptor * const reqd);
-static uint32_t parse_response(const tcoap_data * const request, const tcoap_data * const response, uint32_t * const options_shift);
+static tcoap_error feed(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len, const bool one_frame, uint32_t * const consumed);
+static uint32_t parse_response(const tcoap_data * const request, const tcoap_data * const response, const bool elided_len, uint32_t * const options_shift);
 static uint32_t extract_data_length(tcoap_tcp_header * const header, const uint8_t * const buf);
+static uint32_t calc_ext_length_size(const uint32_t data_len);
+static uint32_t calc_frame_length(const uint8_t * const buf, const uint32_t len);
+static bool process_signal(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd, const uint32_t option_start_idx);
+static void apply_csm(tcoap_handle * const handle, const uint32_t option_start_idx);
+static uint32_t calc_header_length(const uint8_t * const buf);
+static uint32_t write_length_header(uint8_t * const buf, const uint8_t tkl, const uint32_t data_len);
+static bool can_stream(const tcoap_tcp_framer * const framer);
+static bool start_stream(tcoap_tcp_framer * const framer);
+static void stream_chunk(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len);
+static void finish_stream(tcoap_tcp_framer * const framer);
 static void shift_data(uint8_t * dst, const uint8_t * src, uint32_t len);
+static tcoap_error send_produced_payload(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd, const uint8_t * const ws_mask);
+#ifdef TCOAP_CAPTURE_ENABLED
+static void capture_message(tcoap_handle * const handle, const tcoap_capture_direction dir, const uint8_t * buf, const uint32_t len, const uint32_t msg_len);
+#endif /* TCOAP_CAPTURE_ENABLED */
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_tcp_framer_init(tcoap_tcp_framer * const framer, tcoap_handle * const handle, uint8_t * const buf, const uint32_t size)
+{
+    framer->handle = handle;
+    framer->buf = buf;
+    framer->size = size;
+    framer->len = 0;
+    framer->frame_len = 0;
+    framer->drop = false;
+    framer->stream = false;
+    framer->head_len = 0;
+    framer->offset = 0;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_tcp_framer_feed(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len)
+{
+    uint32_t consumed;
+
+    return feed(framer, chunk, len, false, &consumed);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t tcoap_tcp_framer_feed_frame(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len, tcoap_error * const err)
+{
+    uint32_t consumed;
+
+    *err = feed(framer, chunk, len, true, &consumed);
+
+    return consumed;
+}
+
+
+/**
+ * @brief Feed a chunk of TCP stream to the framer
+ *
+ * @param framer - pointer on the framer
+ * @param chunk - pointer on received data
+ * @param len - length of received data
+ * @param one_frame - stop right after the first delivered frame
+ * @param consumed - in this variable will be stored number of consumed bytes
+ *
+ * @return status of operation
+ */
+static tcoap_error feed(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len, const bool one_frame, uint32_t * const consumed)
+{
+    tcoap_error err;
+    uint32_t idx;
+    uint32_t cnt;
+    uint32_t head_size;
+
+    err = TCOAP_OK;
+    idx = 0;
+
+    /* the head of streamed frame should fit into the rx buffer of handle as well */
+    head_size = framer->size < TCOAP_MAX_PDU_SIZE ? framer->size : TCOAP_MAX_PDU_SIZE;
+
+    while (idx < len) {
+
+        /* fast path: the whole frame is in the chunk, deliver it without copying */
+        if (!framer->len) {
+            cnt = calc_frame_length(chunk + idx, len - idx);
+
+            if (cnt && cnt <= len - idx && cnt <= TCOAP_MAX_PDU_SIZE) {
+                tcoap_rx_packet(framer->handle, chunk + idx, cnt);
+                idx += cnt;
+
+                if (one_frame) {
+                    break;
+                }
+
+                continue;
+            }
+        }
+
+        /* collect header */
+        if (!framer->frame_len) {
+            framer->buf[framer->len++] = chunk[idx++];
+            framer->frame_len = calc_frame_length(framer->buf, framer->len);
+
+            if (framer->frame_len > framer->size || framer->frame_len > TCOAP_MAX_PDU_SIZE) {
+                if (can_stream(framer)) {
+                    framer->stream = true;
+                    framer->head_len = 0;
+                } else {
+                    framer->drop = true;
+                    err = TCOAP_RX_BUFF_FULL_ERROR;
+
+                    TCOAP_STATS_INC(framer->handle, rx_overflows);
+                }
+            }
+        } else {
+
+            /* collect rest of frame */
+            cnt = framer->frame_len - framer->len;
 
+            if (cnt > len - idx) {
+                cnt = len - idx;
+            }
+
+            if (framer->stream && !framer->head_len) {
+
+                /* collect head of the streamed frame, then stream the payload */
+                if (cnt > head_size - framer->len) {
+                    cnt = head_size - framer->len;
+                }
+
+                mem_copy(framer->buf + framer->len, chunk + idx, cnt);
+
+                framer->len += cnt;
+                idx += cnt;
+
+                if (framer->len == head_size && !start_stream(framer)) {
+                    framer->stream = false;
+                    framer->drop = true;
+                    err = TCOAP_RX_BUFF_FULL_ERROR;
+
+                    TCOAP_STATS_INC(framer->handle, rx_overflows);
+                }
+
+                continue;
+            }
+
+            if (framer->stream) {
+                stream_chunk(framer, chunk + idx, cnt);
+            } else if (!framer->drop) {
+                mem_copy(framer->buf + framer->len, chunk + idx, cnt);
+            }
+
+            framer->len += cnt;
+            idx += cnt;
+        }
+
+        if (framer->frame_len && framer->len == framer->frame_len) {
+            if (framer->stream) {
+                finish_stream(framer);
+            } else if (!framer->drop) {
+                tcoap_rx_packet(framer->handle, framer->buf, framer->len);
+            }
+
+            framer->len = 0;
+            framer->frame_len = 0;
+            framer->drop = false;
+            framer->stream = false;
+
+            if (one_frame) {
+                break;
+            }
+        }
+    }
+
+    *consumed = idx;
+    return err;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_send_pong_tcp(tcoap_handle * const handle, const uint8_t * token, const uint32_t tkl)
+{
+    tcoap_error err;
+    uint8_t pong[TCOAP_MIN_TCP_HEADER_LEN + TCOAP_MAX_TOKEN_LEN];
+    uint8_t ws_mask[TCOAP_WS_MASK_LEN];
+    tcoap_tcp_len_header header;
+
+    /* rfc8323 5.4: the Pong echoes the token of Ping */
+    header.fields.len = 0;
+    header.fields.tkl = tkl;
+
+    pong[0] = header.byte;
+    pong[1] = TCOAP_TCP_SIGNAL_PONG_703;
+    mem_copy(pong + TCOAP_MIN_TCP_HEADER_LEN, token, tkl);
+
+    /* debug support */
+    if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
+        tcoap_debug_print_packet(handle, "coap pong >> ", pong, TCOAP_MIN_TCP_HEADER_LEN + tkl);
+    }
+
+    tcoap_tx_signal(handle, TCOAP_PING_DID_RECEIVE);
+
+    /* the Pong is sent from the stack, so the request (or the last part of
+     * produced payload) which may be still in the tx queue goes first */
+    err = TCOAP_TX_DRAIN(handle);
+
+    if (err != TCOAP_OK) {
+        return err;
+    }
+
+    /* the Pong has no options, so it is the same over WebSockets */
+    if (handle->transport == TCOAP_WS) {
+        err = tcoap_ws_tx_frame_header(handle, TCOAP_WS_BINARY_FRAME, TCOAP_MIN_TCP_HEADER_LEN + tkl, ws_mask);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+
+        tcoap_ws_mask(pong, TCOAP_MIN_TCP_HEADER_LEN + tkl, ws_mask, 0);
+    }
+
+    TCOAP_STATS_TX(handle, TCOAP_MIN_TCP_HEADER_LEN + tkl, TCOAP_MIN_TCP_HEADER_LEN + tkl);
+
+    return tcoap_tx_data(handle, pong, TCOAP_MIN_TCP_HEADER_LEN + tkl);
+}
+
+
+#ifdef TCOAP_LIVENESS_ENABLED
+/**
+ * @brief See description in the header file.
+ *
+ */
+bool tcoap_tcp_catch_ping(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    tcoap_tcp_len_header header;
+    uint32_t idx;
+
+    if (!len) {
+        return false;
+    }
+
+    header.byte = buf[0];
+    idx = calc_header_length(buf);
+
+    if (len <= idx || len < idx + 1 + header.fields.tkl) {
+        return false;
+    }
+
+    if (buf[idx] != TCOAP_TCP_SIGNAL_PING_702 || header.fields.tkl > TCOAP_MAX_TOKEN_LEN) {
+        return false;
+    }
+
+    /* the Pong will be sent by 'tcoap_keepalive', the last Ping wins */
+    mem_copy(handle->pong_token, buf + idx + 1, header.fields.tkl);
+    handle->pong_tkl = header.fields.tkl;
+    handle->pong_pending = true;
+
+    return true;
+}
+#endif /* TCOAP_LIVENESS_ENABLED */
 
 
 /**
@@ -65,11 +341,22 @@ tcoap_error tcoap_send_coap_request_tcp(tcoap_handle * const handle, const tcoap
     tcoap_error err;
     uint32_t resp_mask;
     uint32_t option_start_idx;
+    uint32_t total_len;
+    uint8_t ws_mask[TCOAP_WS_MASK_LEN];
     tcoap_result_data result;
 
     /* assembling packet */
     asemble_request(handle, &handle->request, reqd);
 
+    TCOAP_TRACE(handle, TCOAP_TRACE_ASSEMBLED);
+
+    total_len = handle->request.len + (reqd->payload_producer != NULL ? reqd->payload.len : 0);
+
+    /* the server does not accept messages longer than its Max-Message-Size */
+    if (handle->max_message_size && total_len > handle->max_message_size) {
+        return TCOAP_PARAM_ERROR;
+    }
+
     /* debug support */
     if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
         tcoap_debug_print_packet(handle, "coap >> ", handle->request.buf, handle->request.len);
@@ -78,59 +365,114 @@ tcoap_error tcoap_send_coap_request_tcp(tcoap_handle * const handle, const tcoap
     /* sending packet */
     tcoap_tx_signal(handle, TCOAP_ROUTINE_PACKET_WILL_START);
 
-    err = tcoap_tx_data(handle, handle->request.buf, handle->request.len);
+    TCOAP_CAPTURE_MESSAGE(handle, TCOAP_CAPTURE_TX, handle->request.buf, handle->request.len, total_len);
+
+    /* the message is carried by one masked binary frame, it is masked in place */
+    if (handle->transport == TCOAP_WS) {
+        err = tcoap_ws_tx_frame_header(handle, TCOAP_WS_BINARY_FRAME, total_len, ws_mask);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+
+        tcoap_ws_mask(handle->request.buf, handle->request.len, ws_mask, 0);
+    }
+
+    TCOAP_STATS_TX(handle, handle->request.len, handle->request.len);
+
+    err = TCOAP_TX(handle, handle->request.buf, handle->request.len);
+
+    if (handle->transport == TCOAP_WS) {
+        /* the driver may still read the masked packet */
+        if (err == TCOAP_OK) {
+            err = TCOAP_TX_DRAIN(handle);
+        }
+
+        /* only the header and token are needed for checking of response */
+        tcoap_ws_mask(handle->request.buf, TCOAP_MIN_TCP_HEADER_LEN + reqd->tkl, ws_mask, 0);
+    }
+
+    if (err == TCOAP_OK && reqd->payload_producer != NULL) {
+        err = send_produced_payload(handle, reqd, handle->transport == TCOAP_WS ? ws_mask : NULL);
+    }
 
     if (err != TCOAP_OK) {
         return err;
     }
 
+    TCOAP_TRACE(handle, TCOAP_TRACE_SENT);
+
     /* waiting response if needed */
     resp_mask = TCOAP_RESP_EMPTY;
     if (reqd->response_callback != NULL) {
 
-        handle->response.len = 0;
-        TCOAP_SET_STATUS(handle, TCOAP_WAITING_RESP);
+        do {
+            handle->response.len = 0;
+            TCOAP_SET_STATUS(handle, TCOAP_WAITING_RESP);
 
-        /* waiting either data arriving or timeout expiring */
-        err = tcoap_wait_event(handle, TCOAP_RESP_TIMEOUT_MS);
+            /* waiting either data arriving or timeout expiring */
+            err = tcoap_wait_event(handle, TCOAP_RESP_TIMEOUT_MS);
 
-        TCOAP_RESET_STATUS(handle, TCOAP_WAITING_RESP);
+            TCOAP_RESET_STATUS(handle, TCOAP_WAITING_RESP);
 
-        if (err != TCOAP_OK) {
-            return err;
-        }
+            if (err != TCOAP_OK) {
+                if (err == TCOAP_TIMEOUT_ERROR) {
+                    TCOAP_STATS_INC(handle, resp_timeouts);
+                }
 
-        /* debug support */
-        if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
-            tcoap_debug_print_packet(handle, "coap << ", handle->response.buf, handle->response.len);
-        }
+                return err;
+            }
 
-        /* parsing incoming packet */
-        resp_mask = parse_response(&handle->request, &handle->response, &option_start_idx);
+            TCOAP_STATS_ANSWERED(handle);
+            TCOAP_CAPTURE_MESSAGE(handle, TCOAP_CAPTURE_RX, handle->response.buf, handle->response.len, handle->response.len);
 
-        if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_INVALID_PACKET)) {
+            /* debug support */
+            if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
+                tcoap_debug_print_packet(handle, "coap << ", handle->response.buf, handle->response.len);
+            }
 
-            tcoap_tx_signal(handle, TCOAP_WRONG_PACKET_DID_RECEIVE);
-            err = TCOAP_NO_RESP_ERROR;
+            /* parsing incoming packet */
+            resp_mask = parse_response(&handle->request, &handle->response, handle->transport == TCOAP_WS, &option_start_idx);
 
-            return err;
-        } else if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_NRST)) {
+            TCOAP_TRACE(handle, TCOAP_TRACE_RESPONSE_RECEIVED);
 
-            tcoap_tx_signal(handle, TCOAP_NRST_DID_RECEIVE);
-            err = TCOAP_NRST_ANSWER;
+            if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_INVALID_PACKET)) {
 
-            return err;
-        }
+                TCOAP_STATS_INC(handle, invalid_packets);
+                TCOAP_STATS_INC(handle, rejects[TCOAP_REJECT_REASON(resp_mask)]);
+                tcoap_tx_signal(handle, TCOAP_WRONG_PACKET_DID_RECEIVE);
+                err = TCOAP_NO_RESP_ERROR;
+
+                return err;
+            } else if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_NRST)) {
+
+                TCOAP_STATS_INC(handle, rsts);
+                tcoap_tx_signal(handle, TCOAP_NRST_DID_RECEIVE);
+                err = TCOAP_NRST_ANSWER;
+
+                return err;
+            }
+
+            /* signals of server (e.g. CSM) may arrive at any moment, they are
+             * processed here and the response is still awaited */
+        } while (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_TCP_SIGNAL_CODE) && process_signal(handle, reqd, option_start_idx));
 
         /* We are using the same request buffer for storing incoming options, bcoz
          * outgoing packet is not needed already. It allows us to save ram-memory.
+         * The packet may be still in the tx queue, the result is not important:
+         * the answer is received.
          */
+        (void)TCOAP_TX_DRAIN(handle);
+
         err = decoding_options(&handle->response,
                 (tcoap_option_data *)handle->request.buf,
                 option_start_idx,
                 &handle->request.len);
 
+        TCOAP_TRACE(handle, TCOAP_TRACE_OPTIONS_DECODED);
+
         if (err == TCOAP_WRONG_OPTIONS_ERROR) {
+            TCOAP_STATS_INC(handle, rejects[TCOAP_REJECT_OPTIONS]);
             return err;
         }
 
@@ -147,8 +489,13 @@ tcoap_error tcoap_send_coap_request_tcp(tcoap_handle * const handle, const tcoap
         result.resp_code = handle->response.buf[option_start_idx - (handle->response.buf[0] & 0x0f) - 1];
         result.options = err == TCOAP_NO_OPTIONS_ERROR ? NULL : (tcoap_option_data *)handle->request.buf;
 
+        /* options are not mandatory */
+        err = TCOAP_OK;
+
         reqd->response_callback(reqd, &result);
 
+        TCOAP_TRACE(handle, TCOAP_TRACE_CALLBACK_DONE);
+
         /* debug support */
         if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
             tcoap_debug_print_options(handle, "coap opt << ", result.options);
@@ -184,22 +531,45 @@ static void asemble_request(tcoap_handle * const handle, tcoap_data * const requ
     options_len = 0;
     options_shift = TCOAP_MIN_TCP_HEADER_LEN + reqd->tkl;
 
-    if (reqd->payload.len > 10) {
-        options_shift += 1;
-    }
+    if (reqd->tpl != NULL && reqd->payload_writer == NULL) {
+
+        /* precompiled options: the length of data is known in advance,
+         * so the predicted length of header is exact and nothing will be shifted */
+        options_len = reqd->tpl->body.len;
+
+        if (handle->transport != TCOAP_WS) {
+            options_shift += calc_ext_length_size(options_len + TCOAP_PAYLOAD_BUF_LEN(reqd));
+        }
 
-    /* assemble options */
-    if (reqd->options != NULL) {
-        options_len += encoding_options(request->buf + options_shift, reqd->options);
+    } else {
+
+        if (handle->transport != TCOAP_WS && (reqd->payload.len > 10 || reqd->payload_writer != NULL)) {
+            options_shift += 1;
+        }
+
+        /* assemble options */
+        if (reqd->tpl != NULL) {
+            mem_copy(request->buf + options_shift, reqd->tpl->body.buf, reqd->tpl->body.len);
+            options_len = reqd->tpl->body.len;
+        } else if (reqd->options != NULL) {
+            options_len += encoding_options(request->buf + options_shift, reqd->options);
+        }
+
+        /* assemble payload in place, it will be shifted together with options */
+        if (reqd->payload_writer != NULL) {
+            options_len += write_payload(request->buf + options_shift + options_len, reqd,
+                    TCOAP_MAX_PDU_SIZE - TCOAP_MIN_TCP_HEADER_LEN - calc_ext_length_size(TCOAP_MAX_PDU_SIZE) - reqd->tkl - options_len);
+        }
     }
 
     /* assemble header */
-    request->len = options_len + (reqd->payload.len ? reqd->payload.len + 1 : 0);
+    request->len = options_len + TCOAP_PAYLOAD_BUF_LEN(reqd);
     header.fields.tkl = reqd->tkl;
 
-    if (request->len < TCOAP_TCP_LEN_MIN) {
+    /* rfc8323 4.2: the length is elided over WebSockets, the frame has it */
+    if (handle->transport == TCOAP_WS || request->len < TCOAP_TCP_LEN_MIN) {
 
-        header.fields.len = request->len;
+        header.fields.len = handle->transport == TCOAP_WS ? 0 : request->len;
 
         request->buf[0] = header.byte;
         request->buf[1] = reqd->code;
@@ -286,12 +656,93 @@ static void asemble_request(tcoap_handle * const handle, tcoap_data * const requ
         request->len += reqd->tkl;
     }
 
+    /* assemble precompiled options and payload */
+    if (reqd->tpl != NULL && reqd->payload_writer == NULL) {
+        request->len += fill_template(request->buf + request->len, reqd);
+        return;
+    }
+
     request->len += options_len;
 
     /* assemble payload */
-    if (reqd->payload.len) {
-        request->len += fill_payload(request->buf + request->len, &reqd->payload);
+    if (reqd->payload.len && reqd->payload_writer == NULL) {
+        if (reqd->payload_producer != NULL) {
+            /* the payload will be produced while sending */
+            request->buf[request->len++] = TCOAP_PAYLOAD_PREFIX;
+        } else {
+            request->len += fill_payload(request->buf + request->len, &reqd->payload);
+        }
+    }
+}
+
+
+/**
+ * @brief Pull the payload from the producer of request and send it by parts.
+ *        The header of packet (with the total length), token and options are
+ *        already sent. The free space of tx buffer after them is used for parts,
+ *        the packet itself is needed for checking of response.
+ *
+ * @param handle - coap handle
+ * @param reqd - descriptor of request
+ * @param ws_mask - masking key of WebSocket frame, NULL for TCP
+ *
+ * @return status of operation
+ */
+static tcoap_error send_produced_payload(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd, const uint8_t * const ws_mask)
+{
+    tcoap_error err;
+    uint8_t * buf;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t max_len;
+    uint32_t len;
+
+    buf = handle->request.buf + handle->request.len;
+    size = TCOAP_MAX_PDU_SIZE - handle->request.len;
+
+    if (!size) {
+        return TCOAP_NO_FREE_MEM_ERROR;
+    }
+
+    for (offset = 0; offset < reqd->payload.len; offset += len) {
+
+        max_len = reqd->payload.len - offset;
+
+        if (max_len > size) {
+            max_len = size;
+        }
+
+        /* the previous part may be still in the tx queue */
+        if (offset) {
+            err = TCOAP_TX_DRAIN(handle);
+
+            if (err != TCOAP_OK) {
+                return err;
+            }
+        }
+
+        len = reqd->payload_producer(reqd, buf, offset, max_len);
+
+        if (!len || len > max_len) {
+            return TCOAP_WRONG_PAYLOAD_ERROR;
+        }
+
+        TCOAP_CAPTURE(handle, TCOAP_CAPTURE_TX, buf, len);
+
+        if (ws_mask != NULL) {
+            tcoap_ws_mask(buf, len, ws_mask, handle->request.len + offset);
+        }
+
+        TCOAP_STATS_TX(handle, len, handle->request.len + len);
+
+        err = TCOAP_TX(handle, buf, len);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
     }
+
+    return TCOAP_OK;
 }
 
 
@@ -300,19 +751,23 @@ static void asemble_request(tcoap_handle * const handle, tcoap_data * const requ
  *
  * @param request - pointer on outgoing packet
  * @param response - pointer on incoming packet
+ * @param elided_len - the length is elided (WebSockets), the message takes the whole packet
  * @param options_shift - in this variable will be stored start of options index
  *
  * @return bit mask of parsing results, see 'tcoap_parsing_result'
  */
-static uint32_t parse_response(const tcoap_data * const request, const tcoap_data * const response, uint32_t * const options_shift)
+static uint32_t parse_response(const tcoap_data * const request, const tcoap_data * const response, const bool elided_len, uint32_t * const options_shift)
 {
     tcoap_tcp_header resp_header;
     tcoap_tcp_header req_header;
+    tcoap_reject_reason reason;
 
     uint32_t resp_mask;
     uint32_t resp_idx;
     uint32_t req_idx;
 
+    reason = TCOAP_REJECT_SHORT;
+
     /* checking header */
     if (response->len > 1) {
         resp_mask = TCOAP_RESP_SEPARATE;
@@ -322,11 +777,6 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
         resp_header.len_header.byte = response->buf[resp_idx++];
         req_header.len_header.byte = request->buf[req_idx++];
 
-        /* fast checking tkl */
-        if (resp_header.len_header.fields.tkl != req_header.len_header.fields.tkl) {
-            goto return_err_label;
-        }
-
         resp_idx += extract_data_length(&resp_header, response->buf + resp_idx);
         req_idx += extract_data_length(&req_header, request->buf + req_idx);
 
@@ -335,28 +785,45 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
             goto return_err_label;
         }
 
+        if (elided_len) {
+            resp_header.data_len = response->len - resp_header.len_header.fields.tkl - resp_idx - 1;
+        }
+
         /* get code */
         resp_header.code = response->buf[resp_idx++];
 
+        /* signals may be sent by the server at any moment, so their tokens are not checked */
+        if (TCOAP_EXTRACT_CLASS(resp_header.code) == TCOAP_TCP_SIGNAL_CLASS) {
+            TCOAP_SET_RESP(resp_mask, TCOAP_RESP_TCP_SIGNAL_CODE);
+
+            *options_shift = response->len - resp_header.data_len;
+            return resp_mask;
+        }
+
+        /* checking tkl */
+        if (resp_header.len_header.fields.tkl != req_header.len_header.fields.tkl) {
+            reason = TCOAP_REJECT_TKL;
+            goto return_err_label;
+        }
+
         /* check code */
         if (TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_SUCCESS_CLASS
                 && TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_BAD_REQUEST_CLASS
-                && TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_SERVER_ERR_CLASS
-                && TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_TCP_SIGNAL_CLASS) {
+                && TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_SERVER_ERR_CLASS) {
+            reason = TCOAP_REJECT_CODE;
             goto return_err_label;
         }
 
         /* check token */
         if (resp_header.len_header.fields.tkl) {
             if (!mem_cmp(response->buf + resp_idx, request->buf + req_idx + 1, resp_header.len_header.fields.tkl)) {
+                reason = TCOAP_REJECT_TOKEN;
                 goto return_err_label;
             }
         }
 
         if (TCOAP_EXTRACT_CLASS(resp_header.code) == TCOAP_SUCCESS_CLASS) {
             TCOAP_SET_RESP(resp_mask, TCOAP_RESP_SUCCESS_CODE);
-        } else if (TCOAP_EXTRACT_CLASS(resp_header.code) == TCOAP_TCP_SIGNAL_CLASS) {
-            TCOAP_SET_RESP(resp_mask, TCOAP_RESP_TCP_SIGNAL_CODE);
         } else {
             TCOAP_SET_RESP(resp_mask, TCOAP_RESP_FAILURE_CODE);
         }
@@ -371,11 +838,241 @@ return_err_label:
 /***********/
 
     *options_shift = 0;
-    resp_mask = TCOAP_RESP_INVALID_PACKET;
+    resp_mask = TCOAP_RESP_REJECT(reason);
     return resp_mask;
 }
 
 
+/**
+ * @brief Process signal of server
+ *
+ * @param handle - coap handle
+ * @param reqd - descriptor of request
+ * @param option_start_idx - index of options in the incoming packet
+ *
+ * @return true if the signal was consumed and the response is still awaited
+ */
+static bool process_signal(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd, const uint32_t option_start_idx)
+{
+    uint8_t code;
+    uint8_t tkl;
+
+    tkl = handle->response.buf[0] & 0x0f;
+    code = handle->response.buf[option_start_idx - tkl - 1];
+
+    switch (code) {
+        case TCOAP_TCP_SIGNAL_CSM_701:
+            apply_csm(handle, option_start_idx);
+            return reqd->code != TCOAP_TCP_SIGNAL_CSM_701;
+
+        case TCOAP_TCP_SIGNAL_PING_702:
+            if (tkl <= TCOAP_MAX_TOKEN_LEN) {
+                tcoap_send_pong_tcp(handle, handle->response.buf + option_start_idx - tkl, tkl);
+            }
+            return true;
+
+        case TCOAP_TCP_SIGNAL_PONG_703:
+            /* a late Pong of the previous ping is ignored */
+            return reqd->code != TCOAP_TCP_SIGNAL_PING_702;
+
+        default:
+            /* e.g. Release or Abort, the user should be informed */
+            return false;
+    }
+}
+
+
+/**
+ * @brief Apply the CSM (Capabilities and Settings Message) of server.
+ *        Settings which are absent in the CSM retain their values.
+ *
+ * @param handle - coap handle
+ * @param option_start_idx - index of options in the incoming packet
+ */
+static void apply_csm(tcoap_handle * const handle, const uint32_t option_start_idx)
+{
+    tcoap_option_data option;
+    uint32_t idx;
+
+    idx = option_start_idx;
+    option.num = 0;
+
+    while (decoding_next_option(&handle->response, &option, &idx) == TCOAP_OK) {
+
+        switch (option.num) {
+            case TCOAP_CSM_MAX_MESSAGE_SIZE_OPT:
+                handle->max_message_size = decoding_uint_option(&option);
+                break;
+
+            case TCOAP_CSM_BLOCK_WISE_TRANSFER_OPT:
+                handle->block_wise_transfer = true;
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+
+/**
+ * @brief Check that the current frame may be streamed, i.e. the handle waits
+ *        for a response and the request has the callback for chunks of payload
+ *
+ * @param framer - pointer on the framer
+ *
+ * @return true if the frame may be streamed
+ */
+static bool can_stream(const tcoap_tcp_framer * const framer)
+{
+    const tcoap_handle * const handle = framer->handle;
+
+    return TCOAP_CHECK_STATUS(handle, TCOAP_WAITING_RESP)
+            && handle->reqd != NULL
+            && handle->reqd->payload_chunk_callback != NULL;
+}
+
+
+/**
+ * @brief Validate the head of streamed frame (it should be the response on the
+ *        current request and its options should be in the buffer) and pass
+ *        the beginning of payload to the callback
+ *
+ * @param framer - pointer on the framer, its buffer contains the head of frame
+ *
+ * @return true if the payload of frame will be streamed
+ */
+static bool start_stream(tcoap_tcp_framer * const framer)
+{
+    tcoap_handle * const handle = framer->handle;
+    tcoap_option_data option;
+    tcoap_data head;
+    tcoap_error err;
+
+    uint32_t code_idx;
+    uint32_t req_code_idx;
+    uint32_t idx;
+    uint8_t tkl;
+    uint8_t code;
+
+    if (!can_stream(framer)) {
+        return false;
+    }
+
+    tkl = framer->buf[0] & 0x0f;
+    code_idx = calc_header_length(framer->buf);
+    req_code_idx = calc_header_length(handle->request.buf);
+
+    if (code_idx + 1 + tkl > framer->len) {
+        return false;
+    }
+
+    /* only a response on the current request is streamed (signals are never so long) */
+    code = framer->buf[code_idx];
+
+    if (TCOAP_EXTRACT_CLASS(code) != TCOAP_SUCCESS_CLASS
+            && TCOAP_EXTRACT_CLASS(code) != TCOAP_BAD_REQUEST_CLASS
+            && TCOAP_EXTRACT_CLASS(code) != TCOAP_SERVER_ERR_CLASS) {
+        return false;
+    }
+
+    if (tkl != (handle->request.buf[0] & 0x0f)
+            || !mem_cmp(framer->buf + code_idx + 1, handle->request.buf + req_code_idx + 1, tkl)) {
+        return false;
+    }
+
+    /* find the payload marker */
+    head.buf = framer->buf;
+    head.len = framer->len;
+
+    idx = code_idx + 1 + tkl;
+    option.num = 0;
+
+    do {
+        err = decoding_next_option(&head, &option, &idx);
+    } while (err == TCOAP_OK);
+
+    if (err != TCOAP_NO_OPTIONS_ERROR || idx >= head.len) {
+        return false;
+    }
+
+    framer->head_len = idx;
+    framer->offset = 0;
+
+    /* beginning of payload */
+    stream_chunk(framer, framer->buf + idx + 1, framer->len - idx - 1);
+
+    return true;
+}
+
+
+/**
+ * @brief Pass a chunk of streamed payload to the callback of request
+ *
+ * @param framer - pointer on the framer
+ * @param chunk - pointer on the chunk
+ * @param len - length of the chunk
+ */
+static void stream_chunk(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len)
+{
+    tcoap_data data;
+
+    /* the request is not awaited anymore (e.g. timeout), the rest of frame is dropped */
+    if (!can_stream(framer)) {
+        framer->stream = false;
+        framer->drop = true;
+        return;
+    }
+
+    if (!len) {
+        return;
+    }
+
+    data.buf = (uint8_t *)chunk;
+    data.len = len;
+
+    framer->handle->reqd->payload_chunk_callback(framer->handle->reqd, &data, framer->offset);
+    framer->offset += len;
+
+    /* the user may restart the timeout of waiting here */
+    tcoap_tx_signal(framer->handle, TCOAP_RESPONSE_BYTE_DID_RECEIVE);
+}
+
+
+/**
+ * @brief Deliver the head of streamed frame (without payload) to the handle,
+ *        so the response is processed as usual
+ *
+ * @param framer - pointer on the framer
+ */
+static void finish_stream(tcoap_tcp_framer * const framer)
+{
+    tcoap_handle * const handle = framer->handle;
+
+    uint32_t code_idx;
+    uint32_t options_idx;
+    uint32_t len;
+    uint8_t tkl;
+
+    if (!can_stream(framer)) {
+        return;
+    }
+
+    tkl = framer->buf[0] & 0x0f;
+    code_idx = calc_header_length(framer->buf);
+    options_idx = code_idx + 1 + tkl;
+
+    /* the length of header is changed, so the head is re-framed */
+    len = write_length_header(handle->response.buf, tkl, framer->head_len - options_idx);
+    mem_copy(handle->response.buf + len, framer->buf + code_idx, framer->head_len - code_idx);
+
+    handle->response.len = len + framer->head_len - code_idx;
+
+    TCOAP_STATS_RX(handle, framer->frame_len, handle->response.len);
+    tcoap_tx_signal(handle, TCOAP_RESPONSE_DID_RECEIVE);
+}
+
+
 /**
  * @brief Extract length of data from header for TCP packet (payload + options)
  *
@@ -422,6 +1119,163 @@ static uint32_t extract_data_length(tcoap_tcp_header * const header, const uint8
 }
 
 
+/**
+ * @brief Calculate size of the extended length field of header for TCP packet
+ *
+ * @param data_len - length of data (options + payload)
+ *
+ * @return size of the extended length field
+ */
+static uint32_t calc_ext_length_size(const uint32_t data_len)
+{
+    if (data_len < TCOAP_TCP_LEN_MIN) {
+        return 0;
+    } else if (data_len < TCOAP_TCP_LEN_MED) {
+        return 1;
+    } else if (data_len < TCOAP_TCP_LEN_MAX) {
+        return 2;
+    }
+
+    return 4;
+}
+
+
+/**
+ * @brief Calculate full length of TCP packet by its header
+ *
+ * @param buf - pointer on the beginning of packet
+ * @param len - length of available data
+ *
+ * @return length of packet or 0 if header is not complete yet
+ */
+static uint32_t calc_frame_length(const uint8_t * const buf, const uint32_t len)
+{
+    tcoap_tcp_header header;
+    uint32_t idx;
+
+    if (!len) {
+        return 0;
+    }
+
+    header.len_header.byte = buf[0];
+    idx = calc_header_length(buf);
+
+    if (len < idx) {
+        return 0;
+    }
+
+    extract_data_length(&header, buf + 1);
+
+    /* length + code + token + options & payload */
+    return idx + 1 + header.len_header.fields.tkl + header.data_len;
+}
+
+
+/**
+ * @brief Calculate length of the Len/TKL byte and the extended length field
+ *
+ * @param buf - pointer on the beginning of packet (at least one byte)
+ *
+ * @return index of the code in the packet
+ */
+static uint32_t calc_header_length(const uint8_t * const buf)
+{
+    tcoap_tcp_len_header header;
+
+    header.byte = buf[0];
+
+    switch (header.fields.len) {
+        case TCOAP_TCP_LEN_1BYTE:
+            return 2;
+
+        case TCOAP_TCP_LEN_2BYTES:
+            return 3;
+
+        case TCOAP_TCP_LEN_4BYTES:
+            return 5;
+
+        default:
+            return 1;
+    }
+}
+
+
+/**
+ * @brief Write the Len/TKL byte and the extended length field
+ *
+ * @param buf - pointer on the beginning of packet
+ * @param tkl - length of token
+ * @param data_len - length of data (options + payload)
+ *
+ * @return length of written header (without code)
+ */
+static uint32_t write_length_header(uint8_t * const buf, const uint8_t tkl, const uint32_t data_len)
+{
+    tcoap_tcp_len_header header;
+    uint32_t idx;
+
+    header.fields.tkl = tkl;
+    idx = 1;
+
+    if (data_len < TCOAP_TCP_LEN_MIN) {
+        header.fields.len = data_len;
+    } else if (data_len < TCOAP_TCP_LEN_MED) {
+        header.fields.len = TCOAP_TCP_LEN_1BYTE;
+        buf[idx++] = data_len - TCOAP_TCP_LEN_MIN;
+    } else if (data_len < TCOAP_TCP_LEN_MAX) {
+        header.fields.len = TCOAP_TCP_LEN_2BYTES;
+        buf[idx++] = (data_len - TCOAP_TCP_LEN_MED) >> 8;
+        buf[idx++] = (data_len - TCOAP_TCP_LEN_MED);
+    } else {
+        header.fields.len = TCOAP_TCP_LEN_4BYTES;
+        buf[idx++] = (data_len - TCOAP_TCP_LEN_MAX) >> 24;
+        buf[idx++] = (data_len - TCOAP_TCP_LEN_MAX) >> 16;
+        buf[idx++] = (data_len - TCOAP_TCP_LEN_MAX) >> 8;
+        buf[idx++] = (data_len - TCOAP_TCP_LEN_MAX);
+    }
+
+    buf[0] = header.byte;
+
+    return idx;
+}
+
+
+#ifdef TCOAP_CAPTURE_ENABLED
+/**
+ * @brief Capture the message or its first part. The length of message of
+ *        CoAP over WebSockets is elided, so its length header is rebuilt,
+ *        otherwise the captured stream cannot be decoded.
+ *
+ * @param handle - coap handle
+ * @param dir - direction of message
+ * @param buf - pointer on the message
+ * @param len - length of the part in the buffer
+ * @param msg_len - length of the whole message (e.g. with produced payload)
+ *
+ */
+static void capture_message(tcoap_handle * const handle, const tcoap_capture_direction dir, const uint8_t * buf, const uint32_t len, const uint32_t msg_len)
+{
+    uint8_t header[5];
+    uint32_t tkl;
+
+    if (handle->transport != TCOAP_WS || len < TCOAP_MIN_TCP_HEADER_LEN) {
+        tcoap_capture_packet(handle, dir, buf, len);
+        return;
+    }
+
+    tkl = buf[0] & 0x0F;
+
+    if (msg_len < TCOAP_MIN_TCP_HEADER_LEN + tkl) {
+        tcoap_capture_packet(handle, dir, buf, len);
+        return;
+    }
+
+    /* the first byte (Len = 0, TKL) is replaced by the Len/TKL byte and the extended length */
+    tcoap_capture_prefixed(handle, dir, header, write_length_header(header, tkl, msg_len - TCOAP_MIN_TCP_HEADER_LEN - tkl), buf + 1, len - 1);
+}
+#endif /* TCOAP_CAPTURE_ENABLED */
+
+
 /**
  * @brief Shift the data in the packet if we did predict a wrong length
  *
@@ -38,7 +38,79 @@ extern "C" {
 
 
 /**
- * @brief Send a CoAP packet over TCP. Do not use it directly.
+ * Incremental framer of CoAP over TCP stream. It detects boundaries of frames
+ * by the length field of header and delivers whole frames to the handle
+ * (through 'tcoap_rx_packet') as soon as the last byte of frame is received,
+ * so detecting of the end of packet by byte-timeout is not needed.
+ *
+ * A response which does not fit into the buffer (or into the PDU) is streamed
+ * if the request has the 'payload_chunk_callback': the head of response (header,
+ * token and options) is collected into the buffer, the payload is passed to the
+ * callback without copying. Otherwise such frame is dropped.
+ *
+ */
+typedef struct tcoap_tcp_framer {
+
+    tcoap_handle * handle;
+
+    uint8_t * buf;           /* buffer for frames which are split across chunks */
+    uint32_t size;           /* size of buffer, frames longer than it are dropped */
+
+    uint32_t len;            /* collected bytes of the current frame */
+    uint32_t frame_len;      /* length of the current frame, 0 if header is not complete yet */
+    bool drop;               /* the current frame is too long and is being dropped */
+
+    bool stream;             /* the payload of current frame is being streamed */
+    uint32_t head_len;       /* length of head of the streamed frame (up to the payload marker) */
+    uint32_t offset;         /* offset of the next chunk of streamed payload */
+
+} tcoap_tcp_framer;
+
+
+/**
+ * @brief Init framer of CoAP over TCP stream
+ *
+ * @param framer - pointer on the framer
+ * @param handle - coap handle, frames are delivered to it
+ * @param buf - buffer for assembling frames (minimum 6 bytes), it is not used
+ *              if every frame arrives within one chunk. For streaming it should
+ *              be large enough for the head of response (header, token, options)
+ * @param size - size of buffer
+ *
+ */
+void tcoap_tcp_framer_init(tcoap_tcp_framer * const framer, tcoap_handle * const handle, uint8_t * const buf, const uint32_t size);
+
+
+/**
+ * @brief Feed a chunk of TCP stream (of any length) to the framer. There may be
+ *        several frames in one chunk as well as a frame may be split across chunks.
+ *
+ * @param framer - pointer on the framer
+ * @param chunk - pointer on received data
+ * @param len - length of received data
+ *
+ * @return status of operation ('TCOAP_RX_BUFF_FULL_ERROR' if some frame was dropped)
+ */
+tcoap_error tcoap_tcp_framer_feed(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len);
+
+
+/**
+ * @brief Feed a chunk of TCP stream to the framer up to the end of the first
+ *        frame. It allows to process the delivered frame (e.g. the response)
+ *        before the next one overwrites the rx buffer of handle.
+ *
+ * @param framer - pointer on the framer
+ * @param chunk - pointer on received data
+ * @param len - length of received data
+ * @param err - in this variable will be stored status of operation
+ *
+ * @return number of consumed bytes, the rest should be fed later
+ */
+uint32_t tcoap_tcp_framer_feed_frame(tcoap_tcp_framer * const framer, const uint8_t * chunk, const uint32_t len, tcoap_error * const err);
+
+
+/**
+ * @brief Send a CoAP packet over TCP (or WebSockets). Do not use it directly.
  *
  * @param handle - coap handle
  * @param reqd - descriptor of request
@@ -48,6 +120,33 @@ extern "C" {
 tcoap_error tcoap_send_coap_request_tcp(tcoap_handle * const handle, const tcoap_request_descriptor * const reqd);
 
 
+/**
+ * @brief Send the Pong signal. Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param token - token of the Ping
+ * @param tkl - length of token
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_send_pong_tcp(tcoap_handle * const handle, const uint8_t * token, const uint32_t tkl);
+
+
+#ifdef TCOAP_LIVENESS_ENABLED
+/**
+ * @brief Remember the Ping of server which was received between exchanges,
+ *        the Pong is sent later by 'tcoap_keepalive'. Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param buf - pointer on received packet
+ * @param len - length of packet
+ *
+ * @return true if the packet is the Ping
+ */
+bool tcoap_tcp_catch_ping(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,211 @@
+/**
+ * tcoap_tx_queue.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_tx_queue.h"
+#include "tcoap_utils.h"
+
+
+#ifdef TCOAP_TX_QUEUE_ENABLED
+
+
+#define TCOAP_TX_QUEUE_MASK             (TCOAP_TX_QUEUE_LEN - 1)
+
+
+static void kick(tcoap_handle * const handle, tcoap_tx_queue * const queue);
+static tcoap_error take_error(tcoap_tx_queue * const queue);
+static void reset(tcoap_tx_queue * const queue);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_tx_queue_init(tcoap_tx_queue * const queue)
+{
+    reset(queue);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+const tcoap_tx_desc * tcoap_tx_queue_complete(tcoap_tx_queue * const queue, const tcoap_error status)
+{
+    if (status != TCOAP_OK) {
+        TCOAP_TX_QUEUE_CAS(&queue->error, TCOAP_OK, status);
+    }
+
+    TCOAP_TX_QUEUE_BARRIER();
+
+    queue->tail++;
+
+    TCOAP_TX_QUEUE_BARRIER();
+
+    if (queue->tail != queue->head) {
+        return &queue->desc[queue->tail & TCOAP_TX_QUEUE_MASK];
+    }
+
+    queue->busy = 0;
+
+    TCOAP_TX_QUEUE_BARRIER();
+
+    /* the task could queue a descriptor after the check and see the driver busy */
+    if (queue->tail != queue->head && TCOAP_TX_QUEUE_CAS(&queue->busy, 0, 1)) {
+        return &queue->desc[queue->tail & TCOAP_TX_QUEUE_MASK];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_tx_queue_submit(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    tcoap_tx_queue * queue;
+    tcoap_tx_desc * desc;
+    tcoap_error err;
+
+    queue = handle->tx_queue;
+
+    /* the retransmission reuses the descriptor which is not sent yet */
+    if (queue->head != queue->tail) {
+        desc = &queue->desc[(queue->head - 1) & TCOAP_TX_QUEUE_MASK];
+
+        if (desc->buf == buf && desc->len == len) {
+            return take_error(queue);
+        }
+    }
+
+    while (queue->head - queue->tail >= TCOAP_TX_QUEUE_LEN) {
+        err = tcoap_wait_tx(handle);
+
+        if (err != TCOAP_OK) {
+            reset(queue);
+            return err;
+        }
+    }
+
+    desc = &queue->desc[queue->head & TCOAP_TX_QUEUE_MASK];
+
+    desc->buf = buf;
+    desc->len = len;
+
+    TCOAP_TX_QUEUE_BARRIER();
+
+    queue->head++;
+
+    TCOAP_TX_QUEUE_BARRIER();
+
+    kick(handle, queue);
+
+    return take_error(queue);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_tx_queue_drain(tcoap_handle * const handle)
+{
+    tcoap_tx_queue * queue;
+    tcoap_error err;
+
+    queue = handle->tx_queue;
+
+    while (queue->tail != queue->head) {
+        err = tcoap_wait_tx(handle);
+
+        if (err != TCOAP_OK) {
+            reset(queue);
+            return err;
+        }
+    }
+
+    TCOAP_TX_QUEUE_BARRIER();
+
+    return take_error(queue);
+}
+
+
+
+/**
+ * @brief Start the driver if it is idle. The task owns the driver until the
+ *        transfer is started, a descriptor which cannot be started is
+ *        completed with the error.
+ *
+ * @param handle - coap handle
+ * @param queue - pointer on the queue
+ *
+ */
+static void kick(tcoap_handle * const handle, tcoap_tx_queue * const queue)
+{
+    const tcoap_tx_desc * desc;
+    tcoap_error err;
+
+    if (!TCOAP_TX_QUEUE_CAS(&queue->busy, 0, 1)) {
+        return;   /* the driver starts the descriptor when the current transfer is completed */
+    }
+
+    desc = &queue->desc[queue->tail & TCOAP_TX_QUEUE_MASK];
+
+    while (desc != NULL) {
+        err = tcoap_tx_start(handle, desc);
+
+        if (err == TCOAP_OK) {
+            break;
+        }
+
+        desc = tcoap_tx_queue_complete(queue, err);
+    }
+}
+
+
+/**
+ * @brief Get the error of a failed transfer and clear it
+ *
+ * @param queue - pointer on the queue
+ *
+ * @return the first error since the last call
+ */
+static tcoap_error take_error(tcoap_tx_queue * const queue)
+{
+    tcoap_error err;
+
+    err = queue->error;
+
+    if (err != TCOAP_OK) {
+        TCOAP_TX_QUEUE_CAS(&queue->error, err, TCOAP_OK);
+    }
+
+    return err;
+}
+
+
+/**
+ * @brief Forget all descriptors, the driver should be stopped
+ *
+ */
+static void reset(tcoap_tx_queue * const queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+    queue->busy = 0;
+    queue->error = TCOAP_OK;
+
+    TCOAP_TX_QUEUE_BARRIER();
+}
+
+
+#endif /* TCOAP_TX_QUEUE_ENABLED */
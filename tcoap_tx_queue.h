@@ -0,0 +1,144 @@
+/**
+ * tcoap_tx_queue.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: asynchronous transmission for DMA-driven drivers (UART, radio).
+ *       Without the queue 'tcoap_tx_data' has to send the data before it
+ *       returns, so the CPU waits for a slow line. With the queue attached to
+ *       the handle ('tx_queue'), the library puts messages into descriptors
+ *       and hands them to the driver by 'tcoap_tx_start', then it goes on
+ *       (e.g. sleeps in 'tcoap_wait_event') while the bytes go out. The
+ *       driver reports the end of each transfer by 'tcoap_tx_queue_complete'
+ *       from its interrupt and gets the next descriptor to start, so queued
+ *       messages are chained without the task.
+ *
+ *       A buffer stays untouched by the library while its descriptor is
+ *       queued: before the tx buffer is reused (options of response are
+ *       decoded into it, ACK is assembled in it, the next part of produced
+ *       payload or SMS is put into it) or freed, the library waits for the
+ *       transfers by 'tcoap_wait_tx'. A retransmission of a message which is
+ *       still queued (the line is slower than the ACK timeout) is not queued
+ *       again.
+ *
+ *       Pong signals, control frames of WebSocket and headers of WebSocket
+ *       frames are built on the stack, so they are sent by 'tcoap_tx_data'
+ *       after the queue is drained. Control frames of WebSocket are answered
+ *       from the context which feeds 'tcoap_ws_receiver', so 'tcoap_wait_tx'
+ *       may be called from there as well (see 'tcoap_ws.h').
+ *
+ *       There should be only one task which sends requests by the handle and
+ *       only one driver which completes the transfers.
+ *
+ *       It is compiled only if 'TCOAP_TX_QUEUE_ENABLED' is defined.
+ *
+ */
+
+
+#ifndef __TCOAP_TX_QUEUE_H
+#define __TCOAP_TX_QUEUE_H
+
+
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifdef TCOAP_TX_QUEUE_ENABLED
+
+
+#ifndef TCOAP_TX_QUEUE_LEN
+#define TCOAP_TX_QUEUE_LEN              4         /* descriptors, a power of two */
+#endif /* TCOAP_TX_QUEUE_LEN */
+
+/* orders accesses to descriptors and to indexes of queue */
+#ifndef TCOAP_TX_QUEUE_BARRIER
+#define TCOAP_TX_QUEUE_BARRIER()        __sync_synchronize()
+#endif /* TCOAP_TX_QUEUE_BARRIER */
+
+/* the task and the interrupt of driver compete for starting of the driver */
+#ifndef TCOAP_TX_QUEUE_CAS
+#define TCOAP_TX_QUEUE_CAS(p,o,n)       __sync_bool_compare_and_swap((p), (o), (n))
+#endif /* TCOAP_TX_QUEUE_CAS */
+
+
+typedef struct tcoap_tx_desc {
+
+    const uint8_t * buf;
+    uint32_t len;
+
+} tcoap_tx_desc;
+
+
+typedef struct tcoap_tx_queue {
+
+    tcoap_tx_desc desc[TCOAP_TX_QUEUE_LEN];
+
+    volatile uint32_t head;        /* the next descriptor to queue, it is written by the task only */
+    volatile uint32_t tail;        /* the descriptor being transferred, it is written by the owner of 'busy' only */
+    volatile uint32_t busy;        /* the driver is owned: the descriptor at 'tail' is being started or transferred */
+
+    volatile tcoap_error error;    /* the first failed transfer since the last waiting */
+
+} tcoap_tx_queue;
+
+
+/**
+ * @brief Init the queue. It should be assigned to 'tx_queue' of handle to send
+ *        through it, NULL returns to the synchronous 'tcoap_tx_data'.
+ *
+ * @param queue - pointer on the queue
+ *
+ */
+void tcoap_tx_queue_init(tcoap_tx_queue * const queue);
+
+
+/**
+ * @brief Report the end of transfer of the descriptor which was started the
+ *        last one (driver, e.g. from the interrupt of DMA). The returned
+ *        descriptor should be started by the driver in the same way, if it
+ *        cannot be started, it should be completed with the error.
+ *
+ * @param queue - pointer on the queue
+ * @param status - result of transfer
+ *
+ * @return the next descriptor which should be started by the driver, NULL if
+ *         there is no one
+ */
+const tcoap_tx_desc * tcoap_tx_queue_complete(tcoap_tx_queue * const queue, const tcoap_error status);
+
+
+/**
+ * @brief Queue a message. Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param buf - pointer on the message, it should not be changed until the transfer is completed
+ * @param len - length of the message
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_tx_queue_submit(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
+
+
+/**
+ * @brief Wait until all queued messages are sent. Do not use it directly.
+ *
+ * @param handle - coap handle
+ *
+ * @return status of operation, the error of a failed transfer (if any)
+ */
+tcoap_error tcoap_tx_queue_drain(tcoap_handle * const handle);
+
+
+#endif /* TCOAP_TX_QUEUE_ENABLED */
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_TX_QUEUE_H */
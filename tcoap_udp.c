@@ -8,11 +8,23 @@
 
 
 #include "tcoap_udp.h"
+#include "tcoap_sms.h"
 #include "tcoap_utils.h"
 
 
 #define TCOAP_RESPONSE_CODE(buf)     ((buf)[1])
 
+/* the SMS bearer carries the same messages, but its latency is much higher */
+#ifdef TCOAP_SMS_ENABLED
+#define TCOAP_UDP_RESP_TIMEOUT(h)    ((h)->transport == TCOAP_SMS ? TCOAP_SMS_RESP_TIMEOUT_MS : TCOAP_RESP_TIMEOUT_MS)
+#define TCOAP_UDP_ACK_TIMEOUT(h)     ((h)->transport == TCOAP_SMS ? TCOAP_SMS_ACK_TIMEOUT_MS : TCOAP_ACK_TIMEOUT_MS)
+#define TCOAP_UDP_MAX_RETRANSMIT(h)  ((h)->transport == TCOAP_SMS ? TCOAP_SMS_MAX_RETRANSMIT : TCOAP_MAX_RETRANSMIT)
+#else
+#define TCOAP_UDP_RESP_TIMEOUT(h)    TCOAP_RESP_TIMEOUT_MS
+#define TCOAP_UDP_ACK_TIMEOUT(h)     TCOAP_ACK_TIMEOUT_MS
+#define TCOAP_UDP_MAX_RETRANSMIT(h)  TCOAP_MAX_RETRANSMIT
+#endif /* TCOAP_SMS_ENABLED */
+
 
 /**
  * @brief CoAP header data struct
@@ -34,7 +46,9 @@ typedef struct {
 static void asemble_request(tcoap_handle * const handle, tcoap_data * const request, const tcoap_request_descriptor * const reqd);
 static uint32_t parse_response(const tcoap_data * const request, const tcoap_data * const response);
 static void asemble_ack(tcoap_data * const ack, const tcoap_data * const response);
-static tcoap_error waiting_ack(tcoap_handle * const handle, const tcoap_data * const request);
+static bool skip_stray(tcoap_handle * const handle, const uint32_t resp_mask);
+static tcoap_error waiting_ack(tcoap_handle * const handle, const tcoap_data * const request, uint32_t * const retransmition);
+static tcoap_error tx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len);
 
 
 
@@ -46,11 +60,24 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
 {
     tcoap_error err;
     uint32_t resp_mask;
+    uint32_t retransmition;
     tcoap_result_data result;
 
+    /* a datagram is sent at once, the 'payload_writer' should be used instead */
+    if (reqd->payload_producer != NULL) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+#ifdef TCOAP_SMS_ENABLED
+    /* segments left from the previous exchange are not in the new rx buffer */
+    handle->sms_segments = 0;
+#endif /* TCOAP_SMS_ENABLED */
+
     /* assembling packet */
     asemble_request(handle, &handle->request, reqd);
 
+    TCOAP_TRACE(handle, TCOAP_TRACE_ASSEMBLED);
+
     /* debug support */
     if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
         tcoap_debug_print_packet(handle, "coap >> ", handle->request.buf, handle->request.len);
@@ -59,33 +86,52 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
     /* sending packet */
     tcoap_tx_signal(handle, TCOAP_ROUTINE_PACKET_WILL_START);
 
-    err = tcoap_tx_data(handle, handle->request.buf, handle->request.len);
+    err = tx_packet(handle, handle->request.buf, handle->request.len);
 
     if (err != TCOAP_OK) {
         return err;
     }
 
+    TCOAP_TRACE(handle, TCOAP_TRACE_SENT);
+
     /* waiting ack if needed */
     resp_mask = TCOAP_RESP_EMPTY;
     if (reqd->type == TCOAP_MESSAGE_CON) {
 
-        TCOAP_SET_STATUS(handle, TCOAP_WAITING_RESP);
+        retransmition = 0;
 
-        err = waiting_ack(handle, &handle->request);
+        do {
+            handle->response.len = 0;
+            TCOAP_SET_STATUS(handle, TCOAP_WAITING_RESP);
 
-        TCOAP_RESET_STATUS(handle, TCOAP_WAITING_RESP);
+            err = waiting_ack(handle, &handle->request, &retransmition);
 
-        if (err != TCOAP_OK) {
-            return err;
-        }
+            TCOAP_RESET_STATUS(handle, TCOAP_WAITING_RESP);
 
-        /* debug support */
-        if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
-            tcoap_debug_print_packet(handle, "coap << ", handle->response.buf, handle->response.len);
-        }
+            if (err != TCOAP_OK) {
+                if (err == TCOAP_TIMEOUT_ERROR) {
+                    TCOAP_STATS_INC(handle, ack_timeouts);
+                }
+
+                return err;
+            }
+
+            TCOAP_CAPTURE(handle, TCOAP_CAPTURE_RX, handle->response.buf, handle->response.len);
+
+            /* debug support */
+            if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
+                tcoap_debug_print_packet(handle, "coap << ", handle->response.buf, handle->response.len);
+            }
 
-        /* parsing incoming ack packet */
-        resp_mask = parse_response(&handle->request, &handle->response);
+            /* parsing incoming ack packet */
+            resp_mask = parse_response(&handle->request, &handle->response);
+
+            TCOAP_TRACE(handle, TCOAP_TRACE_ACK_RECEIVED);
+
+            /* a message of another exchange (e.g. a late answer) does not end this one */
+        } while (skip_stray(handle, resp_mask));
+
+        TCOAP_STATS_ANSWERED(handle);
 
         if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_ACK)) {
 
@@ -93,12 +139,19 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
 
         } else if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_NRST)) {
 
+            /* RST is the expected answer to "CoAP ping" */
+            if (reqd->code != TCOAP_CODE_EMPTY_MSG) {
+                TCOAP_STATS_INC(handle, rsts);
+            }
+
             tcoap_tx_signal(handle, TCOAP_NRST_DID_RECEIVE);
             err = TCOAP_NRST_ANSWER;
 
             return err;
         } else if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_INVALID_PACKET)) {
 
+            TCOAP_STATS_INC(handle, invalid_packets);
+            TCOAP_STATS_INC(handle, rejects[TCOAP_REJECT_REASON(resp_mask)]);
             tcoap_tx_signal(handle, TCOAP_WRONG_PACKET_DID_RECEIVE);
             err = TCOAP_NO_ACK_ERROR;
 
@@ -109,35 +162,54 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
     /* waiting response if needed */
     if (reqd->response_callback != NULL) {
 
-        if (reqd->type != TCOAP_MESSAGE_CON || !TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_PIGGYBACKED)) {
+        /* the separate response may arrive before the Empty ACK (if the ACK is lost) */
+        if (!TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_PIGGYBACKED | TCOAP_RESP_SEPARATE)) {
 
-            handle->response.len = 0;
-            TCOAP_SET_STATUS(handle, TCOAP_WAITING_RESP);
+            do {
+                handle->response.len = 0;
+                TCOAP_SET_STATUS(handle, TCOAP_WAITING_RESP);
 
-            /* waiting either data arriving or timeout expiring */
-            err = tcoap_wait_event(handle, TCOAP_RESP_TIMEOUT_MS);
+                /* waiting either data arriving or timeout expiring */
+                err = tcoap_wait_event(handle, TCOAP_UDP_RESP_TIMEOUT(handle));
 
-            TCOAP_RESET_STATUS(handle, TCOAP_WAITING_RESP);
+                TCOAP_RESET_STATUS(handle, TCOAP_WAITING_RESP);
 
-            if (err != TCOAP_OK) {
-                return err;
-            }
+                if (err != TCOAP_OK) {
+                    if (err == TCOAP_TIMEOUT_ERROR) {
+                        TCOAP_STATS_INC(handle, resp_timeouts);
+                    }
 
-            /* debug support */
-            if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
-                tcoap_debug_print_packet(handle, "rcv coap << ", handle->response.buf, handle->response.len);
-            }
+                    return err;
+                }
 
-            resp_mask = parse_response(&handle->request, &handle->response);
+                TCOAP_CAPTURE(handle, TCOAP_CAPTURE_RX, handle->response.buf, handle->response.len);
+
+                /* debug support */
+                if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
+                    tcoap_debug_print_packet(handle, "rcv coap << ", handle->response.buf, handle->response.len);
+                }
+
+                resp_mask = parse_response(&handle->request, &handle->response);
+
+                TCOAP_TRACE(handle, TCOAP_TRACE_RESPONSE_RECEIVED);
+
+                /* a duplicate of the Empty ACK is not the response as well */
+            } while (skip_stray(handle, resp_mask)
+                    || (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_ACK) && !TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_PIGGYBACKED)));
+
+            TCOAP_STATS_ANSWERED(handle);
 
             if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_INVALID_PACKET)) {
 
+                TCOAP_STATS_INC(handle, invalid_packets);
+                TCOAP_STATS_INC(handle, rejects[TCOAP_REJECT_REASON(resp_mask)]);
                 tcoap_tx_signal(handle, TCOAP_WRONG_PACKET_DID_RECEIVE);
                 err = TCOAP_NO_RESP_ERROR;
 
                 return err;
             } else if (TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_NRST)) {
 
+                TCOAP_STATS_INC(handle, rsts);
                 tcoap_tx_signal(handle, TCOAP_NRST_DID_RECEIVE);
                 err = TCOAP_NRST_ANSWER;
 
@@ -147,13 +219,20 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
 
         /* We are using the same request buffer for storing incoming options, bcoz
          * outgoing packet is not needed already. It allows us to save ram-memory.
+         * The packet may be still in the tx queue, the result is not important:
+         * the answer is received.
          */
+        (void)TCOAP_TX_DRAIN(handle);
+
         err = decoding_options(&handle->response,
                 (tcoap_option_data *)handle->request.buf,
                 ((handle->response.buf[0] & 0x0F) + 4),
                 &handle->request.len);
 
+        TCOAP_TRACE(handle, TCOAP_TRACE_OPTIONS_DECODED);
+
         if (err == TCOAP_WRONG_OPTIONS_ERROR) {
+            TCOAP_STATS_INC(handle, rejects[TCOAP_REJECT_OPTIONS]);
             return err;
         }
 
@@ -169,8 +248,13 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
         result.resp_code = TCOAP_RESPONSE_CODE(handle->response.buf);
         result.options = err == TCOAP_NO_OPTIONS_ERROR ? NULL : (tcoap_option_data *)handle->request.buf;
 
+        /* options are not mandatory */
+        err = TCOAP_OK;
+
         reqd->response_callback(reqd, &result);
 
+        TCOAP_TRACE(handle, TCOAP_TRACE_CALLBACK_DONE);
+
         /* debug support */
         if (TCOAP_CHECK_STATUS(handle, TCOAP_DEBUG_ON)) {
             tcoap_debug_print_options(handle, "coap opt << ", result.options);
@@ -183,7 +267,7 @@ tcoap_error tcoap_send_coap_request_udp(tcoap_handle * const handle, const tcoap
             asemble_ack(&handle->request, &handle->response);
             tcoap_tx_signal(handle, TCOAP_TX_ACK_PACKET);
 
-            err = tcoap_tx_data(handle, handle->request.buf, handle->request.len);
+            err = tx_packet(handle, handle->request.buf, handle->request.len);
         }
     }
 
@@ -218,14 +302,25 @@ static void asemble_request(tcoap_handle * const handle, tcoap_data * const requ
         request->len += reqd->tkl;
     }
 
-    /* assemble options */
-    if (reqd->options != NULL) {
-        request->len += encoding_options(request->buf + request->len, reqd->options);
+    /* assemble precompiled options and payload */
+    if (reqd->tpl != NULL) {
+        request->len += fill_template(request->buf + request->len, reqd);
+    } else {
+
+        /* assemble options */
+        if (reqd->options != NULL) {
+            request->len += encoding_options(request->buf + request->len, reqd->options);
+        }
+
+        /* assemble payload */
+        if (reqd->payload.len && reqd->payload_writer == NULL) {
+            request->len += fill_payload(request->buf + request->len, &reqd->payload);
+        }
     }
 
-    /* assemble payload */
-    if (reqd->payload.len) {
-        request->len += fill_payload(request->buf + request->len, &reqd->payload);
+    /* assemble payload in place */
+    if (reqd->payload_writer != NULL) {
+        request->len += write_payload(request->buf + request->len, reqd, TCOAP_MAX_PDU_SIZE - request->len);
     }
 
     /* copy header */
@@ -255,8 +350,11 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
 
     tcoap_udp_header resp_header;
     tcoap_udp_header req_header;
+    tcoap_reject_reason reason;
     uint32_t resp_mask;
 
+    reason = TCOAP_REJECT_SHORT;
+
     /* check on header */
     if (response->len > 3) {
 
@@ -266,6 +364,7 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
 
         /* do fast checking */
         if (resp_header.vers != req_header.vers) {
+            reason = TCOAP_REJECT_VERSION;
             goto return_err_label;
         }
 
@@ -276,6 +375,7 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
                 TCOAP_SET_RESP(resp_mask, TCOAP_RESP_ACK);
 
                 if (resp_header.mid != req_header.mid) {
+                    reason = TCOAP_REJECT_MID;
                     goto return_err_label;
                 }
 
@@ -285,6 +385,7 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
                     if (!resp_header.tkl && response->len == 4) {
                         return resp_mask;
                     } else {
+                        reason = TCOAP_REJECT_EMPTY;
                         goto return_err_label;
                     }
                 }
@@ -300,36 +401,43 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
                 break;
 
             case TCOAP_MESSAGE_RST:
-                if (resp_header.code == TCOAP_CODE_EMPTY_MSG && !resp_header.tkl && response->len == 4) {
+                if (resp_header.code == TCOAP_CODE_EMPTY_MSG && !resp_header.tkl && response->len == 4
+                        && resp_header.mid == req_header.mid) {
                     TCOAP_SET_RESP(resp_mask, TCOAP_RESP_NRST);
                     return resp_mask;
                 } else {
+                    reason = resp_header.mid != req_header.mid ? TCOAP_REJECT_MID : TCOAP_REJECT_EMPTY;
                     goto return_err_label;
                 }
 
             default:
+                reason = TCOAP_REJECT_TYPE;
                 goto return_err_label;
         }
 
         /* if it is a separate response (msg id's should not be equals) */
         if (!TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_ACK)) {
             if (resp_header.mid == req_header.mid) {
+                reason = TCOAP_REJECT_MID;
                 goto return_err_label;
             }
         }
 
         /* tkl's should be equals */
         if (resp_header.tkl != req_header.tkl) {
+            reason = TCOAP_REJECT_TKL;
             goto return_err_label;
         }
 
         /* check length of msg */
         if (response->len < (uint32_t)(4 + resp_header.tkl)) {
+            reason = TCOAP_REJECT_SHORT;
             goto return_err_label;
         }
 
         /* check tokens */
         if (!mem_cmp(response->buf + 4, request->buf + 4, resp_header.tkl)) {
+            reason = TCOAP_REJECT_TOKEN;
             goto return_err_label;
         }
 
@@ -337,6 +445,7 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
         if (TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_SUCCESS_CLASS
                 && TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_BAD_REQUEST_CLASS
                 && TCOAP_EXTRACT_CLASS(resp_header.code) != TCOAP_SERVER_ERR_CLASS) {
+            reason = TCOAP_REJECT_CODE;
             goto return_err_label;
         }
 
@@ -354,7 +463,7 @@ static uint32_t parse_response(const tcoap_data * const request, const tcoap_dat
 return_err_label:
 /***********/
 
-    resp_mask = TCOAP_RESP_INVALID_PACKET;
+    resp_mask = TCOAP_RESP_REJECT(reason);
     return resp_mask;
 }
 
@@ -370,7 +479,7 @@ static void asemble_ack(tcoap_data * const ack, const tcoap_data * const respons
     tcoap_udp_header ack_header;
 
     /* get header from incoming packet */
-    mem_copy(&ack_header, response, sizeof(tcoap_udp_header));
+    mem_copy(&ack_header, response->buf, sizeof(tcoap_udp_header));
 
     /* assemble header */
     ack_header.type = TCOAP_MESSAGE_ACK;
@@ -383,30 +492,83 @@ static void asemble_ack(tcoap_data * const ack, const tcoap_data * const respons
 }
 
 
+/**
+ * @brief Skip a message of another exchange, e.g. a separate response of the
+ *        previous request which is retransmitted because its ACK was lost, or
+ *        a late ACK. A CON is acknowledged (rfc7252 4.5), so the server stops
+ *        retransmitting it. The awaited answer is waited for again.
+ *
+ * @param handle - coap handle
+ * @param resp_mask - result of parsing of the received message
+ *
+ * @return true if the message was skipped
+ */
+static bool skip_stray(tcoap_handle * const handle, const uint32_t resp_mask)
+{
+    tcoap_udp_header header;
+    uint8_t ack_buf[sizeof(tcoap_udp_header)];
+    tcoap_data ack;
+
+    if (!TCOAP_CHECK_RESP(resp_mask, TCOAP_RESP_INVALID_PACKET)) {
+        return false;
+    }
+
+    switch (TCOAP_REJECT_REASON(resp_mask)) {
+        case TCOAP_REJECT_MID:
+        case TCOAP_REJECT_TKL:
+        case TCOAP_REJECT_TOKEN:
+            break;
+
+        default:
+            /* a malformed message ends the exchange */
+            return false;
+    }
+
+    TCOAP_STATS_INC(handle, invalid_packets);
+    TCOAP_STATS_INC(handle, rejects[TCOAP_REJECT_REASON(resp_mask)]);
+    tcoap_tx_signal(handle, TCOAP_WRONG_PACKET_DID_RECEIVE);
+
+    mem_copy(&header, handle->response.buf, sizeof(tcoap_udp_header));
+
+    if (header.type == TCOAP_MESSAGE_CON) {
+        ack.buf = ack_buf;
+        asemble_ack(&ack, &handle->response);
+
+        tcoap_tx_signal(handle, TCOAP_TX_ACK_PACKET);
+
+        /* the ACK is on the stack, so it should be sent before return */
+        if (tx_packet(handle, ack.buf, ack.len) == TCOAP_OK) {
+            (void)TCOAP_TX_DRAIN(handle);
+        }
+    }
+
+    return true;
+}
+
 
 /**
  * @brief Waiting ACK functionality (retransmission and etc)
  *
  * @param handle - coap handle
  * @param request - outgoing packet
+ * @param retransmition - pointer on counter of retransmissions, it is kept
+ *                        while messages of other exchanges are skipped
  *
  * @return result of operation
  */
-static tcoap_error waiting_ack(tcoap_handle * const handle, const tcoap_data * const request)
+static tcoap_error waiting_ack(tcoap_handle * const handle, const tcoap_data * const request, uint32_t * const retransmition)
 {
     tcoap_error err;
-    uint32_t retransmition;
-
-    retransmition = 0;
 
     do {
 
-        err = tcoap_wait_event(handle, retransmition * ((TCOAP_ACK_TIMEOUT_MS * TCOAP_ACK_RANDOM_FACTOR) / 100) + TCOAP_ACK_TIMEOUT_MS);
+        err = tcoap_wait_event(handle, *retransmition * ((TCOAP_UDP_ACK_TIMEOUT(handle) * TCOAP_ACK_RANDOM_FACTOR) / 100) + TCOAP_UDP_ACK_TIMEOUT(handle));
 
         if (err == TCOAP_TIMEOUT_ERROR) {
 
-            if (retransmition < TCOAP_MAX_RETRANSMIT) {
+            if (*retransmition < TCOAP_UDP_MAX_RETRANSMIT(handle)) {
                 /* retransmission */
+                TCOAP_STATS_INC(handle, retransmissions);
                 tcoap_tx_signal(handle, TCOAP_TX_RETR_PACKET);
 
                 /* debug support */
@@ -414,12 +576,16 @@ static tcoap_error waiting_ack(tcoap_handle * const handle, const tcoap_data * c
                     tcoap_debug_print_packet(handle, "coap retr >> ", handle->request.buf, handle->request.len);
                 }
 
-                retransmition++;
-                err = tcoap_tx_data(handle, request->buf, request->len);
+                (*retransmition)++;
+                TCOAP_SET_STATUS(handle, TCOAP_RETRANSMITTED);
+
+                err = tx_packet(handle, request->buf, request->len);
 
                 if (err != TCOAP_OK) {
                     break;
                 }
+
+                TCOAP_TRACE(handle, TCOAP_TRACE_RETRANSMITTED);
             } else {
                 break;
             }
@@ -431,3 +597,26 @@ static tcoap_error waiting_ack(tcoap_handle * const handle, const tcoap_data * c
     return err;
 }
 
+
+/**
+ * @brief Transmit the packet by the bearer of handle
+ *
+ * @param handle - coap handle
+ * @param buf - pointer on the packet
+ * @param len - length of the packet
+ *
+ * @return result of operation
+ */
+static tcoap_error tx_packet(tcoap_handle * const handle, const uint8_t * buf, const uint32_t len)
+{
+    TCOAP_STATS_TX(handle, len, len);
+    TCOAP_CAPTURE(handle, TCOAP_CAPTURE_TX, buf, len);
+
+#ifdef TCOAP_SMS_ENABLED
+    if (handle->transport == TCOAP_SMS) {
+        return tcoap_sms_tx_packet(handle, buf, len);
+    }
+#endif /* TCOAP_SMS_ENABLED */
+
+    return TCOAP_TX(handle, buf, len);
+}
@@ -38,7 +38,8 @@ extern "C" {
 
 
 /**
- * @brief Send a CoAP packet over UDP. Do not use it directly.
+ * @brief Send a CoAP packet over UDP (or over SMS, see 'tcoap_sms.h').
+ *        Do not use it directly.
  *
  * @param handle - coap handle
  * @param reqd - descriptor of request
@@ -0,0 +1,445 @@
+/**
+ * tcoap_uri.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_uri.h"
+
+
+#define TCOAP_URI_SCHEME_LEN(s)      (sizeof(s) - 1)
+
+
+/**
+ * Auxiliary data structures
+ *
+ */
+typedef struct {
+
+    tcoap_option_data * options;
+    uint32_t options_num;
+    uint32_t options_cnt;
+
+    uint8_t * values;
+    uint32_t values_len;
+    uint32_t values_idx;
+
+} tcoap_uri_arena;
+
+
+
+static bool parse_scheme(tcoap_uri * const uri, const char * str, const uint32_t len);
+static bool is_scheme(const char * str, const uint32_t len, const char * scheme, const uint32_t scheme_len);
+static bool is_delimiter(const char c, const char * delimiters);
+static int8_t hex_to_nibble(const char c);
+static tcoap_option_data * add_option(tcoap_uri * const uri, tcoap_uri_arena * const arena, const uint16_t num);
+static tcoap_error decode_component(tcoap_uri_arena * const arena, tcoap_option_data * const option, const char * str, const uint32_t len, const bool lowercase);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_parse_uri(tcoap_uri * const uri,
+        const char * str,
+        const uint32_t len,
+        tcoap_option_data * const options,
+        const uint32_t options_num,
+        uint8_t * const values,
+        const uint32_t values_len)
+{
+    tcoap_error err;
+    tcoap_uri_arena arena;
+    tcoap_option_data * option;
+
+    uint32_t idx;
+    uint32_t start;
+    uint32_t port;
+    uint16_t default_port;
+    bool explicit_port;
+    bool ip_host;
+
+    arena.options = options;
+    arena.options_num = options_num;
+    arena.options_cnt = 0;
+    arena.values = values;
+    arena.values_len = values_len;
+    arena.values_idx = 0;
+
+    uri->options = NULL;
+    uri->host.buf = NULL;
+    uri->host.len = 0;
+
+    /* scheme and "://" */
+    for (idx = 0; idx < len && str[idx] != ':'; idx++);
+
+    if (idx + 2 >= len || str[idx + 1] != '/' || str[idx + 2] != '/') {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    if (!parse_scheme(uri, str, idx)) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    default_port = uri->port;
+
+    idx += 3;
+    start = idx;
+
+    /* host */
+    if (idx < len && str[idx] == '[') {
+
+        /* IP-literal, rfc7252 6.4 (5): the Uri-Host option is not needed */
+        for (idx += 1; idx < len && str[idx] != ']'; idx++);
+
+        if (idx == len) {
+            return TCOAP_PARAM_ERROR;
+        }
+
+        uri->host.buf = (uint8_t *)(str + start + 1);
+        uri->host.len = idx - start - 1;
+
+        idx++;
+        ip_host = true;
+
+    } else {
+
+        ip_host = true;
+
+        for (; idx < len && !is_delimiter(str[idx], ":/?#"); idx++) {
+            if ((str[idx] < '0' || str[idx] > '9') && str[idx] != '.') {
+                ip_host = false;
+            }
+        }
+
+        uri->host.buf = (uint8_t *)(str + start);
+        uri->host.len = idx - start;
+    }
+
+    if (!uri->host.len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    if (!ip_host) {
+        option = add_option(uri, &arena, TCOAP_URI_HOST_OPT);
+
+        if (option == NULL) {
+            return TCOAP_NO_FREE_MEM_ERROR;
+        }
+
+        err = decode_component(&arena, option, (const char *)uri->host.buf, uri->host.len, true);
+
+        if (err != TCOAP_OK) {
+            return err;
+        }
+    }
+
+    /* port */
+    explicit_port = false;
+
+    if (idx < len && str[idx] == ':') {
+        port = 0;
+
+        for (idx += 1; idx < len && !is_delimiter(str[idx], "/?#"); idx++) {
+            if (str[idx] < '0' || str[idx] > '9') {
+                return TCOAP_PARAM_ERROR;
+            }
+
+            port = port * 10 + (str[idx] - '0');
+
+            if (port > 0xFFFF) {
+                return TCOAP_PARAM_ERROR;
+            }
+
+            explicit_port = true;
+        }
+
+        if (explicit_port) {
+            uri->port = port;
+        }
+    }
+
+    /* rfc7252 6.4 (6): the Uri-Port option is needed only for a non-default port */
+    if (explicit_port && uri->port != default_port) {
+        option = add_option(uri, &arena, TCOAP_URI_PORT_OPT);
+
+        if (option == NULL || arena.values_idx + 2 > arena.values_len) {
+            return TCOAP_NO_FREE_MEM_ERROR;
+        }
+
+        if (uri->port > 0xFF) {
+            arena.values[arena.values_idx + option->len++] = uri->port >> 8;
+        }
+
+        if (uri->port) {
+            arena.values[arena.values_idx + option->len++] = uri->port;
+        }
+
+        arena.values_idx += option->len;
+    }
+
+    /* path, rfc7252 6.4 (8): empty path and "/" do not produce the Uri-Path option */
+    if (idx < len && str[idx] == '/' && !(idx + 1 == len || is_delimiter(str[idx + 1], "?#"))) {
+
+        do {
+            start = ++idx;
+
+            for (; idx < len && !is_delimiter(str[idx], "/?#"); idx++);
+
+            option = add_option(uri, &arena, TCOAP_URI_PATH_OPT);
+
+            if (option == NULL) {
+                return TCOAP_NO_FREE_MEM_ERROR;
+            }
+
+            err = decode_component(&arena, option, str + start, idx - start, false);
+
+            if (err != TCOAP_OK) {
+                return err;
+            }
+
+        } while (idx < len && str[idx] == '/');
+
+    } else if (idx < len && str[idx] == '/') {
+        idx++;
+    }
+
+    /* query */
+    if (idx < len && str[idx] == '?') {
+
+        do {
+            start = ++idx;
+
+            for (; idx < len && !is_delimiter(str[idx], "&#"); idx++);
+
+            option = add_option(uri, &arena, TCOAP_URI_QUERY_OPT);
+
+            if (option == NULL) {
+                return TCOAP_NO_FREE_MEM_ERROR;
+            }
+
+            err = decode_component(&arena, option, str + start, idx - start, false);
+
+            if (err != TCOAP_OK) {
+                return err;
+            }
+
+        } while (idx < len && str[idx] == '&');
+    }
+
+    /* rfc7252 6.4 (4): fragment is not allowed as well as the rest of unparsed data */
+    if (idx != len) {
+        return TCOAP_PARAM_ERROR;
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Parse scheme of URI and fill transport, security flag and default port
+ *
+ * @param uri - pointer on result of parsing
+ * @param str - pointer on scheme
+ * @param len - length of scheme
+ *
+ * @return true if scheme is supported
+ */
+static bool parse_scheme(tcoap_uri * const uri, const char * str, const uint32_t len)
+{
+    if (is_scheme(str, len, TCOAP_UDP_URI_SCHEME, TCOAP_URI_SCHEME_LEN(TCOAP_UDP_URI_SCHEME))) {
+
+        uri->transport = TCOAP_UDP;
+        uri->secure = false;
+        uri->port = TCOAP_UDP_DEFAULT_PORT;
+
+    } else if (is_scheme(str, len, TCOAP_UDP_SECURE_URI_SCHEME, TCOAP_URI_SCHEME_LEN(TCOAP_UDP_SECURE_URI_SCHEME))) {
+
+        uri->transport = TCOAP_UDP;
+        uri->secure = true;
+        uri->port = TCOAP_UDP_DEFAULT_SECURE_PORT;
+
+    } else if (is_scheme(str, len, TCOAP_TCP_URI_SCHEME, TCOAP_URI_SCHEME_LEN(TCOAP_TCP_URI_SCHEME))) {
+
+        uri->transport = TCOAP_TCP;
+        uri->secure = false;
+        uri->port = TCOAP_TCP_DEFAULT_PORT;
+
+    } else if (is_scheme(str, len, TCOAP_TCP_SECURE_URI_SCHEME, TCOAP_URI_SCHEME_LEN(TCOAP_TCP_SECURE_URI_SCHEME))) {
+
+        uri->transport = TCOAP_TCP;
+        uri->secure = true;
+        uri->port = TCOAP_TCP_DEFAULT_SECURE_PORT;
+
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Case-insensitive comparing of scheme
+ *
+ * @param str - pointer on scheme of URI
+ * @param len - length of scheme of URI
+ * @param scheme - expected scheme in the lower case
+ * @param scheme_len - length of expected scheme
+ *
+ * @return true if schemes are equal
+ */
+static bool is_scheme(const char * str, const uint32_t len, const char * scheme, const uint32_t scheme_len)
+{
+    uint32_t idx;
+    char c;
+
+    if (len != scheme_len) {
+        return false;
+    }
+
+    for (idx = 0; idx < len; idx++) {
+        c = (str[idx] >= 'A' && str[idx] <= 'Z') ? (str[idx] | 0x20) : str[idx];
+
+        if (c != scheme[idx]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Check that the char is one of delimiters
+ *
+ * @param c - char for checking
+ * @param delimiters - NULL terminated string of delimiters
+ *
+ * @return true if the char is a delimiter
+ */
+static bool is_delimiter(const char c, const char * delimiters)
+{
+    while (*delimiters) {
+        if (c == *delimiters++) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief Convert hex char to nibble
+ *
+ * @param c - hex char
+ *
+ * @return value of nibble or -1 if the char is not hex
+ */
+static int8_t hex_to_nibble(const char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+
+/**
+ * @brief Take a next option from the arena and link it to the end of list
+ *
+ * @param uri - pointer on result of parsing
+ * @param arena - arena of options and values
+ * @param num - number of option
+ *
+ * @return pointer on option or NULL if there is no free option in the arena
+ */
+static tcoap_option_data * add_option(tcoap_uri * const uri, tcoap_uri_arena * const arena, const uint16_t num)
+{
+    tcoap_option_data * option;
+
+    if (arena->options_cnt == arena->options_num) {
+        return NULL;
+    }
+
+    option = arena->options + arena->options_cnt;
+
+    option->num = num;
+    option->len = 0;
+    option->value = arena->values + arena->values_idx;
+    option->next = NULL;
+
+    if (arena->options_cnt) {
+        arena->options[arena->options_cnt - 1].next = option;
+    } else {
+        uri->options = option;
+    }
+
+    arena->options_cnt++;
+
+    return option;
+}
+
+
+/**
+ * @brief Percent-decode a component of URI into the value of option
+ *
+ * @param arena - arena of options and values
+ * @param option - option which value is being filled
+ * @param str - pointer on component of URI
+ * @param len - length of component
+ * @param lowercase - convert value to the lower case (for Uri-Host)
+ *
+ * @return status of operation
+ */
+static tcoap_error decode_component(tcoap_uri_arena * const arena, tcoap_option_data * const option, const char * str, const uint32_t len, const bool lowercase)
+{
+    uint32_t idx;
+    int8_t hi;
+    int8_t lo;
+    uint8_t byte;
+
+    for (idx = 0; idx < len; idx++) {
+
+        if (str[idx] == '%') {
+            if (idx + 2 >= len) {
+                return TCOAP_PARAM_ERROR;
+            }
+
+            hi = hex_to_nibble(str[idx + 1]);
+            lo = hex_to_nibble(str[idx + 2]);
+
+            if (hi < 0 || lo < 0) {
+                return TCOAP_PARAM_ERROR;
+            }
+
+            byte = (hi << 4) | lo;
+            idx += 2;
+        } else {
+            byte = str[idx];
+        }
+
+        if (lowercase && byte >= 'A' && byte <= 'Z') {
+            byte |= 0x20;
+        }
+
+        if (arena->values_idx == arena->values_len) {
+            return TCOAP_NO_FREE_MEM_ERROR;
+        }
+
+        arena->values[arena->values_idx++] = byte;
+        option->len++;
+    }
+
+    return TCOAP_OK;
+}
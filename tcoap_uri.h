@@ -0,0 +1,71 @@
+/**
+ * tcoap_uri.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#ifndef __TCOAP_URI_H
+#define __TCOAP_URI_H
+
+
+#include <stdint.h>
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Result of parsing of URI
+ *
+ */
+typedef struct tcoap_uri {
+
+    uint16_t transport;            /* TCOAP_UDP or TCOAP_TCP, depends on scheme */
+    uint16_t port;                 /* explicit port or default port of scheme */
+    bool secure;                   /* true for "coaps" and "coaps+tcp" schemes */
+
+    tcoap_data host;               /* host (without brackets for IP-literal), points into the URI string */
+    tcoap_option_data * options;   /* NULL terminated linked list of Uri-* options, NULL if there are no options */
+
+} tcoap_uri;
+
+
+/**
+ * @brief Parse URI (e.g. "coap+tcp://host:port/a/b?x=1") and decompose it into
+ *        Uri-Host, Uri-Port, Uri-Path and Uri-Query options (rfc7252, 6.4).
+ *        The string is parsed in one pass without dynamic allocation: options
+ *        are placed into the given array and their percent-decoded values are
+ *        placed into the given buffer. The list of options is already in the
+ *        ascending order, so it may be passed either to the request descriptor
+ *        or to 'tcoap_compile_request_template'.
+ *
+ * @param uri - pointer on result of parsing
+ * @param str - URI string (not necessarily NULL terminated)
+ * @param len - length of URI string
+ * @param options - array for storing options
+ * @param options_num - number of elements in the array of options
+ * @param values - buffer for storing values of options, should be alive while options are used
+ * @param values_len - length of buffer for values
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_parse_uri(tcoap_uri * const uri,
+        const char * str,
+        const uint32_t len,
+        tcoap_option_data * const options,
+        const uint32_t options_num,
+        uint8_t * const values,
+        const uint32_t values_len);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_URI_H */
@@ -18,8 +18,6 @@
 #define TCOAP_OPT_2BYTE              14
 #define TCOAP_OPT_DIS                15
 
-#define TCOAP_PAYLOAD_PREFIX         0xff
-
 
 
 /**
@@ -86,6 +84,37 @@ uint32_t encoding_options(uint8_t * const buf, const tcoap_option_data * options
 }
 
 
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t encoding_options_len(const tcoap_option_data * options)
+{
+    uint32_t len;
+
+    uint16_t delta;
+    uint16_t delta_sum;
+
+    delta_sum = 0;
+    len = 0;
+
+    do {
+        delta = options->num - delta_sum;
+        delta_sum += delta;
+
+        len += 1 + options->len;
+        len += delta < TCOAP_OPT_MIN ? 0 : (delta < TCOAP_OPT_MED ? 1 : 2);
+        len += options->len < TCOAP_OPT_MIN ? 0 : (options->len < TCOAP_OPT_MED ? 1 : 2);
+
+        options = options->next;
+
+    } while(options != NULL);
+
+
+    return len;
+}
+
+
 /**
  * @brief See description in the header file.
  *
@@ -104,10 +133,16 @@ tcoap_error decoding_options(const tcoap_data * const response,
     /* initialize */
     err = TCOAP_NO_OPTIONS_ERROR;
     idx = opt_start_idx;
+
+    /* options may absent as well as the payload */
+    if (idx >= response->len) {
+        goto return_label;
+    }
+
     opt = response->buf[idx++];
 
     /* decoding */
-    if (response->len > idx && opt != TCOAP_PAYLOAD_PREFIX) {
+    if (opt != TCOAP_PAYLOAD_PREFIX) {
         delta_sum = 0;
         options->next = NULL;
 
@@ -166,12 +201,22 @@ tcoap_error decoding_options(const tcoap_data * const response,
             }
 
             /* value */
+            if (idx + options->len > response->len) {
+                err = TCOAP_WRONG_OPTIONS_ERROR;
+                goto return_label;
+            }
+
             options->value = response->buf + idx;
 
             /* shift counters */
             idx += options->len;
             options->next = (options + 1);
 
+            /* options without payload end with the packet */
+            if (idx >= response->len) {
+                break;
+            }
+
             opt = response->buf[idx++];
 
         } while (opt != TCOAP_PAYLOAD_PREFIX);
@@ -189,6 +234,117 @@ return_label:
 }
 
 
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error decoding_next_option(const tcoap_data * const response, tcoap_option_data * const option, uint32_t * const idx)
+{
+    uint32_t i;
+    uint32_t delta;
+    uint32_t len;
+    uint8_t opt;
+
+    i = *idx;
+
+    if (i >= response->len || response->buf[i] == TCOAP_PAYLOAD_PREFIX) {
+        return TCOAP_NO_OPTIONS_ERROR;
+    }
+
+    opt = response->buf[i++];
+    delta = opt >> 4;
+    len = opt & 0x0F;
+
+    if (delta == TCOAP_OPT_DIS || len == TCOAP_OPT_DIS) {
+        return TCOAP_WRONG_OPTIONS_ERROR;
+    }
+
+    /* option */
+    if (delta == TCOAP_OPT_1BYTE) {
+        if (i + 1 > response->len) {
+            return TCOAP_WRONG_OPTIONS_ERROR;
+        }
+
+        delta = response->buf[i++] + TCOAP_OPT_MIN;
+    } else if (delta == TCOAP_OPT_2BYTE) {
+        if (i + 2 > response->len) {
+            return TCOAP_WRONG_OPTIONS_ERROR;
+        }
+
+        delta = ((uint32_t)response->buf[i] << 8 | response->buf[i + 1]) + TCOAP_OPT_MED;
+        i += 2;
+    }
+
+    /* length */
+    if (len == TCOAP_OPT_1BYTE) {
+        if (i + 1 > response->len) {
+            return TCOAP_WRONG_OPTIONS_ERROR;
+        }
+
+        len = response->buf[i++] + TCOAP_OPT_MIN;
+    } else if (len == TCOAP_OPT_2BYTE) {
+        if (i + 2 > response->len) {
+            return TCOAP_WRONG_OPTIONS_ERROR;
+        }
+
+        len = ((uint32_t)response->buf[i] << 8 | response->buf[i + 1]) + TCOAP_OPT_MED;
+        i += 2;
+    }
+
+    /* value */
+    if (i + len > response->len) {
+        return TCOAP_WRONG_OPTIONS_ERROR;
+    }
+
+    option->num += delta;
+    option->len = len;
+    option->value = response->buf + i;
+    option->next = NULL;
+
+    *idx = i + len;
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint16_t encoding_uint_option(uint8_t * const buf, const uint32_t value)
+{
+    uint16_t len;
+    uint16_t idx;
+
+    for (len = 0; len < 4 && (value >> (len * 8)); len++);
+
+    for (idx = 0; idx < len; idx++) {
+        buf[idx] = value >> ((len - idx - 1) * 8);
+    }
+
+    return len;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t decoding_uint_option(const tcoap_option_data * const option)
+{
+    uint32_t value;
+    uint32_t idx;
+
+    value = 0;
+
+    for (idx = 0; idx < option->len && idx < 4; idx++) {
+        value <<= 8;
+        value |= option->value[idx];
+    }
+
+    return value;
+}
+
+
 /**
  * @brief See description in the header file.
  *
@@ -203,3 +359,157 @@ uint32_t fill_payload(uint8_t * const buf, const tcoap_data * const payload)
 }
 
 
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t write_payload(uint8_t * const buf, const tcoap_request_descriptor * const reqd, const uint32_t max_len)
+{
+    uint32_t len;
+
+    if (reqd->tpl != NULL && reqd->tpl->payload_marker) {
+        /* the marker is already in the template */
+        return reqd->payload_writer(reqd, buf, max_len);
+    }
+
+    if (max_len < 2) {
+        return 0;
+    }
+
+    len = reqd->payload_writer(reqd, buf + 1, max_len - 1);
+
+    if (len) {
+        *buf = TCOAP_PAYLOAD_PREFIX;
+        len += 1;
+    }
+
+    return len;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+uint32_t fill_template(uint8_t * const buf, const tcoap_request_descriptor * const reqd)
+{
+    uint32_t len;
+
+    mem_copy(buf, reqd->tpl->body.buf, reqd->tpl->body.len);
+    len = reqd->tpl->body.len;
+
+    if (reqd->payload.len && reqd->payload_writer == NULL) {
+        if (reqd->payload_producer != NULL) {
+            /* the payload will be produced while sending */
+            if (!reqd->tpl->payload_marker) {
+                buf[len++] = TCOAP_PAYLOAD_PREFIX;
+            }
+        } else if (reqd->tpl->payload_marker) {
+            /* the marker and a prefix of payload are already in the template */
+            mem_copy(buf + len, reqd->payload.buf, reqd->payload.len);
+            len += reqd->payload.len;
+        } else {
+            len += fill_payload(buf + len, &reqd->payload);
+        }
+    }
+
+    return len;
+}
+
+
+#ifdef TCOAP_STATS_ENABLED
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_stats_add(tcoap_handle * const handle, uint32_t * const counter, const uint32_t value)
+{
+    /* accesses through volatile keep the counter between changes of sequence */
+    handle->stats_seq++;
+    *(volatile uint32_t *)counter += value;
+    handle->stats_seq++;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_stats_tx(tcoap_handle * const handle, const uint32_t bytes, const uint32_t len)
+{
+    volatile tcoap_stats * const stats = &handle->stats;
+
+    handle->stats_seq++;
+
+    stats->bytes_out += bytes;
+
+    if (len > stats->peak_tx_len) {
+        stats->peak_tx_len = len;
+    }
+
+    handle->stats_seq++;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_stats_rx(tcoap_handle * const handle, const uint32_t bytes, const uint32_t len)
+{
+    volatile tcoap_stats * const stats = &handle->stats;
+
+    handle->stats_seq++;
+
+    stats->bytes_in += bytes;
+
+    if (len > stats->peak_rx_len) {
+        stats->peak_rx_len = len;
+    }
+
+    handle->stats_seq++;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_stats_sent(tcoap_handle * const handle)
+{
+    handle->stats_sent_ms = tcoap_get_time_ms(handle);
+    TCOAP_SET_STATUS(handle, TCOAP_RTT_PENDING);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_stats_answered(tcoap_handle * const handle)
+{
+    uint32_t rtt;
+    uint32_t bucket;
+
+    if (!TCOAP_CHECK_STATUS(handle, TCOAP_RTT_PENDING)) {
+        return;
+    }
+
+    TCOAP_RESET_STATUS(handle, TCOAP_RTT_PENDING);
+
+    /* Karn's algorithm: the answer may belong to any transmission */
+    if (TCOAP_CHECK_STATUS(handle, TCOAP_RETRANSMITTED)) {
+        return;
+    }
+
+    rtt = tcoap_get_time_ms(handle) - handle->stats_sent_ms;
+
+    for (bucket = 0; bucket < TCOAP_STATS_RTT_BUCKETS - 1; ++bucket) {
+        if (rtt < ((uint32_t)TCOAP_STATS_RTT_MIN_MS << bucket)) {
+            break;
+        }
+    }
+
+    tcoap_stats_add(handle, &handle->stats.rtt[bucket], 1);
+}
+#endif /* TCOAP_STATS_ENABLED */
@@ -12,6 +12,9 @@
 
 
 #include "tcoap.h"
+#include "tcoap_capture.h"
+#include "tcoap_tx_queue.h"
+#include "tcoap_pool.h"
 
 
 #ifdef __cplusplus
@@ -19,14 +22,78 @@ extern "C" {
 #endif
 
 
+#define TCOAP_PAYLOAD_PREFIX         0xff
+
 #define TCOAP_CHECK_STATUS(h,s)      ((h)->statuses_mask & (s))
 #define TCOAP_SET_STATUS(h,s)        ((h)->statuses_mask |= (s))
 #define TCOAP_RESET_STATUS(h,s)      ((h)->statuses_mask &= ~(s))
 
+/* length of the tx buffer including room of lower layers */
+#define TCOAP_TX_BLOCK_LEN(h)        (TCOAP_ALIGN_UP((uint32_t)(h)->headroom) + TCOAP_MAX_PDU_SIZE + (h)->tailroom)
+
+#define TCOAP_RELIABLE_TRANSPORT(h)  ((h)->transport == TCOAP_TCP || (h)->transport == TCOAP_WS)
+
 #define TCOAP_CHECK_RESP(m,s)        ((m) & (s))
 #define TCOAP_SET_RESP(m,s)          ((m) |= (s))
 #define TCOAP_RESET_RESP(m,s)        ((m) = ~(s))
 
+/* the reason of rejection ('tcoap_reject_reason') is kept in the mask together with 'TCOAP_RESP_INVALID_PACKET' */
+#define TCOAP_RESP_REJECT(r)         ((uint32_t)TCOAP_RESP_INVALID_PACKET | ((uint32_t)(r) << 24))
+#define TCOAP_REJECT_REASON(m)       (((m) >> 24) & 0x0F)
+
+/* length of the payload marker which should be added before payload of request */
+#define TCOAP_PAYLOAD_MARKER_LEN(r)  (((r)->payload.len && ((r)->tpl == NULL || !(r)->tpl->payload_marker)) ? 1 : 0)
+
+/* length of payload of request which was given by buffer (not by the payload writer) */
+#define TCOAP_PAYLOAD_BUF_LEN(r)     ((r)->payload_writer == NULL ? (r)->payload.len + TCOAP_PAYLOAD_MARKER_LEN(r) : 0)
+
+/* tracing is compiled out entirely if it is disabled */
+#ifdef TCOAP_TRACE_ENABLED
+#define TCOAP_TRACE(h,p)             tcoap_trace((h), (p))
+#else
+#define TCOAP_TRACE(h,p)
+#endif /* TCOAP_TRACE_ENABLED */
+
+/* capture costs a check of the ring if it is stopped and nothing if it is disabled */
+#ifdef TCOAP_CAPTURE_ENABLED
+#define TCOAP_CAPTURE(h,d,b,l)       ((h)->capture != NULL ? tcoap_capture_packet((h), (d), (b), (l)) : (void)0)
+#else
+#define TCOAP_CAPTURE(h,d,b,l)
+#endif /* TCOAP_CAPTURE_ENABLED */
+
+/* the tx buffer is not touched between 'TCOAP_TX' and 'TCOAP_TX_DRAIN' */
+#ifdef TCOAP_TX_QUEUE_ENABLED
+#define TCOAP_TX(h,b,l)              ((h)->tx_queue != NULL ? tcoap_tx_queue_submit((h), (b), (l)) : tcoap_tx_data((h), (b), (l)))
+#define TCOAP_TX_DRAIN(h)            ((h)->tx_queue != NULL ? tcoap_tx_queue_drain(h) : TCOAP_OK)
+#else
+#define TCOAP_TX(h,b,l)              tcoap_tx_data((h), (b), (l))
+#define TCOAP_TX_DRAIN(h)            TCOAP_OK
+#endif /* TCOAP_TX_QUEUE_ENABLED */
+
+/* buffers of exchange are taken from the pool of handle if it is set */
+#ifdef TCOAP_POOL_ENABLED
+#define TCOAP_ALLOC_BLOCK(h,b,l)     ((h)->pool != NULL ? tcoap_pool_alloc((h)->pool, (h), (b), (l)) : tcoap_alloc_mem_block((b), (l)))
+#define TCOAP_FREE_BLOCK(h,b,l)      ((h)->pool != NULL ? tcoap_pool_free((h)->pool, (h), (b)) : tcoap_free_mem_block((b), (l)))
+#else
+#define TCOAP_ALLOC_BLOCK(h,b,l)     tcoap_alloc_mem_block((b), (l))
+#define TCOAP_FREE_BLOCK(h,b,l)      tcoap_free_mem_block((b), (l))
+#endif /* TCOAP_POOL_ENABLED */
+
+/* statistics are compiled out entirely if they are disabled */
+#ifdef TCOAP_STATS_ENABLED
+#define TCOAP_STATS_INC(h,f)         tcoap_stats_add((h), &(h)->stats.f, 1)
+#define TCOAP_STATS_TX(h,n,l)        tcoap_stats_tx((h), (n), (l))
+#define TCOAP_STATS_RX(h,n,l)        tcoap_stats_rx((h), (n), (l))
+#define TCOAP_STATS_SENT(h)          tcoap_stats_sent(h)
+#define TCOAP_STATS_ANSWERED(h)      tcoap_stats_answered(h)
+#else
+#define TCOAP_STATS_INC(h,f)
+#define TCOAP_STATS_TX(h,n,l)
+#define TCOAP_STATS_RX(h,n,l)
+#define TCOAP_STATS_SENT(h)
+#define TCOAP_STATS_ANSWERED(h)
+#endif /* TCOAP_STATS_ENABLED */
+
 
 
 typedef enum {
@@ -36,6 +103,8 @@ typedef enum {
 
      TCOAP_SENDING_PACKET  = (int) 0x0001,
      TCOAP_WAITING_RESP    = (int) 0x0002,
+     TCOAP_RETRANSMITTED   = (int) 0x0004,   /* request was retransmitted, its RTT is ambiguous */
+     TCOAP_RTT_PENDING     = (int) 0x0008,   /* the first answer to request is awaited (statistics) */
 
      TCOAP_DEBUG_ON        = (int) 0x0080
 
@@ -53,7 +122,7 @@ typedef enum {
 
     TCOAP_RESP_SUCCESS_CODE     = (int) 0x00000010,
     TCOAP_RESP_FAILURE_CODE     = (int) 0x00000020,
-    TCOAP_RESP_TCP_SIGNAL_CODE  = (int) 0x00000020,
+    TCOAP_RESP_TCP_SIGNAL_CODE  = (int) 0x00000040,
 
     TCOAP_RESP_NEED_SEND_ACK    = (int) 0x00000100,
 
@@ -74,6 +143,16 @@ typedef enum {
 uint32_t encoding_options(uint8_t * const buf, const tcoap_option_data * option);
 
 
+/**
+ * @brief Calculate length of encoded options
+ *
+ * @param option - pointer on first element of linked list of options. Must not be NULL.
+ *
+ * @return length of data that will be added to the buffer by 'encoding_options'
+ */
+uint32_t encoding_options_len(const tcoap_option_data * option);
+
+
 /**
  * @brief Decoding options from response
  *
@@ -90,6 +169,39 @@ tcoap_error decoding_options(const tcoap_data * const response,
         uint32_t * const payload_start_idx);
 
 
+/**
+ * @brief Decoding a next option from response without storing of all options
+ *
+ * @param response - incoming packet
+ * @param option - pointer on option, its 'num' should be 0 before the first call
+ * @param idx - pointer on index of the next option in the incoming packet
+ *
+ * @return status of operations ('TCOAP_NO_OPTIONS_ERROR' if there are no more options)
+ */
+tcoap_error decoding_next_option(const tcoap_data * const response, tcoap_option_data * const option, uint32_t * const idx);
+
+
+/**
+ * @brief Encoding an unsigned integer value of option (minimal length)
+ *
+ * @param buf - buffer for storing value (max length is 4)
+ * @param value - value of option
+ *
+ * @return length of encoded value
+ */
+uint16_t encoding_uint_option(uint8_t * const buf, const uint32_t value);
+
+
+/**
+ * @brief Decoding an unsigned integer value of option
+ *
+ * @param option - pointer on option
+ *
+ * @return value of option
+ */
+uint32_t decoding_uint_option(const tcoap_option_data * const option);
+
+
 /**
  * @brief Add payload to the packet
  *
@@ -101,6 +213,77 @@ tcoap_error decoding_options(const tcoap_data * const response,
 uint32_t fill_payload(uint8_t * const buf, const tcoap_data * const payload);
 
 
+/**
+ * @brief Add payload to the packet through the payload writer of request
+ *
+ * @param buf - pointer on packet buffer
+ * @param reqd - descriptor of request with not NULL payload writer
+ * @param max_len - free space in the packet buffer
+ *
+ * @return length of data that was added to the buffer
+ */
+uint32_t write_payload(uint8_t * const buf, const tcoap_request_descriptor * const reqd, const uint32_t max_len);
+
+
+/**
+ * @brief Add precompiled options (template) and payload to the packet
+ *
+ * @param buf - pointer on packet buffer
+ * @param reqd - descriptor of request with not NULL template
+ *
+ * @return length of data that was added to the buffer
+ */
+uint32_t fill_template(uint8_t * const buf, const tcoap_request_descriptor * const reqd);
+
+
+#ifdef TCOAP_STATS_ENABLED
+/**
+ * @brief Add a value to a counter of statistics
+ *
+ * @param handle - coap handle
+ * @param counter - pointer on the counter in 'stats' of handle
+ * @param value - value to add
+ */
+void tcoap_stats_add(tcoap_handle * const handle, uint32_t * const counter, const uint32_t value);
+
+
+/**
+ * @brief Count sent bytes
+ *
+ * @param handle - coap handle
+ * @param bytes - number of sent bytes
+ * @param len - length of the message in the tx buffer (for its peak)
+ */
+void tcoap_stats_tx(tcoap_handle * const handle, const uint32_t bytes, const uint32_t len);
+
+
+/**
+ * @brief Count received bytes
+ *
+ * @param handle - coap handle
+ * @param bytes - number of received bytes
+ * @param len - length of the message in the rx buffer (for its peak)
+ */
+void tcoap_stats_rx(tcoap_handle * const handle, const uint32_t bytes, const uint32_t len);
+
+
+/**
+ * @brief Remember the time of sending of request, RTT is counted by its first answer
+ *
+ * @param handle - coap handle
+ */
+void tcoap_stats_sent(tcoap_handle * const handle);
+
+
+/**
+ * @brief Count the RTT of request if it is the first answer to it
+ *
+ * @param handle - coap handle
+ */
+void tcoap_stats_answered(tcoap_handle * const handle);
+#endif /* TCOAP_STATS_ENABLED */
+
+
 #ifdef  __cplusplus
 }
 #endif
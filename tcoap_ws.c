@@ -0,0 +1,452 @@
+/**
+ * tcoap_ws.c
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ */
+
+
+#include "tcoap_ws.h"
+#include "tcoap_tcp.h"
+#include "tcoap_utils.h"
+
+
+
+#define TCOAP_WS_MIN_HEADER_LEN      2u
+
+#define TCOAP_WS_FIN_BIT             0x80
+#define TCOAP_WS_MASK_BIT            0x80
+#define TCOAP_WS_OPCODE_MASK         0x0f
+#define TCOAP_WS_LEN_MASK            0x7f
+#define TCOAP_WS_CONTROL_BIT         0x08
+
+#define TCOAP_WS_LEN_2BYTES          126
+#define TCOAP_WS_LEN_8BYTES          127
+
+#define TCOAP_WS_CLOSE_STATUS_LEN    2
+
+
+
+static uint32_t calc_header_length(const tcoap_ws_receiver * const receiver);
+static tcoap_error start_frame(tcoap_ws_receiver * const receiver);
+static tcoap_error receive_payload(tcoap_ws_receiver * const receiver, uint8_t * chunk, const uint32_t len);
+static void finish_frame(tcoap_ws_receiver * const receiver);
+static void send_control(tcoap_ws_receiver * const receiver, const uint8_t opcode, const uint32_t len);
+
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_ws_receiver_init(tcoap_ws_receiver * const receiver, tcoap_handle * const handle)
+{
+    receiver->handle = handle;
+    receiver->header_len = 0;
+    receiver->frame_len = 0;
+    receiver->received = 0;
+    receiver->msg_len = 0;
+    receiver->drop = true;
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    receiver->catching = false;
+#endif /* TCOAP_LIVENESS_ENABLED */
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_ws_receiver_feed(tcoap_ws_receiver * const receiver, uint8_t * chunk, const uint32_t len)
+{
+    tcoap_error err;
+    tcoap_error status;
+    uint32_t idx;
+    uint32_t cnt;
+
+    err = TCOAP_OK;
+
+    for (idx = 0; idx < len; idx += cnt) {
+
+        /* collect header of frame */
+        if (receiver->header_len < calc_header_length(receiver)) {
+
+            receiver->header[receiver->header_len++] = chunk[idx];
+            cnt = 1;
+
+            if (receiver->header_len == calc_header_length(receiver)) {
+
+                status = start_frame(receiver);
+
+                if (status != TCOAP_OK) {
+                    err = status;
+                }
+
+                if (!receiver->frame_len) {
+                    finish_frame(receiver);
+                }
+            }
+
+            continue;
+        }
+
+        cnt = receiver->frame_len - receiver->received;
+
+        if (cnt > len - idx) {
+            cnt = len - idx;
+        }
+
+        status = receive_payload(receiver, chunk + idx, cnt);
+
+        if (status != TCOAP_OK) {
+            err = status;
+        }
+
+        receiver->received += cnt;
+
+        if (receiver->received == receiver->frame_len) {
+            finish_frame(receiver);
+        }
+    }
+
+    return err;
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+tcoap_error tcoap_ws_tx_frame_header(tcoap_handle * const handle, const uint8_t opcode, const uint32_t len, uint8_t * const mask)
+{
+    tcoap_error err;
+    uint8_t header[TCOAP_WS_MAX_HEADER_LEN];
+    uint32_t idx;
+
+    /* rfc6455 5.3: the masking key must be unpredictable */
+    err = tcoap_fill_token(handle, mask, TCOAP_WS_MASK_LEN);
+
+    if (err != TCOAP_OK) {
+        return err;
+    }
+
+    header[0] = TCOAP_WS_FIN_BIT | opcode;
+    idx = TCOAP_WS_MIN_HEADER_LEN;
+
+    if (len < TCOAP_WS_LEN_2BYTES) {
+
+        header[1] = TCOAP_WS_MASK_BIT | len;
+
+    } else if (len <= 0xffff) {
+
+        header[1] = TCOAP_WS_MASK_BIT | TCOAP_WS_LEN_2BYTES;
+        header[idx++] = len >> 8;
+        header[idx++] = len;
+
+    } else {
+
+        header[1] = TCOAP_WS_MASK_BIT | TCOAP_WS_LEN_8BYTES;
+        header[idx++] = 0;
+        header[idx++] = 0;
+        header[idx++] = 0;
+        header[idx++] = 0;
+        header[idx++] = len >> 24;
+        header[idx++] = len >> 16;
+        header[idx++] = len >> 8;
+        header[idx++] = len;
+    }
+
+    mem_copy(header + idx, mask, TCOAP_WS_MASK_LEN);
+    idx += TCOAP_WS_MASK_LEN;
+
+    /* the header is sent from the stack, the queued data should not be interleaved with it */
+    err = TCOAP_TX_DRAIN(handle);
+
+    if (err != TCOAP_OK) {
+        return err;
+    }
+
+    return tcoap_tx_data(handle, header, idx);
+}
+
+
+/**
+ * @brief See description in the header file.
+ *
+ */
+void tcoap_ws_mask(uint8_t * buf, const uint32_t len, const uint8_t * const mask, const uint32_t offset)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] ^= mask[(offset + i) & (TCOAP_WS_MASK_LEN - 1)];
+    }
+}
+
+
+/**
+ * @brief Calculate length of header of the current frame by its collected part
+ *
+ * @param receiver - pointer on the receiver
+ *
+ * @return length of header
+ */
+static uint32_t calc_header_length(const tcoap_ws_receiver * const receiver)
+{
+    uint32_t len;
+
+    if (receiver->header_len < TCOAP_WS_MIN_HEADER_LEN) {
+        return TCOAP_WS_MIN_HEADER_LEN;
+    }
+
+    len = TCOAP_WS_MIN_HEADER_LEN;
+
+    switch (receiver->header[1] & TCOAP_WS_LEN_MASK) {
+        case TCOAP_WS_LEN_2BYTES:
+            len += 2;
+            break;
+
+        case TCOAP_WS_LEN_8BYTES:
+            len += 8;
+            break;
+
+        default:
+            break;
+    }
+
+    if (receiver->header[1] & TCOAP_WS_MASK_BIT) {
+        len += TCOAP_WS_MASK_LEN;
+    }
+
+    return len;
+}
+
+
+/**
+ * @brief Parse the collected header and start the frame. A data frame of
+ *        the binary message which is not awaited is dropped (text messages
+ *        are not used by CoAP, rfc8323 4.2).
+ *
+ * @param receiver - pointer on the receiver
+ *
+ * @return status of operation
+ */
+static tcoap_error start_frame(tcoap_ws_receiver * const receiver)
+{
+    const uint8_t * header;
+    uint32_t idx;
+
+    header = receiver->header;
+    idx = TCOAP_WS_MIN_HEADER_LEN;
+
+    receiver->fin = (header[0] & TCOAP_WS_FIN_BIT) != 0;
+    receiver->opcode = header[0] & TCOAP_WS_OPCODE_MASK;
+    receiver->masked = (header[1] & TCOAP_WS_MASK_BIT) != 0;
+    receiver->received = 0;
+
+    switch (header[1] & TCOAP_WS_LEN_MASK) {
+        case TCOAP_WS_LEN_2BYTES:
+            receiver->frame_len = ((uint32_t)header[2] << 8) | header[3];
+            idx += 2;
+            break;
+
+        case TCOAP_WS_LEN_8BYTES:
+            receiver->frame_len = ((uint32_t)header[6] << 24) | ((uint32_t)header[7] << 16)
+                    | ((uint32_t)header[8] << 8) | header[9];
+
+            /* such frames can't be received by this lib at all, they are skipped */
+            if (header[2] | header[3] | header[4] | header[5]) {
+                receiver->frame_len = 0xffffffff;
+            }
+
+            idx += 8;
+            break;
+
+        default:
+            receiver->frame_len = header[1] & TCOAP_WS_LEN_MASK;
+            break;
+    }
+
+    if (receiver->masked) {
+        mem_copy(receiver->mask, header + idx, TCOAP_WS_MASK_LEN);
+    }
+
+    /* control frames may be injected in the middle of fragmented message */
+    if (receiver->opcode & TCOAP_WS_CONTROL_BIT) {
+        return TCOAP_OK;
+    }
+
+    /* the first frame of message */
+    if (receiver->opcode != TCOAP_WS_CONTINUATION_FRAME) {
+        receiver->msg_len = 0;
+        receiver->drop = receiver->opcode != TCOAP_WS_BINARY_FRAME
+                || !TCOAP_CHECK_STATUS(receiver->handle, TCOAP_WAITING_RESP);
+
+#ifdef TCOAP_LIVENESS_ENABLED
+        /* a binary message between exchanges is kept if it may be the Ping signal */
+        receiver->catching = receiver->opcode == TCOAP_WS_BINARY_FRAME && receiver->drop;
+#endif /* TCOAP_LIVENESS_ENABLED */
+    }
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    if (receiver->catching && receiver->frame_len > TCOAP_WS_MAX_SIGNAL_LEN - receiver->msg_len) {
+        receiver->catching = false;
+    }
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+    if (!receiver->drop && receiver->frame_len > TCOAP_MAX_PDU_SIZE - receiver->msg_len) {
+        receiver->drop = true;
+
+        TCOAP_STATS_INC(receiver->handle, rx_overflows);
+        tcoap_tx_signal(receiver->handle, TCOAP_RESPONSE_TO_LONG_ERROR);
+
+        return TCOAP_RX_BUFF_FULL_ERROR;
+    }
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Receive a part of payload of the current frame. The part is unmasked
+ *        in place and the data of message is stored right in the rx buffer.
+ *
+ * @param receiver - pointer on the receiver
+ * @param chunk - pointer on the part of payload
+ * @param len - length of the part
+ *
+ * @return status of operation
+ */
+static tcoap_error receive_payload(tcoap_ws_receiver * const receiver, uint8_t * chunk, const uint32_t len)
+{
+    if (receiver->opcode & TCOAP_WS_CONTROL_BIT) {
+
+        if (receiver->frame_len > TCOAP_WS_MAX_CONTROL_LEN) {
+            return TCOAP_OK;
+        }
+
+        if (receiver->masked) {
+            tcoap_ws_mask(chunk, len, receiver->mask, receiver->received);
+        }
+
+        mem_copy(receiver->control + receiver->received, chunk, len);
+        return TCOAP_OK;
+    }
+
+    if (receiver->drop) {
+#ifdef TCOAP_LIVENESS_ENABLED
+        if (receiver->catching) {
+            if (receiver->masked) {
+                tcoap_ws_mask(chunk, len, receiver->mask, receiver->received);
+            }
+
+            mem_copy(receiver->signal + receiver->msg_len, chunk, len);
+            receiver->msg_len += len;
+        }
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+        return TCOAP_OK;
+    }
+
+    /* the exchange was finished (e.g. by timeout) in the middle of message */
+    if (!TCOAP_CHECK_STATUS(receiver->handle, TCOAP_WAITING_RESP)) {
+        receiver->drop = true;
+        return TCOAP_WRONG_STATE_ERROR;
+    }
+
+    if (receiver->masked) {
+        tcoap_ws_mask(chunk, len, receiver->mask, receiver->received);
+    }
+
+    mem_copy(receiver->handle->response.buf + receiver->msg_len, chunk, len);
+    receiver->msg_len += len;
+
+    return TCOAP_OK;
+}
+
+
+/**
+ * @brief Finish the current frame. The message is delivered by its last frame,
+ *        Ping and Close of server are answered.
+ *
+ * @param receiver - pointer on the receiver
+ *
+ */
+static void finish_frame(tcoap_ws_receiver * const receiver)
+{
+    receiver->header_len = 0;
+
+    switch (receiver->opcode) {
+        case TCOAP_WS_CONTINUATION_FRAME:
+        case TCOAP_WS_TEXT_FRAME:
+        case TCOAP_WS_BINARY_FRAME:
+            if (!receiver->fin) {
+                break;
+            }
+
+            if (!receiver->drop) {
+                receiver->handle->response.len = receiver->msg_len;
+
+                TCOAP_STATS_RX(receiver->handle, receiver->msg_len, receiver->msg_len);
+                tcoap_tx_signal(receiver->handle, TCOAP_RESPONSE_DID_RECEIVE);
+            }
+
+#ifdef TCOAP_LIVENESS_ENABLED
+            /* the Pong will be sent by 'tcoap_keepalive' */
+            if (receiver->catching) {
+                tcoap_tcp_catch_ping(receiver->handle, receiver->signal, receiver->msg_len);
+                receiver->catching = false;
+            }
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+            /* continuation frames without the first one will be dropped */
+            receiver->drop = true;
+            break;
+
+        case TCOAP_WS_PING_FRAME:
+            if (receiver->frame_len <= TCOAP_WS_MAX_CONTROL_LEN) {
+                /* rfc6455 5.5.3: the Pong echoes the application data of Ping */
+                send_control(receiver, TCOAP_WS_PONG_FRAME, receiver->frame_len);
+            }
+            break;
+
+        case TCOAP_WS_CLOSE_FRAME:
+            /* rfc6455 5.5.1: the Close is answered, the status code is echoed */
+            send_control(receiver, TCOAP_WS_CLOSE_FRAME, receiver->frame_len < TCOAP_WS_CLOSE_STATUS_LEN ? 0 : TCOAP_WS_CLOSE_STATUS_LEN);
+            tcoap_tx_signal(receiver->handle, TCOAP_CLOSE_DID_RECEIVE);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+/**
+ * @brief Send the control frame with the beginning of the received control data.
+ *        The answer is sent from the rx context, so it is skipped while the
+ *        request is being sent for keeping the tx stream consistent.
+ *
+ * @param receiver - pointer on the receiver
+ * @param opcode - opcode of frame
+ * @param len - length of payload of frame
+ *
+ */
+static void send_control(tcoap_ws_receiver * const receiver, const uint8_t opcode, const uint32_t len)
+{
+    uint8_t mask[TCOAP_WS_MASK_LEN];
+
+    if (TCOAP_CHECK_STATUS(receiver->handle, TCOAP_SENDING_PACKET)
+            && !TCOAP_CHECK_STATUS(receiver->handle, TCOAP_WAITING_RESP)) {
+        return;
+    }
+
+    if (tcoap_ws_tx_frame_header(receiver->handle, opcode, len, mask) != TCOAP_OK) {
+        return;
+    }
+
+    tcoap_ws_mask(receiver->control, len, mask, 0);
+    tcoap_tx_data(receiver->handle, receiver->control, len);
+}
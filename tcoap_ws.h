@@ -0,0 +1,170 @@
+/**
+ * tcoap_ws.h
+ *
+ * Author: Serge Maslyakov, rusoil.9@gmail.com
+ * Copyright 2017 Serge Maslyakov. All rights reserved.
+ *
+ * Aims: CoAP over WebSockets (rfc8323, 4). Messages have the format of CoAP
+ *       over TCP with the elided length (Len = 0), each message is carried by
+ *       one binary WebSocket message. The opening handshake (HTTP Upgrade with
+ *       the "coap" subprotocol) is a user responsibility.
+ *
+ */
+
+
+#ifndef __TCOAP_WS_H
+#define __TCOAP_WS_H
+
+
+#include "tcoap.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#ifndef TCOAP_WS_MAX_CONTROL_LEN
+#define TCOAP_WS_MAX_CONTROL_LEN        125       /* payload of Ping/Close which is echoed, rfc6455 5.5 */
+#endif /* TCOAP_WS_MAX_CONTROL_LEN */
+
+#define TCOAP_WS_MAX_HEADER_LEN         14
+#define TCOAP_WS_MASK_LEN               4
+
+/* the longest message which is kept between exchanges: the Ping signal (7.02)
+ * without options, i.e. Len/TKL, code and token */
+#define TCOAP_WS_MAX_SIGNAL_LEN         (2 + TCOAP_MAX_TOKEN_LEN)
+
+
+typedef enum {
+
+    TCOAP_WS_CONTINUATION_FRAME = 0x0,
+    TCOAP_WS_TEXT_FRAME = 0x1,
+    TCOAP_WS_BINARY_FRAME = 0x2,
+    TCOAP_WS_CLOSE_FRAME = 0x8,
+    TCOAP_WS_PING_FRAME = 0x9,
+    TCOAP_WS_PONG_FRAME = 0xA
+
+} tcoap_ws_opcode;
+
+
+/**
+ *  WebSocket frame header, rfc6455 (5.2)
+ *
+ *   0                   1                   2                   3
+ *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *  +-+-+-+-+-------+-+-------------+-------------------------------+
+ *  |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+ *  |I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
+ *  |N|V|V|V|       |S|             |   (if payload len==126/127)   |
+ *  +-+-+-+-+-------+-+-------------+ - - - - - - - - - - - - - - - +
+ *  |     Extended payload length continued, if payload len == 127  |
+ *  + - - - - - - - - - - - - - - - +-------------------------------+
+ *  |                               |Masking-key, if MASK set to 1  |
+ *  +-------------------------------+-------------------------------+
+ *  | Masking-key (continued)       |          Payload Data         |
+ *  +-------------------------------- - - - - - - - - - - - - - - - +
+ *
+ */
+
+
+/**
+ * Receiver of WebSocket stream. Payload of binary frames (including fragmented
+ * messages) is written and unmasked right in the rx buffer of handle, so only
+ * the frame header is collected here. Ping and Close of server are answered.
+ * A short message between exchanges is kept here: if it is the Ping signal
+ * of CoAP, the Pong is sent by 'tcoap_keepalive' (as over TCP).
+ *
+ * The answers to Ping and Close are sent right from 'tcoap_ws_receiver_feed'
+ * by a blocking 'tcoap_tx_data' (after 'tcoap_wait_tx' if the tx queue is
+ * attached), also while an exchange is waiting the response. So the context
+ * which feeds the receiver (a socket task, not an interrupt) should be allowed
+ * to send, and 'tcoap_tx_data' should not wait for the task which is blocked
+ * in 'tcoap_wait_event'. The answers are not sent while the request is being
+ * sent, the server is not answered then.
+ *
+ */
+typedef struct tcoap_ws_receiver {
+
+    tcoap_handle * handle;
+
+    uint8_t header[TCOAP_WS_MAX_HEADER_LEN];
+    uint8_t header_len;      /* collected bytes of header of the current frame */
+
+    uint8_t opcode;          /* opcode of the current frame */
+    bool fin;                /* the current frame is the last fragment of message */
+    bool masked;
+    uint8_t mask[TCOAP_WS_MASK_LEN];
+
+    uint32_t frame_len;      /* length of payload of the current frame */
+    uint32_t received;       /* received bytes of payload of the current frame */
+
+    uint32_t msg_len;        /* length of message assembled from fragments */
+    bool drop;               /* the current message is not awaited or too long */
+
+#ifdef TCOAP_LIVENESS_ENABLED
+    bool catching;           /* the current message is not awaited, it may be the Ping signal */
+    uint8_t signal[TCOAP_WS_MAX_SIGNAL_LEN];
+#endif /* TCOAP_LIVENESS_ENABLED */
+
+    uint8_t control[TCOAP_WS_MAX_CONTROL_LEN];
+
+} tcoap_ws_receiver;
+
+
+/**
+ * @brief Init receiver of WebSocket stream
+ *
+ * @param receiver - pointer on the receiver
+ * @param handle - coap handle, messages are delivered to it
+ *
+ */
+void tcoap_ws_receiver_init(tcoap_ws_receiver * const receiver, tcoap_handle * const handle);
+
+
+/**
+ * @brief Feed a chunk of WebSocket stream (of any length) to the receiver.
+ *        The chunk is unmasked in place if the server masks frames. Control
+ *        frames of server are answered from here (see above).
+ *
+ * @param receiver - pointer on the receiver
+ * @param chunk - pointer on received data
+ * @param len - length of received data
+ *
+ * @return status of operation ('TCOAP_RX_BUFF_FULL_ERROR' if some message was dropped)
+ */
+tcoap_error tcoap_ws_receiver_feed(tcoap_ws_receiver * const receiver, uint8_t * chunk, const uint32_t len);
+
+
+/**
+ * @brief Send header of the masked frame, the payload should be masked by
+ *        'tcoap_ws_mask' and sent by the 'tcoap_tx_data'. The tx queue (if any)
+ *        is drained before. Do not use it directly.
+ *
+ * @param handle - coap handle
+ * @param opcode - opcode of frame
+ * @param len - length of payload of frame
+ * @param mask - pointer on buffer for masking key (4 bytes), it is generated here
+ *
+ * @return status of operation
+ */
+tcoap_error tcoap_ws_tx_frame_header(tcoap_handle * const handle, const uint8_t opcode, const uint32_t len, uint8_t * const mask);
+
+
+/**
+ * @brief Mask/unmask data in place. Do not use it directly.
+ *
+ * @param buf - pointer on data
+ * @param len - length of data
+ * @param mask - masking key
+ * @param offset - offset of data in the payload of frame
+ *
+ */
+void tcoap_ws_mask(uint8_t * buf, const uint32_t len, const uint8_t * const mask, const uint32_t offset);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* __TCOAP_WS_H */